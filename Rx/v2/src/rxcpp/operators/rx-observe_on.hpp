@@ -139,7 +139,7 @@ struct observe_on
         std::shared_ptr<observe_on_state> state;
 
         observe_on_observer(dest_type d, coordinator_type coor, composite_subscription cs)
-            : state(std::make_shared<observe_on_state>(std::move(d), std::move(coor), std::move(cs)))
+            : state(rxcpp::detail::make_state<observe_on_state>(std::move(d), std::move(coor), std::move(cs)))
         {
         }
 
@@ -274,6 +274,49 @@ inline observe_on_one_worker observe_on_new_thread() {
     return r;
 }
 
+/// like observe_on_new_thread(), but the thread of each subscription is
+/// taken from, and given back to, a shared thread_cache
+inline observe_on_one_worker observe_on_cached_new_thread() {
+    static observe_on_one_worker r(rxsc::make_cached_new_thread());
+    return r;
+}
+
+inline observe_on_one_worker observe_on_work_stealing() {
+    static observe_on_one_worker r(rxsc::make_work_stealing());
+    return r;
+}
+
+inline observe_on_one_worker observe_on_run_loop(const rxsc::run_loop& rl) {
+    return observe_on_one_worker(rxsc::make_run_loop(rl));
+}
+
+/// deliver on shard i. each subscription queues onto the lock-free inbox
+/// of the shard.
+inline observe_on_one_worker observe_on_shard(const rxsc::shards& s, size_t i) {
+    return observe_on_one_worker(rxsc::make_shard(s, i));
+}
+
+/// deliver on the default deadline_pool. each drain of the queued
+/// notifications must finish within budget of the first notification.
+inline observe_on_one_worker observe_on_deadline(rxsc::scheduler::clock_type::duration budget) {
+    return observe_on_one_worker(rxsc::make_deadline(rxsc::default_deadline_pool(), budget));
+}
+
+inline observe_on_one_worker observe_on_deadline(const rxsc::deadline_pool& pool, rxsc::scheduler::clock_type::duration budget) {
+    return observe_on_one_worker(rxsc::make_deadline(pool, budget));
+}
+
+#if RXCPP_USE_EPOLL
+inline observe_on_one_worker observe_on_reactor() {
+    static observe_on_one_worker r(rxsc::make_reactor(rxsc::default_reactor()));
+    return r;
+}
+
+inline observe_on_one_worker observe_on_reactor(const rxsc::reactor& re) {
+    return observe_on_one_worker(rxsc::make_reactor(re));
+}
+#endif
+
 }
 
 #endif
@@ -121,7 +121,7 @@ struct reduce : public operator_base<typename reduce_traits<T, SourceOperator, A
             seed_type current;
             Subscriber out;
         };
-        auto state = std::make_shared<reduce_state_type>(initial, std::move(o));
+        auto state = rxcpp::detail::make_state<reduce_state_type>(initial, std::move(o));
         state->source.subscribe(
             state->out,
         // on_next
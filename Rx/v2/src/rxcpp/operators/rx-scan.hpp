@@ -59,7 +59,7 @@ struct scan : public operator_base<typename std::decay<Seed>::type>
             seed_type result;
             Subscriber out;
         };
-        auto state = std::make_shared<scan_state_type>(initial, std::move(o));
+        auto state = rxcpp::detail::make_state<scan_state_type>(initial, std::move(o));
         state->source.subscribe(
             state->out,
         // on_next
@@ -66,7 +66,7 @@ struct subscribe_on : public operator_base<T>
         auto controller = coordinator.get_worker();
 
         // take a copy of the values for each subscription
-        auto state = std::shared_ptr<subscribe_on_state_type>(new subscribe_on_state_type(initial, std::move(coordinator), std::move(s)));
+        auto state = rxcpp::detail::make_state<subscribe_on_state_type>(initial, std::move(coordinator), std::move(s));
 
         auto disposer = [=](const rxsc::schedulable&){
             state->source_lifetime.unsubscribe();
@@ -79,12 +79,15 @@ struct subscribe_on : public operator_base<T>
             return;
         }
 
-        state->out.add([=](){
-            controller.schedule(selectedDisposer.get());
-        });
-        state->source_lifetime.add([=](){
-            controller.schedule(selectedDisposer.get());
-        });
+        // unsubscribe is control work, so it does not wait behind the
+        // values queued on the worker
+        auto dispose = [=](){
+            auto scbl = rxsc::make_schedulable(controller, selectedDisposer.get());
+            scbl.set_priority(rxsc::priority::high);
+            controller.schedule(scbl);
+        };
+        state->out.add(dispose);
+        state->source_lifetime.add(dispose);
 
         auto producer = [=](const rxsc::schedulable&){
             state->source.subscribe(state->source_lifetime, state->out);
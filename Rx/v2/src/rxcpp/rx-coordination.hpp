@@ -171,6 +171,11 @@ inline identity_one_worker identity_current_thread() {
     return r;
 }
 
+/// keeps the work of a subscription on shard i, with no hop
+inline identity_one_worker identity_shard(const rxsc::shards& s, size_t i) {
+    return identity_one_worker(rxsc::make_shard(s, i));
+}
+
 class serialize_one_worker : public coordination_base
 {
     rxsc::scheduler factory;
@@ -297,6 +302,11 @@ inline serialize_one_worker serialize_new_thread() {
     return r;
 }
 
+inline serialize_one_worker serialize_work_stealing() {
+    static serialize_one_worker r(rxsc::make_work_stealing());
+    return r;
+}
+
 
 }
 
@@ -0,0 +1,428 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_COROUTINE_HPP)
+#define RXCPP_RX_COROUTINE_HPP
+
+#include "rx-includes.hpp"
+
+#if RXCPP_USE_COROUTINES
+
+#include <coroutine>
+#include <optional>
+#include <utility>
+
+namespace rxcpp {
+
+namespace detail {
+
+// resumes a suspended coroutine from a scheduled action. when the frame
+// is owned, an action that is dropped without running destroys the frame
+// so that an unsubscribed producer does not leak. otherwise the frame is
+// left suspended and whoever owns the coroutine must destroy it.
+class coroutine_resumer
+{
+    typedef coroutine_resumer this_type;
+    coroutine_resumer(const this_type&);
+
+    std::coroutine_handle<> handle;
+    bool owned;
+
+public:
+    coroutine_resumer(std::coroutine_handle<> h, bool o)
+        : handle(h)
+        , owned(o)
+    {
+    }
+    ~coroutine_resumer()
+    {
+        if (handle && owned) {
+            handle.destroy();
+        }
+    }
+    void resume() {
+        auto h = handle;
+        handle = nullptr;
+        h.resume();
+    }
+};
+
+// the coroutine may run to the end inside schedule() and free the frame
+// that holds the arguments, so they are all taken by value.
+inline void resume_from(rxsc::worker controller, composite_subscription lifetime, bool timed, rxsc::scheduler::clock_type::time_point when, std::coroutine_handle<> h, bool owned) {
+    auto resumer = std::make_shared<coroutine_resumer>(h, owned);
+    auto resume = [resumer](const rxsc::schedulable&){
+        resumer->resume();
+    };
+    // an owned frame belongs to a subscription, so the action ends with it.
+    // a worker from the coordinator of the subscription already does.
+    auto scbl = owned && lifetime != controller.get_subscription()
+        ? rxsc::make_schedulable(controller, std::move(lifetime), std::move(resume))
+        : rxsc::make_schedulable(controller, std::move(resume));
+    if (timed) {
+        controller.schedule(when, scbl);
+    } else {
+        controller.schedule(scbl);
+    }
+}
+
+struct worker_hop
+{
+    rxsc::worker controller;
+    bool timed;
+    rxsc::scheduler::clock_type::time_point when;
+    // set by async_generator so that the hop ends with the subscription
+    // and an unsubscribed frame is destroyed
+    composite_subscription lifetime;
+    bool owned;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> h) const {
+        resume_from(controller, lifetime, timed, when, h, owned);
+    }
+    void await_resume() const noexcept {
+    }
+};
+
+}
+
+/// co_await resume_on(w) continues the coroutine in an action scheduled on
+/// w. no thread is held while the coroutine waits in the queue of w.
+///
+/// outside of an async_generator the caller owns the coroutine frame. when
+/// w is unsubscribed before the action runs, the coroutine is never resumed
+/// and the frame stays suspended until its owner destroys it. inside an
+/// async_generator the frame is destroyed instead.
+inline detail::worker_hop resume_on(rxsc::worker w) {
+    return detail::worker_hop{std::move(w), false, rxsc::scheduler::clock_type::time_point(), composite_subscription(), false};
+}
+
+/// co_await resume_at(w, when) continues the coroutine on w at when. the
+/// frame is owned as for resume_on().
+inline detail::worker_hop resume_at(rxsc::worker w, rxsc::scheduler::clock_type::time_point when) {
+    return detail::worker_hop{std::move(w), true, when, composite_subscription(), false};
+}
+
+/// co_await resume_after(w, delay) continues the coroutine on w after delay.
+/// the frame is owned as for resume_on().
+inline detail::worker_hop resume_after(rxsc::worker w, rxsc::scheduler::clock_type::duration delay) {
+    auto when = w.now() + delay;
+    return resume_at(std::move(w), when);
+}
+
+namespace detail {
+
+template<class T>
+struct reader_state
+{
+    reader_state()
+        : done(false)
+        , cancelled(false)
+        , owned(false)
+    {
+    }
+
+    std::mutex lock;
+    std::deque<T> values;
+    std::exception_ptr error;
+    bool done;
+    std::coroutine_handle<> waiting;
+    std::optional<rxsc::worker> controller;
+    composite_subscription lifetime;
+    // set once an async_generator awaits next(). the waiting frame then ends
+    // with the subscription of the generator.
+    bool cancelled;
+    bool owned;
+    composite_subscription waiter;
+
+    bool ready() const {
+        return !values.empty() || done;
+    }
+
+    // lock must not be held
+    void watch(const std::shared_ptr<reader_state>& self, composite_subscription cs) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (owned) {
+                return;
+            }
+            owned = true;
+            waiter = cs;
+        }
+        cs.add([self](){
+            self->cancel();
+        });
+    }
+
+    // lock must not be held
+    void cancel() {
+        std::unique_lock<std::mutex> guard(lock);
+        cancelled = true;
+        auto h = std::exchange(waiting, nullptr);
+        guard.unlock();
+        if (h) {
+            h.destroy();
+        }
+    }
+
+    // lock must not be held
+    void resume(std::coroutine_handle<> h) {
+        if (!h) {
+            return;
+        }
+        if (controller) {
+            // owned and waiter were set before h was stored in waiting
+            resume_from(*controller, waiter, false, rxsc::scheduler::clock_type::time_point(), h, owned);
+        } else {
+            h.resume();
+        }
+    }
+};
+
+template<class T>
+struct reader_next
+{
+    std::shared_ptr<reader_state<T>> state;
+    // set by async_generator so that the wait ends with the subscription
+    // and an unsubscribed frame is destroyed
+    composite_subscription lifetime;
+    bool owned;
+
+    bool await_ready() const {
+        std::unique_lock<std::mutex> guard(state->lock);
+        return state->ready();
+    }
+    bool await_suspend(std::coroutine_handle<> h) const {
+        // the frame that holds this awaiter may be destroyed below
+        auto s = state;
+        if (owned) {
+            s->watch(s, lifetime);
+        }
+        std::unique_lock<std::mutex> guard(s->lock);
+        if (s->ready()) {
+            return false;
+        }
+        if (s->cancelled) {
+            guard.unlock();
+            h.destroy();
+            return true;
+        }
+        s->waiting = h;
+        return true;
+    }
+    /// the next value, or nullopt once the observable has completed.
+    /// rethrows the error that the observable ended with.
+    std::optional<T> await_resume() const {
+        std::unique_lock<std::mutex> guard(state->lock);
+        if (!state->values.empty()) {
+            std::optional<T> result(std::move(state->values.front()));
+            state->values.pop_front();
+            return result;
+        }
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        return std::nullopt;
+    }
+};
+
+}
+
+/// the return type of a coroutine that produces the values of an
+/// observable. co_yield calls on_next, co_return calls on_completed and an
+/// exception that leaves the coroutine calls on_error.
+///
+/// rxcpp::sources::from_coroutine() starts a new coroutine for each
+/// subscription. the coroutine is destroyed when it ends, at the first
+/// co_yield after the subscription ends, when a resume_on() hop is dropped
+/// because the subscription ended while it was queued, or when the
+/// subscription ends while it waits on async_reader::next().
+template<class T>
+class async_generator
+{
+public:
+    typedef T value_type;
+
+    struct promise_type
+    {
+        // set by start() before the first resume
+        std::optional<subscriber<T>> dest;
+
+        struct yield_type
+        {
+            bool stop;
+
+            bool await_ready() const noexcept {
+                return !stop;
+            }
+            void await_suspend(std::coroutine_handle<> h) const noexcept {
+                h.destroy();
+            }
+            void await_resume() const noexcept {
+            }
+        };
+
+        async_generator get_return_object() {
+            return async_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() const noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+        void return_void() {
+            dest->on_completed();
+        }
+        void unhandled_exception() {
+            dest->on_error(std::current_exception());
+        }
+        yield_type yield_value(T v) {
+            dest->on_next(std::move(v));
+            return yield_type{!dest->is_subscribed()};
+        }
+        detail::worker_hop await_transform(detail::worker_hop hop) {
+            hop.lifetime = dest->get_subscription();
+            hop.owned = true;
+            return hop;
+        }
+        template<class U>
+        detail::reader_next<U> await_transform(detail::reader_next<U> next) {
+            next.lifetime = dest->get_subscription();
+            next.owned = true;
+            return next;
+        }
+        template<class Awaitable>
+        Awaitable&& await_transform(Awaitable&& a) {
+            return std::forward<Awaitable>(a);
+        }
+    };
+
+private:
+    typedef async_generator<T> this_type;
+    async_generator(const this_type&);
+
+    std::coroutine_handle<promise_type> handle;
+
+    explicit async_generator(std::coroutine_handle<promise_type> h)
+        : handle(h)
+    {
+    }
+
+public:
+    async_generator(this_type&& o)
+        : handle(o.handle)
+    {
+        o.handle = nullptr;
+    }
+    ~async_generator()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    /// runs the coroutine in an action on controller until its first
+    /// suspension. the coroutine then owns itself.
+    void start(subscriber<T> o, rxsc::worker controller) {
+        auto h = handle;
+        handle = nullptr;
+        auto lifetime = o.get_subscription();
+        h.promise().dest.emplace(std::move(o));
+        detail::resume_from(std::move(controller), std::move(lifetime), false, rxsc::scheduler::clock_type::time_point(), h, true);
+    }
+};
+
+/// lets a coroutine co_await the values of an observable one at a time.
+///
+/// the observable is subscribed when the reader is created and the values
+/// are buffered until next() takes them, so a fast source is not slowed
+/// down. the awaiting coroutine is resumed on controller when one is given
+/// and otherwise on the thread that called on_next. destroying the reader
+/// unsubscribes.
+///
+/// outside of an async_generator the caller owns the awaiting coroutine
+/// frame. when controller is unsubscribed before the resume runs, or the
+/// observable never signals again, the frame stays suspended until its owner
+/// destroys it. an async_generator that waits in next() is destroyed when
+/// its subscription ends.
+template<class T>
+class async_reader
+{
+    typedef async_reader<T> this_type;
+    async_reader(const this_type&);
+
+    typedef detail::reader_state<T> state_type;
+
+    std::shared_ptr<state_type> state;
+
+public:
+    typedef detail::reader_next<T> next_type;
+
+    template<class SourceOperator>
+    async_reader(observable<T, SourceOperator> source, std::optional<rxsc::worker> controller)
+        : state(std::make_shared<state_type>())
+    {
+        state->controller = std::move(controller);
+        auto s = state;
+        source.subscribe(
+            state->lifetime,
+            [s](T v){
+                std::unique_lock<std::mutex> guard(s->lock);
+                s->values.push_back(std::move(v));
+                auto h = std::exchange(s->waiting, nullptr);
+                guard.unlock();
+                s->resume(h);
+            },
+            [s](std::exception_ptr e){
+                std::unique_lock<std::mutex> guard(s->lock);
+                s->error = e;
+                s->done = true;
+                auto h = std::exchange(s->waiting, nullptr);
+                guard.unlock();
+                s->resume(h);
+            },
+            [s](){
+                std::unique_lock<std::mutex> guard(s->lock);
+                s->done = true;
+                auto h = std::exchange(s->waiting, nullptr);
+                guard.unlock();
+                s->resume(h);
+            });
+    }
+    async_reader(this_type&& o)
+        : state(std::move(o.state))
+    {
+    }
+    ~async_reader()
+    {
+        if (state) {
+            state->lifetime.unsubscribe();
+        }
+    }
+
+    /// co_await next() for the next value. only one coroutine may wait at
+    /// a time.
+    next_type next() const {
+        return next_type{state, composite_subscription(), false};
+    }
+};
+
+template<class T, class SourceOperator>
+async_reader<T> make_async_reader(observable<T, SourceOperator> source) {
+    return async_reader<T>(std::move(source), std::nullopt);
+}
+
+template<class T, class SourceOperator>
+async_reader<T> make_async_reader(observable<T, SourceOperator> source, rxsc::worker controller) {
+    return async_reader<T>(std::move(source), std::move(controller));
+}
+
+}
+
+#endif
+
+#endif
@@ -19,6 +19,10 @@
 #define RXCPP_USE_VARIADIC_TEMPLATES 1
 #endif
 
+#if _MSC_VER >= 1900
+#define RXCPP_USE_THREAD_LOCAL 1
+#endif
+
 #if _CPPRTTI
 #define RXCPP_USE_RTTI 1
 #endif
@@ -34,6 +38,9 @@
 #if __has_feature(cxx_variadic_templates)
 #define RXCPP_USE_VARIADIC_TEMPLATES 1
 #endif
+#if __has_feature(cxx_thread_local)
+#define RXCPP_USE_THREAD_LOCAL 1
+#endif
 
 #elif defined(__GNUG__)
 
@@ -49,6 +56,10 @@
 #define RXCPP_USE_VARIADIC_TEMPLATES 1
 #endif
 
+#if GCC_VERSION >= 40800
+#define RXCPP_USE_THREAD_LOCAL 1
+#endif
+
 #if defined(__GXX_RTTI)
 #define RXCPP_USE_RTTI 1
 #endif
@@ -61,6 +72,30 @@
 #define RXCPP_USE_WINRT 1
 #endif
 
+// pooled allocation of subscription, action and notification state is opt-in
+#define RXCPP_USE_OBJECT_POOL 0
+
+// the timing wheel queue for timed schedulables is opt-in
+#define RXCPP_USE_TIMING_WHEEL 0
+
+// the per worker counters of new_thread and event_loop are opt-in
+#define RXCPP_USE_SCHEDULER_METRICS 0
+
+// watching the scheduler threads for stall_watchdog is opt-in
+#define RXCPP_USE_STALL_WATCHDOG 0
+
+#if defined(__linux__)
+#define RXCPP_USE_EPOLL 1
+#else
+#define RXCPP_USE_EPOLL 0
+#endif
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define RXCPP_USE_COROUTINES 1
+#else
+#define RXCPP_USE_COROUTINES 0
+#endif
+
 #if defined(RXCPP_FORCE_USE_VARIADIC_TEMPLATES)
 #undef RXCPP_USE_VARIADIC_TEMPLATES
 #define RXCPP_USE_VARIADIC_TEMPLATES RXCPP_FORCE_USE_VARIADIC_TEMPLATES
@@ -81,6 +116,48 @@
 #define RXCPP_USE_WINRT RXCPP_FORCE_USE_WINRT
 #endif
 
+#if defined(RXCPP_FORCE_USE_THREAD_LOCAL)
+#undef RXCPP_USE_THREAD_LOCAL
+#define RXCPP_USE_THREAD_LOCAL RXCPP_FORCE_USE_THREAD_LOCAL
+#endif
+
+#if defined(RXCPP_FORCE_USE_OBJECT_POOL)
+#undef RXCPP_USE_OBJECT_POOL
+#define RXCPP_USE_OBJECT_POOL RXCPP_FORCE_USE_OBJECT_POOL
+#endif
+
+#if RXCPP_USE_OBJECT_POOL && !RXCPP_USE_THREAD_LOCAL
+// the pool returns the blocks of an exiting thread from a thread_local
+// destructor, so it falls back to std::make_shared without one
+#undef RXCPP_USE_OBJECT_POOL
+#define RXCPP_USE_OBJECT_POOL 0
+#endif
+
+#if defined(RXCPP_FORCE_USE_EPOLL)
+#undef RXCPP_USE_EPOLL
+#define RXCPP_USE_EPOLL RXCPP_FORCE_USE_EPOLL
+#endif
+
+#if defined(RXCPP_FORCE_USE_TIMING_WHEEL)
+#undef RXCPP_USE_TIMING_WHEEL
+#define RXCPP_USE_TIMING_WHEEL RXCPP_FORCE_USE_TIMING_WHEEL
+#endif
+
+#if defined(RXCPP_FORCE_USE_SCHEDULER_METRICS)
+#undef RXCPP_USE_SCHEDULER_METRICS
+#define RXCPP_USE_SCHEDULER_METRICS RXCPP_FORCE_USE_SCHEDULER_METRICS
+#endif
+
+#if defined(RXCPP_FORCE_USE_STALL_WATCHDOG)
+#undef RXCPP_USE_STALL_WATCHDOG
+#define RXCPP_USE_STALL_WATCHDOG RXCPP_FORCE_USE_STALL_WATCHDOG
+#endif
+
+#if defined(RXCPP_FORCE_USE_COROUTINES)
+#undef RXCPP_USE_COROUTINES
+#define RXCPP_USE_COROUTINES RXCPP_FORCE_USE_COROUTINES
+#endif
+
 #if defined(_MSC_VER) && !RXCPP_USE_VARIADIC_TEMPLATES
 // resolve args needs enough to store all the possible resolved args
 #define _VARIADIC_MAX 10
@@ -94,6 +171,7 @@
 #include <stdlib.h>
 
 #include <cstddef>
+#include <cstdint>
 
 #include <iostream>
 #include <iomanip>
@@ -117,16 +195,20 @@
 #include <chrono>
 #include <condition_variable>
 #include <initializer_list>
+#include <limits>
 #include <typeinfo>
 
 #include "rx-util.hpp"
+#include "rx-pool.hpp"
 #include "rx-predef.hpp"
+#include "rx-watchdog.hpp"
 #include "rx-subscription.hpp"
 #include "rx-observer.hpp"
 #include "rx-scheduler.hpp"
 #include "rx-subscriber.hpp"
 #include "rx-notification.hpp"
 #include "rx-coordination.hpp"
+#include "rx-coroutine.hpp"
 #include "rx-sources.hpp"
 #include "rx-subjects.hpp"
 #include "rx-operators.hpp"
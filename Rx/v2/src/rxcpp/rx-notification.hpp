@@ -184,27 +184,27 @@ private:
         catch (...) {
             ep = std::current_exception();
         }
-        return std::make_shared<on_error_notification>(ep);
+        return rxcpp::detail::make_pooled<on_error_notification>(ep);
     }
 
     struct exception_ptr_tag {};
 
     static
     type make_on_error(exception_ptr_tag&&, std::exception_ptr ep) {
-        return std::make_shared<on_error_notification>(ep);
+        return rxcpp::detail::make_pooled<on_error_notification>(ep);
     }
 
     struct on_next_factory
     {
         type operator()(T value) const {
-            return std::make_shared<on_next_notification>(std::move(value));
+            return rxcpp::detail::make_pooled<on_next_notification>(std::move(value));
         }
     };
 
     struct on_completed_factory
     {
         type operator()() const {
-            return std::make_shared<on_completed_notification>();
+            return rxcpp::detail::make_pooled<on_completed_notification>();
         }
     };
 
@@ -448,6 +448,20 @@ public:
         return detail_subscribe(make_subscriber<T>(std::forward<ArgN>(an)...));
     }
 
+    ///
+    /// subscribe with a subscription_arena as the first argument allocates
+    /// the state of the subscription graph that is created while subscribing
+    /// from one arena. the arena is freed when that state has been released.
+    /// state that on_next, on_error or on_completed create, even when they
+    /// are called before subscribe returns, does not come from the arena.
+    ///
+    template<class... ArgN>
+    auto subscribe(subscription_arena arena, ArgN&&... an) const
+        -> composite_subscription {
+        rxcpp::detail::arena_scope scope(arena.capacity());
+        return detail_subscribe(make_subscriber<T>(std::forward<ArgN>(an)...));
+    }
+
     /// filter (AKA Where) ->
     /// for each item from this observable use Predicate to select which items to emit from the new observable that is returned.
     ///
@@ -1159,6 +1173,18 @@ public:
         -> decltype(rxs::interval(initial, period, std::move(cn))) {
         return      rxs::interval(initial, period, std::move(cn));
     }
+#if RXCPP_USE_EPOLL
+    template<class T = uint32_t>
+    static auto from_fd(int fd, uint32_t events)
+        -> decltype(rxs::from_fd<T>(fd, events)) {
+        return      rxs::from_fd<T>(fd, events);
+    }
+    template<class T = uint32_t>
+    static auto from_fd(int fd, uint32_t events, rxsc::reactor r)
+        -> decltype(rxs::from_fd<T>(fd, events, std::move(r))) {
+        return      rxs::from_fd<T>(fd, events, std::move(r));
+    }
+#endif
     template<class Collection>
     static auto iterate(Collection c)
         -> decltype(rxs::iterate(std::move(c), identity_current_thread())) {
@@ -173,7 +173,7 @@ private:
     template<class Observer>
     static auto make_destination(Observer o)
         -> std::shared_ptr<virtual_observer> {
-        return std::make_shared<specific_observer<Observer>>(std::move(o));
+        return rxcpp::detail::make_state<specific_observer<Observer>>(std::move(o));
     }
 
 public:
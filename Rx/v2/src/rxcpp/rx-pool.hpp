@@ -0,0 +1,469 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_POOL_HPP)
+#define RXCPP_RX_POOL_HPP
+
+#include "rx-includes.hpp"
+
+namespace rxcpp {
+
+namespace detail {
+
+#if RXCPP_USE_THREAD_LOCAL
+
+/// block_pool hands out fixed size blocks from a per-thread free list.
+///
+/// a block freed on the thread that allocated it goes back onto the free
+/// list of that thread. a block freed on any other thread is pushed onto
+/// the remote list of the thread that allocated it, which is lock-free.
+/// the owner takes the whole remote list back when its own list is empty.
+/// this covers notifications that are created by a producer and freed by
+/// the consumer after observe_on has drained them.
+///
+/// when a thread exits, its free list is released and its cache is parked
+/// so that blocks that are still alive on other threads have somewhere to
+/// go. the next new thread adopts the parked cache.
+template<size_t Size>
+class block_pool
+{
+    struct thread_cache;
+
+    union block_header
+    {
+        struct
+        {
+            thread_cache* owner;
+            block_header* next;
+        } link;
+        // keep the payload aligned for any type
+        long double align_ld;
+        long long align_ll;
+        void* align_p;
+    };
+
+    struct thread_cache
+    {
+        thread_cache()
+            : local(nullptr)
+            , local_count(0)
+            , remote(nullptr)
+            , next_parked(nullptr)
+        {
+        }
+        block_header* local;
+        size_t local_count;
+        std::atomic<block_header*> remote;
+        thread_cache* next_parked;
+    };
+
+    enum {
+        max_cached = 1024
+    };
+
+    struct parked_caches
+    {
+        parked_caches()
+            : head(nullptr)
+        {
+        }
+        std::mutex lock;
+        thread_cache* head;
+    };
+
+    static parked_caches& parked() {
+        static parked_caches p;
+        return p;
+    }
+
+    enum holder_status {
+        holder_none = 0,
+        holder_alive,
+        holder_destroyed
+    };
+
+    static int& status() {
+        static RXCPP_THREAD_LOCAL int s;
+        return s;
+    }
+
+    struct cache_holder
+    {
+        cache_holder()
+            : cache(nullptr)
+        {
+            {
+                auto& p = parked();
+                std::unique_lock<std::mutex> guard(p.lock);
+                if (p.head) {
+                    cache = p.head;
+                    p.head = cache->next_parked;
+                    cache->next_parked = nullptr;
+                }
+            }
+            if (!cache) {
+                cache = new thread_cache();
+            }
+            status() = holder_alive;
+        }
+        ~cache_holder()
+        {
+            status() = holder_destroyed;
+            while (cache->local) {
+                auto b = cache->local;
+                cache->local = b->link.next;
+                free(b);
+            }
+            cache->local_count = 0;
+            auto& p = parked();
+            std::unique_lock<std::mutex> guard(p.lock);
+            cache->next_parked = p.head;
+            p.head = cache;
+        }
+        thread_cache* cache;
+    };
+
+    static thread_cache* current() {
+        if (status() == holder_destroyed) {
+            // thread (or process) is exiting
+            return nullptr;
+        }
+        // not RXCPP_THREAD_LOCAL: __thread and __declspec(thread) do not run
+        // destructors, and ~cache_holder is what hands the blocks of an
+        // exiting thread back. the pool is off without C++11 thread_local.
+        static thread_local cache_holder holder;
+        return holder.cache;
+    }
+
+    static block_header* header(void* p) {
+        return static_cast<block_header*>(p) - 1;
+    }
+    static void* payload(block_header* b) {
+        return b + 1;
+    }
+
+public:
+    static void* allocate() {
+        auto c = current();
+        block_header* b = nullptr;
+        if (c) {
+            if (!c->local) {
+                // take back the blocks freed by other threads
+                c->local = c->remote.exchange(nullptr, std::memory_order_acquire);
+                for (auto it = c->local; it; it = it->link.next) {
+                    ++c->local_count;
+                }
+            }
+            if (c->local) {
+                b = c->local;
+                c->local = b->link.next;
+                --c->local_count;
+            }
+        }
+        if (!b) {
+            b = static_cast<block_header*>(malloc(sizeof(block_header) + Size));
+            if (!b) {
+                throw std::bad_alloc();
+            }
+        }
+        b->link.owner = c;
+        return payload(b);
+    }
+
+    static void deallocate(void* p) {
+        auto b = header(p);
+        auto owner = b->link.owner;
+        if (!owner) {
+            free(b);
+            return;
+        }
+        if (owner == current()) {
+            if (owner->local_count >= max_cached) {
+                free(b);
+                return;
+            }
+            b->link.next = owner->local;
+            owner->local = b;
+            ++owner->local_count;
+            return;
+        }
+        auto head = owner->remote.load(std::memory_order_relaxed);
+        do {
+            b->link.next = head;
+        } while (!owner->remote.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+    }
+};
+
+/// pool_allocator allocates single objects from the block_pool for the
+/// size class of T. it is used with std::allocate_shared so that the
+/// object and the shared_ptr control block come from the same block.
+template<class T>
+struct pool_allocator
+{
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<class U>
+    struct rebind
+    {
+        typedef pool_allocator<U> other;
+    };
+
+    typedef block_pool<(sizeof(T) + 15) & ~size_t(15)> pool_type;
+
+    pool_allocator() {}
+    template<class U>
+    pool_allocator(const pool_allocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(pool_type::allocate());
+    }
+    void deallocate(T* p, size_t n) {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+        pool_type::deallocate(p);
+    }
+};
+
+template<class T, class U>
+inline bool operator==(const pool_allocator<T>&, const pool_allocator<U>&) {
+    return true;
+}
+template<class T, class U>
+inline bool operator!=(const pool_allocator<T>&, const pool_allocator<U>&) {
+    return false;
+}
+
+#endif
+
+/// make_pooled is used in place of std::make_shared for the small state
+/// objects that are created for every subscribe, schedule and notification.
+/// it uses the pool when RXCPP_USE_OBJECT_POOL is set.
+template<class T, class... AN>
+inline std::shared_ptr<T> make_pooled(AN&&... an) {
+#if RXCPP_USE_OBJECT_POOL
+    return std::allocate_shared<T>(pool_allocator<T>(), std::forward<AN>(an)...);
+#else
+    return std::make_shared<T>(std::forward<AN>(an)...);
+#endif
+}
+
+/// arena is a bump allocator for the state created by one subscribe call.
+///
+/// the arena is one malloc'd buffer. allocation only happens on the thread
+/// that is running the subscribe, so the bump pointer needs no lock. each
+/// allocation holds a reference on the arena and the buffer is freed in one
+/// shot when the last state allocated from it is released, which is when
+/// the subscription graph is torn down. once the buffer is full the arena
+/// falls back to operator new.
+class arena
+{
+    std::atomic<size_t> refs;
+    char* next;
+    char* end;
+
+    explicit arena(size_t capacity)
+        : refs(1)
+        , next(begin())
+        , end(begin() + capacity)
+    {
+        live_count().fetch_add(1, std::memory_order_relaxed);
+    }
+    ~arena()
+    {
+        live_count().fetch_sub(1, std::memory_order_relaxed);
+    }
+    arena(const arena&);
+    arena& operator=(const arena&);
+
+    char* begin() {
+        return reinterpret_cast<char*>(this + 1);
+    }
+
+    enum {
+        alignment = 16
+    };
+
+    static std::atomic<size_t>& live_count() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+
+public:
+    static arena* create(size_t capacity) {
+        void* p = malloc(sizeof(arena) + capacity);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return new (p) arena(capacity);
+    }
+
+    /// the number of arenas whose buffer has not been freed yet.
+    static size_t live() {
+        return live_count().load(std::memory_order_relaxed);
+    }
+
+    /// the arena of the subscribe call running on this thread, if any.
+    static arena*& current() {
+        static RXCPP_THREAD_LOCAL arena* a;
+        return a;
+    }
+
+    void* allocate(size_t size) {
+        refs.fetch_add(1, std::memory_order_relaxed);
+        auto aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(next) + (alignment - 1)) & ~uintptr_t(alignment - 1));
+        if (aligned <= end && size <= size_t(end - aligned)) {
+            next = aligned + size;
+            return aligned;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p) {
+        if (p < static_cast<void*>(begin()) || p >= static_cast<void*>(end)) {
+            ::operator delete(p);
+        }
+        release();
+    }
+
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~arena();
+            free(this);
+        }
+    }
+};
+
+/// arena_scope makes a new arena current on this thread for its lifetime.
+class arena_scope
+{
+    arena* previous;
+    arena* a;
+
+    arena_scope(const arena_scope&);
+    arena_scope& operator=(const arena_scope&);
+public:
+    explicit arena_scope(size_t capacity)
+        : previous(arena::current())
+        , a(arena::create(capacity))
+    {
+        arena::current() = a;
+    }
+    ~arena_scope()
+    {
+        arena::current() = previous;
+        a->release();
+    }
+};
+
+/// arena_pause takes the arena of this thread away for its lifetime. the
+/// on_next, on_error and on_completed calls of a subscriber that was
+/// created under an arena run under one, so that only the state of the
+/// subscribe call comes from the arena and not the state that a callback
+/// creates while values are delivered, such as a nested subscribe that may
+/// outlive the subscription. when active is false nothing is touched.
+class arena_pause
+{
+    arena* a;
+
+    arena_pause(const arena_pause&);
+    arena_pause& operator=(const arena_pause&);
+public:
+    explicit arena_pause(bool active)
+        : a(active ? arena::current() : nullptr)
+    {
+        if (a) {
+            arena::current() = nullptr;
+        }
+    }
+    ~arena_pause()
+    {
+        if (a) {
+            arena::current() = a;
+        }
+    }
+};
+
+template<class T>
+struct arena_allocator
+{
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<class U>
+    struct rebind
+    {
+        typedef arena_allocator<U> other;
+    };
+
+    explicit arena_allocator(arena* a) : a(a) {}
+    template<class U>
+    arena_allocator(const arena_allocator<U>& o) : a(o.a) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(a->allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t) {
+        a->deallocate(p);
+    }
+
+    arena* a;
+};
+
+template<class T, class U>
+inline bool operator==(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) {
+    return lhs.a == rhs.a;
+}
+template<class T, class U>
+inline bool operator!=(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs) {
+    return lhs.a != rhs.a;
+}
+
+/// make_state is used for the state that lives as long as a subscription:
+/// subscription and composite states, observers and operator states.
+/// inside subscribe(subscription_arena(), ...) it allocates from the arena.
+template<class T, class... AN>
+inline std::shared_ptr<T> make_state(AN&&... an) {
+    if (auto a = arena::current()) {
+        return std::allocate_shared<T>(arena_allocator<T>(a), std::forward<AN>(an)...);
+    }
+    return make_pooled<T>(std::forward<AN>(an)...);
+}
+
+}
+
+/// subscription_arena is passed as the first argument to
+/// observable::subscribe. the state allocated for the subscription graph
+/// while subscribing comes from one arena of the given capacity.
+class subscription_arena
+{
+    size_t cap;
+public:
+    explicit subscription_arena(size_t capacity = 16 * 1024)
+        : cap(capacity)
+    {
+    }
+    size_t capacity() const {
+        return cap;
+    }
+};
+
+}
+
+#endif
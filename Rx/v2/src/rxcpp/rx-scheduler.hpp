@@ -7,6 +7,14 @@
 
 #include "rx-includes.hpp"
 
+// the largest callable that an action stores in place. each action is sized
+// for its own callable, so this only bounds the size classes of the actions.
+// it is enough for the range and iterate producers at the head of a chain of
+// a few operators. larger callables are moved to the heap.
+#if !defined(RXCPP_ACTION_INLINE_SIZE)
+#define RXCPP_ACTION_INLINE_SIZE (64 * sizeof(void*))
+#endif
+
 namespace rxcpp {
 
 namespace schedulers {
@@ -49,6 +57,40 @@ public:
     }
 };
 
+/// recursion_budget limits how long one run of an action may tail-recurse
+/// in place. when it runs out, the action is scheduled again, so that a
+/// producer such as range() takes turns with the other work of its thread.
+struct recursion_budget
+{
+    typedef std::chrono::steady_clock clock_type;
+
+    recursion_budget()
+        : items(0)
+        , time(clock_type::duration::zero())
+    {
+    }
+    recursion_budget(size_t i, clock_type::duration t)
+        : items(i)
+        , time(t)
+    {
+    }
+    /// the calls of the function in one run. 0 is no limit.
+    size_t items;
+    /// the time of one run. zero is no limit.
+    clock_type::duration time;
+
+    /// true once runs calls, started at start, have used up the budget
+    inline bool is_spent(size_t runs, clock_type::time_point start) const {
+        return (items != 0 && runs >= items) ||
+            (time != clock_type::duration::zero() && clock_type::now() - start >= time);
+    }
+    /// no limit
+    static const recursion_budget& unlimited() {
+        static const recursion_budget b;
+        return b;
+    }
+};
+
 /// recurse is passed to the action by the scheduler.
 /// the action uses recurse to coordinate the scheduler and the function.
 class recurse
@@ -56,11 +98,32 @@ class recurse
     bool& isallowed;
     mutable bool isrequested;
     recursed requestor;
+    const recursion_budget* limit;
+#if RXCPP_USE_SCHEDULER_METRICS
+    mutable uint64_t recursions;
+    mutable uint64_t reschedules;
+#endif
 public:
     explicit recurse(bool& a)
         : isallowed(a)
         , isrequested(true)
         , requestor(isrequested)
+        , limit(&recursion_budget::unlimited())
+#if RXCPP_USE_SCHEDULER_METRICS
+        , recursions(0)
+        , reschedules(0)
+#endif
+    {
+    }
+    recurse(bool& a, const recursion_budget& b)
+        : isallowed(a)
+        , isrequested(true)
+        , requestor(isrequested)
+        , limit(&b)
+#if RXCPP_USE_SCHEDULER_METRICS
+        , recursions(0)
+        , reschedules(0)
+#endif
     {
     }
     /// does the scheduler allow tail-recursion now?
@@ -79,28 +142,60 @@ public:
     inline const recursed& get_recursed() const {
         return requestor;
     }
+    /// the budget for each run of an action
+    inline const recursion_budget& get_budget() const {
+        return *limit;
+    }
+    /// the function asked to be recursed and was called again in place.
+    /// only counted when RXCPP_USE_SCHEDULER_METRICS is set.
+    inline void count_tail_recursion() const {
+#if RXCPP_USE_SCHEDULER_METRICS
+        ++recursions;
+#endif
+    }
+    /// the function asked to be recursed and was scheduled again.
+    /// only counted when RXCPP_USE_SCHEDULER_METRICS is set.
+    inline void count_reschedule() const {
+#if RXCPP_USE_SCHEDULER_METRICS
+        ++reschedules;
+#endif
+    }
+#if RXCPP_USE_SCHEDULER_METRICS
+    inline uint64_t tail_recursions() const {
+        return recursions;
+    }
+    inline uint64_t rescheduled() const {
+        return reschedules;
+    }
+#endif
 };
 
 /// recursion is used by the scheduler to signal to each action whether tail recursion is allowed.
 class recursion
 {
     mutable bool isallowed;
+    recursion_budget budget;
     recurse recursor;
 public:
     recursion()
         : isallowed(true)
-        , recursor(isallowed)
+        , recursor(isallowed, budget)
     {
     }
     explicit recursion(bool b)
         : isallowed(b)
-        , recursor(isallowed)
+        , recursor(isallowed, budget)
     {
     }
     /// set whether tail-recursion is allowed
     inline void reset(bool b = true) const {
         isallowed = b;
     }
+    /// set the budget for each run of an action. only call this while no
+    /// action is running.
+    inline void set_budget(const recursion_budget& b) {
+        budget = b;
+    }
     /// get the recurse to pass into each action being called
     inline const recurse& get_recurse() const {
         return recursor;
@@ -150,6 +245,67 @@ struct worker_base : public subscription_base
     typedef tag_worker worker_tag;
 };
 
+/// a snapshot of the counters of a worker. the counters are only kept when
+/// RXCPP_USE_SCHEDULER_METRICS is set.
+struct worker_metrics
+{
+    typedef scheduler_base::clock_type clock_type;
+
+    /// bucket i of wait counts the actions that waited less than 2^i
+    /// microseconds. the last bucket counts the rest.
+    static const int wait_buckets = 24;
+
+    worker_metrics()
+        : queued(0)
+        , timed_live(0)
+        , timed_dead(0)
+        , executed(0)
+        , busy(0)
+        , tail_recursions(0)
+        , reschedules(0)
+    {
+        wait.fill(0);
+    }
+
+    /// the actions in the queue
+    size_t queued;
+    /// the actions in the timed queue that will run when they are due.
+    /// counted when the snapshot is taken.
+    size_t timed_live;
+    /// the actions in the timed queue that were unsubscribed while they
+    /// waited and have not been dropped yet
+    size_t timed_dead;
+    /// the actions that have run
+    uint64_t executed;
+    /// the time spent running actions
+    clock_type::duration busy;
+    /// the times that an action asked to run again and was run in place
+    uint64_t tail_recursions;
+    /// the times that an action asked to run again and was queued again
+    uint64_t reschedules;
+    /// the time from when each action was due to when it was taken from
+    /// the queue to run
+    std::array<uint64_t, wait_buckets> wait;
+
+    /// the upper bound of the wait bucket that holds the q quantile of the
+    /// waits. max() when it is in the last bucket.
+    clock_type::duration wait_quantile(double q) const {
+        uint64_t total = 0;
+        for (auto count : wait) {
+            total += count;
+        }
+        auto target = q * total;
+        uint64_t seen = 0;
+        for (int i = 0; i != wait_buckets - 1; ++i) {
+            seen += wait[i];
+            if (seen >= target) {
+                return std::chrono::duration_cast<clock_type::duration>(std::chrono::microseconds(uint64_t(1) << i));
+            }
+        }
+        return (clock_type::duration::max)();
+    }
+};
+
 class worker_interface
     : public std::enable_shared_from_this<worker_interface>
 {
@@ -164,6 +320,18 @@ public:
 
     virtual void schedule(const schedulable& scbl) const = 0;
     virtual void schedule(clock_type::time_point when, const schedulable& scbl) const = 0;
+
+    /// schedule count items, starting at first, to run as soon as possible
+    /// in order. the default schedules them one at a time. schedulers that
+    /// take a lock or wake a thread per item override this to do it once
+    /// per batch.
+    virtual void schedule_batch(const schedulable* first, size_t count) const;
+
+    /// fill in the counters of this worker. false when it does not keep
+    /// them.
+    virtual bool get_metrics(worker_metrics&) const {
+        return false;
+    }
 };
 
 namespace detail {
@@ -241,6 +409,13 @@ public:
         return inner->now();
     }
 
+    /// fill in the counters of this worker. false when it does not keep
+    /// them, which is always the case unless RXCPP_USE_SCHEDULER_METRICS
+    /// is set.
+    inline bool get_metrics(worker_metrics& m) const {
+        return inner->get_metrics(m);
+    }
+
     /// insert the supplied schedulable to be run as soon as possible
     inline void schedule(const schedulable& scbl) const {
         // force rebinding scbl to this worker
@@ -276,6 +451,11 @@ public:
         schedule_periodically_rebind(now() + initial, period, scbl);
     }
 
+    /// insert each schedulable in the range to be run as soon as possible, in order.
+    /// the worker pays for its lock and wake up once for the whole range.
+    template<class Range>
+    void schedule_batch(const Range& scbls) const;
+
     /// use the supplied arguments to make a schedulable and then insert it to be run
     template<class Arg0, class... ArgN>
     auto schedule(Arg0&& a0, ArgN&&... an) const
@@ -330,6 +510,12 @@ public:
     virtual clock_type::time_point now() const = 0;
 
     virtual worker create_worker(composite_subscription cs) const = 0;
+
+    /// fill in the counters of each thread of this scheduler. false when
+    /// it does not keep them.
+    virtual bool get_metrics(std::vector<worker_metrics>&) const {
+        return false;
+    }
 };
 
 
@@ -373,6 +559,13 @@ public:
     inline worker create_worker(composite_subscription cs = composite_subscription()) const {
         return inner->create_worker(cs);
     }
+
+    /// fill in the counters of each thread of this scheduler. false when
+    /// it does not keep them, which is always the case unless
+    /// RXCPP_USE_SCHEDULER_METRICS is set.
+    inline bool get_metrics(std::vector<worker_metrics>& m) const {
+        return inner->get_metrics(m);
+    }
 };
 
 template<class Scheduler, class... ArgN>
@@ -380,6 +573,17 @@ inline scheduler make_scheduler(ArgN&&... an) {
     return scheduler(std::static_pointer_cast<scheduler_interface>(std::make_shared<Scheduler>(std::forward<ArgN>(an)...)));
 }
 
+/// the lanes of the schedulers that have them. a due action in the high
+/// lane runs before the actions in the normal lane.
+struct priority
+{
+    enum type {
+        /// data and other bulk work
+        normal,
+        /// control work such as unsubscribe, heartbeats and timeouts
+        high
+    };
+};
 
 class schedulable : public schedulable_base
 {
@@ -389,6 +593,8 @@ class schedulable : public schedulable_base
     worker controller;
     action activity;
     bool scoped;
+    priority::type lane;
+    scheduler_base::clock_type::time_point due_by;
     composite_subscription::weak_subscription action_scope;
 
     struct detacher
@@ -463,6 +669,8 @@ public:
     }
     schedulable()
         : scoped(false)
+        , lane(priority::normal)
+        , due_by((scheduler_base::clock_type::time_point::max)())
     {
     }
 
@@ -472,6 +680,8 @@ public:
         , controller(std::move(q))
         , activity(std::move(a))
         , scoped(false)
+        , lane(priority::normal)
+        , due_by((scheduler_base::clock_type::time_point::max)())
     {
     }
     /// action and worker have independent lifetimes
@@ -480,15 +690,19 @@ public:
         , controller(std::move(q))
         , activity(std::move(a))
         , scoped(true)
+        , lane(priority::normal)
+        , due_by((scheduler_base::clock_type::time_point::max)())
         , action_scope(controller.add(lifetime))
     {
     }
-    /// inherit lifetimes
+    /// inherit lifetimes, priority and deadline
     schedulable(schedulable scbl, worker q, action a)
         : lifetime(scbl.get_subscription())
         , controller(std::move(q))
         , activity(std::move(a))
         , scoped(scbl.scoped)
+        , lane(scbl.lane)
+        , due_by(scbl.due_by)
         , action_scope(scbl.scoped ? controller.add(lifetime) : weak_subscription())
     {
     }
@@ -505,6 +719,21 @@ public:
     inline worker& get_worker() {
         return controller;
     }
+    /// the lane that schedulers with priority lanes queue this in
+    inline priority::type get_priority() const {
+        return lane;
+    }
+    inline void set_priority(priority::type p) {
+        lane = p;
+    }
+    /// the time that deadline schedulers must finish this by. the default,
+    /// time_point::max(), means that the worker assigns the deadline.
+    inline clock_type::time_point get_deadline() const {
+        return due_by;
+    }
+    inline void set_deadline(clock_type::time_point d) {
+        due_by = d;
+    }
     inline const action& get_action() const {
         return activity;
     }
@@ -602,32 +831,113 @@ struct current_thread;
 
 namespace detail {
 
+/// action_function decides how an action holds its
+/// void(const schedulable&, const recurse&) callable. each action is
+/// allocated with room for its own callable, so a callable of up to
+/// RXCPP_ACTION_INLINE_SIZE bytes is stored in place and the action is the
+/// only allocation. larger callables are moved to the heap.
+class action_function
+{
+public:
+    static const size_t inline_size = RXCPP_ACTION_INLINE_SIZE;
+
+    template<class F>
+    struct fits
+        : std::integral_constant<bool,
+            sizeof(F) <= inline_size &&
+            std::alignment_of<F>::value <= std::alignment_of<std::max_align_t>::value>
+    {
+    };
+
+    template<class F>
+    struct in_place
+    {
+        template<class Fn>
+        explicit in_place(Fn&& fn)
+            : f(std::forward<Fn>(fn))
+        {
+        }
+        void operator()(const schedulable& s, const recurse& r) {
+            f(s, r);
+        }
+        F f;
+    };
+
+    template<class F>
+    struct on_heap
+    {
+        template<class Fn>
+        explicit on_heap(Fn&& fn)
+            : f(new F(std::forward<Fn>(fn)))
+        {
+        }
+        void operator()(const schedulable& s, const recurse& r) {
+            (*f)(s, r);
+        }
+        std::unique_ptr<F> f;
+    };
+
+    template<class F>
+    struct select
+    {
+        typedef typename std::conditional<fits<F>::value, in_place<F>, on_heap<F>>::type type;
+    };
+
+    /// true when the callable is stored in place
+    template<class F>
+    static bool is_inline() {
+        return fits<typename std::decay<F>::type>::value;
+    }
+};
+
 class action_type
     : public std::enable_shared_from_this<action_type>
 {
     typedef action_type this_type;
 
-public:
-    typedef std::function<void(const schedulable&, const recurse&)> function_type;
+protected:
+    typedef void (*invoke_type)(action_type&, const schedulable&, const recurse&);
+
+    explicit action_type(invoke_type i)
+        : invoke(i)
+    {
+    }
 
 private:
-    function_type f;
+    invoke_type invoke;
 
 public:
     action_type()
-    {
-    }
-
-    action_type(function_type f)
-        : f(std::move(f))
+        : invoke(nullptr)
     {
     }
 
     inline void operator()(const schedulable& s, const recurse& r) {
-        if (!f) {
+        if (!invoke) {
             abort();
         }
-        f(s, r);
+        invoke(*this, s, r);
+    }
+};
+
+/// the action for a callable of type F
+template<class F>
+class callable_action : public action_type
+{
+    typedef typename action_function::select<F>::type function_type;
+
+    function_type f;
+
+    static void call(action_type& a, const schedulable& s, const recurse& r) {
+        static_cast<callable_action&>(a).f(s, r);
+    }
+
+public:
+    template<class Fn>
+    explicit callable_action(Fn&& fn)
+        : action_type(&callable_action::call)
+        , f(std::forward<Fn>(fn))
+    {
     }
 };
 
@@ -649,25 +959,39 @@ template<class F>
 inline action make_action(F&& f) {
     static_assert(detail::is_action_function<F>::value, "action function must be void(schedulable)");
     auto fn = std::forward<F>(f);
-    return action(std::make_shared<detail::action_type>(
-        // tail-recurse inside of the virtual function call
-        // until a new action, lifetime or scheduler is returned
-        [fn](const schedulable& s, const recurse& r) {
-            trace_activity().action_enter(s);
-            auto scope = s.set_recursed(r);
-            while (s.is_subscribed()) {
-                r.reset();
+    // tail-recurse inside of the virtual function call
+    // until a new action, lifetime or scheduler is returned
+    auto run = [fn](const schedulable& s, const recurse& r) {
+        trace_activity().action_enter(s);
+        auto scope = s.set_recursed(r);
+        auto& budget = r.get_budget();
+        size_t runs = 0;
+        auto start = budget.time != recursion_budget::clock_type::duration::zero()
+            ? recursion_budget::clock_type::now()
+            : recursion_budget::clock_type::time_point();
+        while (s.is_subscribed()) {
+            r.reset();
+#if RXCPP_USE_STALL_WATCHDOG
+            {
+                rxcpp::detail::watched_action watched;
                 fn(s);
-                if (!r.is_allowed() || !r.is_requested()) {
-                    if (r.is_requested()) {
-                        s.schedule();
-                    }
-                    break;
+            }
+#else
+            fn(s);
+#endif
+            if (!r.is_allowed() || !r.is_requested() || budget.is_spent(++runs, start)) {
+                if (r.is_requested()) {
+                    r.count_reschedule();
+                    s.schedule();
                 }
-                trace_activity().action_recurse(s);
+                break;
             }
-            trace_activity().action_return(s);
-        }));
+            r.count_tail_recursion();
+            trace_activity().action_recurse(s);
+        }
+        trace_activity().action_return(s);
+    };
+    return action(rxcpp::detail::make_pooled<detail::callable_action<decltype(run)>>(std::move(run)));
 }
 
 // copy
@@ -718,11 +1042,17 @@ auto make_schedulable(schedulable scbl, F&& f)
 
 inline auto make_schedulable(schedulable scbl, composite_subscription cs)
     -> schedulable {
-    return schedulable(cs, scbl.get_worker(), scbl.get_action());
+    schedulable result(cs, scbl.get_worker(), scbl.get_action());
+    result.set_priority(scbl.get_priority());
+    result.set_deadline(scbl.get_deadline());
+    return result;
 }
 inline auto make_schedulable(schedulable scbl, worker sc, composite_subscription cs)
     -> schedulable {
-    return schedulable(cs, sc, scbl.get_action());
+    schedulable result(cs, sc, scbl.get_action());
+    result.set_priority(scbl.get_priority());
+    result.set_deadline(scbl.get_deadline());
+    return result;
 }
 inline auto make_schedulable(schedulable scbl, worker sc)
     -> schedulable {
@@ -748,6 +1078,31 @@ void worker::schedule_rebind(const schedulable& scbl, ArgN&&... an) const {
     trace_activity().schedule_return(*inner.get());
 }
 
+template<class Range>
+void worker::schedule_batch(const Range& scbls) const {
+    // force rebinding each scbl to this worker
+    std::vector<schedulable> rescbls;
+    for (const auto& scbl : scbls) {
+        rescbls.push_back(make_schedulable(scbl, *this));
+    }
+    if (rescbls.empty()) {
+        return;
+    }
+    for (const auto& rescbl : rescbls) {
+        trace_activity().schedule_enter(*inner.get(), rescbl);
+    }
+    inner->schedule_batch(rescbls.data(), rescbls.size());
+    for (size_t i = 0; i != rescbls.size(); ++i) {
+        trace_activity().schedule_return(*inner.get());
+    }
+}
+
+inline void worker_interface::schedule_batch(const schedulable* first, size_t count) const {
+    for (auto last = first + count; first != last; ++first) {
+        schedule(*first);
+    }
+}
+
 template<class Arg0, class... ArgN>
 auto worker::schedule(clock_type::time_point when, Arg0&& a0, ArgN&&... an) const
     -> typename std::enable_if<
@@ -813,9 +1168,24 @@ struct time_schedulable
 };
 
 
+/// the items in a timed queue, split by whether they are still subscribed
+struct queue_counts
+{
+    /// items that will run when they are due
+    size_t live;
+    /// items that were unsubscribed while they waited and have not been
+    /// dropped yet
+    size_t dead;
+};
+
 // Sorts time_schedulable items in priority order sorted
 // on value of time_schedulable.when. Items with equal
 // values for when are sorted in fifo order.
+//
+// Items that are unsubscribed while they wait are dropped by compact().
+// push calls it each time the queue has doubled since the last compaction,
+// so a queue of timeouts that are mostly cancelled stays near the size of
+// the live timeouts, at an amortized O(1) cost per push.
 template<class TimePoint>
 class schedulable_queue {
 public:
@@ -837,34 +1207,79 @@ private:
         }
     };
 
-    typedef std::priority_queue<
-        elem_type,
-        container_type,
-        compare_elem
-    > queue_type;
+    static bool is_dead(const elem_type& e) {
+        return !e.first.what.is_subscribed();
+    }
+
+    // the smallest queue that push compacts
+    static const size_t compact_min = 64;
 
-    queue_type queue;
+    container_type queue;
 
     int64_t ordinal;
+    size_t compact_at;
+
+    size_t pushed() {
+        std::push_heap(queue.begin(), queue.end(), compare_elem());
+        if (queue.size() >= compact_at) {
+            return compact();
+        }
+        return 0;
+    }
+
 public:
+    schedulable_queue()
+        : ordinal(0)
+        , compact_at(compact_min)
+    {
+    }
+
     const_reference top() const {
-        return queue.top().first;
+        return queue.front().first;
     }
 
     void pop() {
-        queue.pop();
+        std::pop_heap(queue.begin(), queue.end(), compare_elem());
+        queue.pop_back();
     }
 
     bool empty() const {
         return queue.empty();
     }
 
-    void push(const item_type& value) {
-        queue.push(elem_type(value, ordinal++));
+    /// the number of items in the queue, including unsubscribed items
+    /// that have not been dropped yet
+    size_t size() const {
+        return queue.size();
+    }
+
+    /// returns the number of unsubscribed items that the push dropped.
+    size_t push(const item_type& value) {
+        queue.push_back(elem_type(value, ordinal++));
+        return pushed();
+    }
+
+    size_t push(item_type&& value) {
+        queue.push_back(elem_type(std::move(value), ordinal++));
+        return pushed();
+    }
+
+    /// drop the unsubscribed items. returns the number dropped.
+    size_t compact() {
+        auto before = queue.size();
+        queue.erase(std::remove_if(queue.begin(), queue.end(), is_dead), queue.end());
+        std::make_heap(queue.begin(), queue.end(), compare_elem());
+        compact_at = (std::max)(queue.size() * 2, size_t(compact_min));
+        return before - queue.size();
     }
 
-    void push(item_type&& value) {
-        queue.push(elem_type(std::move(value), ordinal++));
+    /// counts the live and dead items. O(n).
+    queue_counts count() const {
+        queue_counts result = {0, 0};
+        for (auto& e : queue) {
+            ++(is_dead(e) ? result.dead : result.live);
+        }
+        return result;
     }
 };
 
@@ -875,9 +1290,15 @@ namespace rxsc=schedulers;
 
 }
 
+#include "schedulers/rx-timingwheel.hpp"
 #include "schedulers/rx-currentthread.hpp"
 #include "schedulers/rx-newthread.hpp"
 #include "schedulers/rx-eventloop.hpp"
+#include "schedulers/rx-sharded.hpp"
+#include "schedulers/rx-runloop.hpp"
+#include "schedulers/rx-reactor.hpp"
+#include "schedulers/rx-deadline.hpp"
+#include "schedulers/rx-workstealing.hpp"
 #include "schedulers/rx-immediate.hpp"
 #include "schedulers/rx-virtualtime.hpp"
 #include "schedulers/rx-sameworker.hpp"
@@ -42,5 +42,7 @@ namespace rxs=sources;
 #include "sources/rx-defer.hpp"
 #include "sources/rx-never.hpp"
 #include "sources/rx-error.hpp"
+#include "sources/rx-from_fd.hpp"
+#include "sources/rx-from_coroutine.hpp"
 
 #endif
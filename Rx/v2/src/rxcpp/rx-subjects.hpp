@@ -19,5 +19,6 @@ namespace rxsub=subjects;
 #include "subjects/rx-subject.hpp"
 #include "subjects/rx-behavior.hpp"
 #include "subjects/rx-synchronize.hpp"
+#include "subjects/rx-channel.hpp"
 
 #endif
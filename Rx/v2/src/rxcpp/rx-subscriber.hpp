@@ -26,6 +26,8 @@ class subscriber : public subscriber_base<T>
     composite_subscription lifetime;
     observer_type destination;
     trace_id id;
+    // set when created inside subscribe with a subscription_arena
+    bool under_arena;
 
     struct nextdetacher
     {
@@ -44,6 +46,10 @@ class subscriber : public subscriber_base<T>
         template<class U>
         void operator()(U u) {
             trace_activity().on_next_enter(*that, u);
+            detail::arena_pause paused(that->under_arena);
+#if RXCPP_USE_STALL_WATCHDOG
+            detail::watched_call watched(that->id);
+#endif
             that->destination.on_next(std::move(u));
             do_unsubscribe = false;
         }
@@ -64,6 +70,10 @@ class subscriber : public subscriber_base<T>
         }
         inline void operator()(std::exception_ptr ex) {
             trace_activity().on_error_enter(*that, ex);
+            detail::arena_pause paused(that->under_arena);
+#if RXCPP_USE_STALL_WATCHDOG
+            detail::watched_call watched(that->id);
+#endif
             that->destination.on_error(std::move(ex));
         }
         const this_type* that;
@@ -82,6 +92,10 @@ class subscriber : public subscriber_base<T>
         }
         inline void operator()() {
             trace_activity().on_completed_enter(*that);
+            detail::arena_pause paused(that->under_arena);
+#if RXCPP_USE_STALL_WATCHDOG
+            detail::watched_call watched(that->id);
+#endif
             that->destination.on_completed();
         }
         const this_type* that;
@@ -95,12 +109,14 @@ public:
         : lifetime(o.lifetime)
         , destination(o.destination)
         , id(o.id)
+        , under_arena(o.under_arena)
     {
     }
     subscriber(this_type&& o)
         : lifetime(std::move(o.lifetime))
         , destination(std::move(o.destination))
         , id(std::move(o.id))
+        , under_arena(o.under_arena)
     {
     }
 
@@ -109,6 +125,7 @@ public:
         : lifetime(std::move(cs))
         , destination(std::forward<U>(o))
         , id(std::move(id))
+        , under_arena(detail::arena::current() != nullptr)
     {
         static_assert(!is_subscriber<U>::value, "cannot nest subscribers");
         static_assert(is_observer<U>::value, "must pass observer to subscriber");
@@ -119,6 +136,7 @@ public:
         lifetime = std::move(o.lifetime);
         destination = std::move(o.destination);
         id = std::move(o.id);
+        under_arena = o.under_arena;
         return *this;
     }
 
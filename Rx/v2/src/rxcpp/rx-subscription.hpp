@@ -64,8 +64,14 @@ public:
     }
 };
 
+namespace detail {
+class composite_subscription_inner;
+class unsubscribe_worklist;
+}
+
 class subscription : public subscription_base
 {
+protected:
     class base_subscription_state : public std::enable_shared_from_this<base_subscription_state>
     {
         base_subscription_state();
@@ -107,6 +113,16 @@ protected:
 
     friend bool operator<(const subscription&, const subscription&);
     friend bool operator==(const subscription&, const subscription&);
+    friend class detail::composite_subscription_inner;
+    friend class detail::unsubscribe_worklist;
+
+    explicit subscription(std::shared_ptr<base_subscription_state> s)
+        : state(std::move(s))
+    {
+        if (!state) {
+            abort();
+        }
+    }
 
 private:
     subscription(weak_state_type w)
@@ -119,7 +135,7 @@ private:
 public:
 
     subscription()
-        : state(std::make_shared<base_subscription_state>(false))
+        : state(detail::make_state<base_subscription_state>(false))
     {
         if (!state) {
             abort();
@@ -127,7 +143,7 @@ public:
     }
     template<class U>
     explicit subscription(U u, typename std::enable_if<!is_subscription<U>::value, void**>::type = nullptr)
-        : state(std::make_shared<subscription_state<U>>(std::move(u)))
+        : state(detail::make_state<subscription_state<U>>(std::move(u)))
     {
         if (!state) {
             abort();
@@ -214,70 +230,300 @@ namespace detail {
 
 struct tag_composite_subscription_empty {};
 
-class composite_subscription_inner
+/// unsubscribe_worklist bounds the stack used to unsubscribe a tree of
+/// composite_subscriptions. the first recursion_limit levels of a tree
+/// are unsubscribed recursively, as before. a composite at a deeper level
+/// starts a worklist on its thread and then every deeper composite pushes
+/// its children onto that worklist instead of recursing. the children are
+/// released in batches as the worklist drains, so the destruction of the
+/// tree does not recurse either.
+/// only the composite that the worklist itself is unsubscribing defers its
+/// children. any other composite that is unsubscribed on the thread while
+/// the worklist drains, such as one that a child callback unsubscribes,
+/// is drained in place by a worklist of its own, so its children are
+/// unsubscribed before its unsubscribe() returns.
+/// the whole tree is still unsubscribed before the outermost unsubscribe()
+/// returns.
+class unsubscribe_worklist
 {
-private:
-    typedef subscription::weak_state_type weak_subscription;
-    struct composite_subscription_state : public std::enable_shared_from_this<composite_subscription_state>
+    enum {
+        recursion_limit = 32,
+        release_batch = 256
+    };
+
+    struct thread_state
     {
-        std::set<subscription> subscriptions;
-        std::mutex lock;
-        std::atomic<bool> issubscribed;
+        int depth;
+        unsubscribe_worklist* active;
+    };
 
-        ~composite_subscription_state()
-        {
-            std::unique_lock<decltype(lock)> guard(lock);
-            subscriptions.clear();
+    static thread_state& current() {
+        static RXCPP_THREAD_LOCAL thread_state state;
+        return state;
+    }
+
+    std::vector<subscription> pending;
+    std::vector<subscription> released;
+    // the state that drain is unsubscribing now
+    const void* reached;
+
+    unsubscribe_worklist()
+        : reached(nullptr)
+    {
+    }
+
+    template<class Slots>
+    void push(Slots& children) {
+        for (auto it = children.begin(), end = children.end(); it != end; ++it) {
+            if (!it->child.empty()) {
+                pending.push_back(std::move(it->child.get()));
+            }
         }
+    }
 
-        composite_subscription_state()
-            : issubscribed(true)
-        {
+    void drain() {
+        do {
+            while (!pending.empty()) {
+                subscription next(std::move(pending.back()));
+                pending.pop_back();
+                reached = next.state.get();
+                next.unsubscribe();
+                reached = nullptr;
+                released.push_back(std::move(next));
+                if (released.size() >= release_batch) {
+                    released.clear();
+                }
+            }
+            // destructors may unsubscribe more
+            released.clear();
+        } while (!pending.empty());
+    }
+
+    template<class Slots>
+    static void run(thread_state& state, Slots& children) {
+        auto outer = state.active;
+        unsubscribe_worklist worklist;
+        state.active = &worklist;
+        RXCPP_UNWIND_AUTO([&](){state.active = outer;});
+        worklist.push(children);
+        worklist.drain();
+    }
+
+public:
+    /// unsubscribe all the children in the slots that the composite with
+    /// the state owner has detached.
+    template<class Slots>
+    static void unsubscribe(Slots& children, const void* owner) {
+        auto& state = current();
+        if (state.active) {
+            if (state.active->reached == owner) {
+                state.active->push(children);
+            } else {
+                run(state, children);
+            }
+            return;
+        }
+        if (state.depth < recursion_limit) {
+            ++state.depth;
+            RXCPP_UNWIND_AUTO([&](){--state.depth;});
+            for (auto it = children.begin(), end = children.end(); it != end; ++it) {
+                if (!it->child.empty()) {
+                    it->child.get().unsubscribe();
+                }
+            }
+            return;
         }
-        composite_subscription_state(tag_composite_subscription_empty)
-            : issubscribed(false)
+        run(state, children);
+    }
+};
+
+/// composite_subscription_handle is returned by composite_subscription::add.
+/// it is a generation-checked index into the slot map of the composite
+/// that returned it. remove uses the owner to reject a handle from another
+/// composite, the index to find the slot and the stamp to detect that the
+/// child was already removed and the slot reused, so removal is O(1) and
+/// does not touch any reference counts.
+struct composite_subscription_handle
+{
+    static const size_t npos = static_cast<size_t>(-1);
+
+    composite_subscription_handle()
+        : owner(nullptr)
+        , index(npos)
+        , stamp(0)
+    {
+    }
+    composite_subscription_handle(const void* o, size_t i, uint64_t st)
+        : owner(o)
+        , index(i)
+        , stamp(st)
+    {
+    }
+
+    bool empty() const {
+        return index == npos;
+    }
+
+    // only compared, never dereferenced
+    const void* owner;
+    size_t index;
+    uint64_t stamp;
+};
+
+#if !defined(RXCPP_COMPOSITE_SUBSCRIPTION_INLINE_CHILDREN)
+#define RXCPP_COMPOSITE_SUBSCRIPTION_INLINE_CHILDREN 4
+#endif
+
+class composite_subscription_inner
+{
+private:
+    typedef composite_subscription_handle weak_subscription;
+    typedef subscription::base_subscription_state base_subscription_state;
+
+    // the composite state is also the state of the subscription that
+    // composite_subscription derives from, so that each composite costs
+    // one allocation.
+    struct composite_subscription_state : public base_subscription_state
+    {
+        // children are stored in slots. the first inline_capacity slots
+        // are stored in the state itself, the rest spill into a vector.
+        // removed slots are threaded onto a free list and reused by later
+        // adds so that add and remove are both O(1) and allocation free
+        // once the slots have grown to the steady-state number of children.
+        // every add takes a new stamp from this composite so that a stale
+        // handle can never match a slot that has since been reused, even
+        // across clear().
+        struct slot
+        {
+            slot()
+                : stamp(0)
+                , next_free(weak_subscription::npos)
+            {
+            }
+            slot(const slot& o)
+                : child(o.child)
+                , stamp(o.stamp)
+                , next_free(o.next_free)
+            {
+            }
+            slot(slot&& o)
+                : child(std::move(o.child))
+                , stamp(o.stamp)
+                , next_free(o.next_free)
+            {
+            }
+            rxu::detail::maybe<subscription> child;
+            uint64_t stamp;
+            size_t next_free;
+        };
+        static const size_t inline_capacity = RXCPP_COMPOSITE_SUBSCRIPTION_INLINE_CHILDREN;
+        typedef std::array<slot, inline_capacity> inline_slots_type;
+        typedef std::vector<slot> slots_type;
+
+        inline_slots_type inline_slots;
+        size_t inline_used;
+        slots_type spilled;
+        size_t free_head;
+        uint64_t last_stamp;
+        // all critical sections are O(1) except the moves in
+        // clear/unsubscribe, which detach all the slots in one step.
+        rxu::detail::spin_lock lock;
+
+        explicit composite_subscription_state(bool initial)
+            : base_subscription_state(initial)
+            , inline_used(0)
+            , free_head(weak_subscription::npos)
+            , last_stamp(0)
         {
         }
 
+        inline slot* find(size_t index) {
+            if (index < inline_capacity) {
+                return index < inline_used ? &inline_slots[index] : nullptr;
+            }
+            index -= inline_capacity;
+            return index < spilled.size() ? &spilled[index] : nullptr;
+        }
+
         inline weak_subscription add(subscription s) {
             if (!issubscribed) {
                 s.unsubscribe();
             } else if (s.is_subscribed()) {
                 std::unique_lock<decltype(lock)> guard(lock);
-                subscriptions.insert(s);
+                if (!issubscribed) {
+                    // lost a race with unsubscribe
+                    guard.unlock();
+                    s.unsubscribe();
+                    return weak_subscription();
+                }
+                size_t index = free_head;
+                slot* target = nullptr;
+                if (index != weak_subscription::npos) {
+                    target = find(index);
+                    free_head = target->next_free;
+                } else if (inline_used < inline_capacity) {
+                    index = inline_used++;
+                    target = &inline_slots[index];
+                } else {
+                    index = inline_capacity + spilled.size();
+                    spilled.push_back(slot());
+                    target = &spilled.back();
+                }
+                target->child.reset(std::move(s));
+                target->stamp = ++last_stamp;
+                return weak_subscription(this, index, target->stamp);
             }
-            return s.get_weak();
+            return weak_subscription();
         }
 
         inline void remove(weak_subscription w) {
-            if (issubscribed && !w.expired()) {
-                auto s = subscription::lock(w);
-                std::unique_lock<decltype(lock)> guard(lock);
-                subscriptions.erase(std::move(s));
+            if (issubscribed && !w.empty() && w.owner == this) {
+                rxu::detail::maybe<subscription> removed;
+                {
+                    std::unique_lock<decltype(lock)> guard(lock);
+                    auto target = find(w.index);
+                    if (!target || target->stamp != w.stamp || target->child.empty()) {
+                        // already removed, or the slot was reused
+                        return;
+                    }
+                    removed.reset(std::move(target->child.get()));
+                    target->child.reset();
+                    target->next_free = free_head;
+                    free_head = w.index;
+                }
+                // the child is released outside of the lock
+            }
+        }
+
+        inline void unsubscribe_all() {
+            std::unique_lock<decltype(lock)> guard(lock);
+
+            inline_slots_type inline_children;
+            for (size_t i = 0; i < inline_used; ++i) {
+                inline_children[i].child = std::move(inline_slots[i].child);
+                inline_slots[i].child.reset();
             }
+            inline_used = 0;
+            slots_type spilled_children(std::move(spilled));
+            spilled.clear();
+            free_head = weak_subscription::npos;
+            guard.unlock();
+            const base_subscription_state* owner = this;
+            unsubscribe_worklist::unsubscribe(inline_children, owner);
+            unsubscribe_worklist::unsubscribe(spilled_children, owner);
         }
 
         inline void clear() {
             if (issubscribed) {
-                std::unique_lock<decltype(lock)> guard(lock);
-
-                std::set<subscription> v(std::move(subscriptions));
-                guard.unlock();
-                std::for_each(v.begin(), v.end(),
-                              [](const subscription& s) {
-                                s.unsubscribe(); });
+                unsubscribe_all();
             }
         }
 
-        inline void unsubscribe() {
+        virtual void unsubscribe() {
             if (issubscribed.exchange(false)) {
-                std::unique_lock<decltype(lock)> guard(lock);
-
-                std::set<subscription> v(std::move(subscriptions));
-                guard.unlock();
-                std::for_each(v.begin(), v.end(),
-                              [](const subscription& s) {
-                                s.unsubscribe(); });
+                trace_activity().unsubscribe_enter(*this);
+                unsubscribe_all();
+                trace_activity().unsubscribe_return(*this);
             }
         }
     };
@@ -290,11 +536,11 @@ protected:
 
 public:
     composite_subscription_inner()
-        : state(std::make_shared<composite_subscription_state>())
+        : state(make_state<composite_subscription_state>(true))
     {
     }
-    composite_subscription_inner(tag_composite_subscription_empty et)
-        : state(std::make_shared<composite_subscription_state>(et))
+    composite_subscription_inner(tag_composite_subscription_empty)
+        : state(make_state<composite_subscription_state>(false))
     {
     }
 
@@ -346,6 +592,11 @@ public:
         }
         state->unsubscribe();
     }
+
+protected:
+    inline subscription as_subscription() const {
+        return subscription(std::static_pointer_cast<base_subscription_state>(state));
+    }
 };
 
 }
@@ -356,13 +607,13 @@ class composite_subscription
 {
     typedef detail::composite_subscription_inner inner_type;
 public:
-    typedef subscription::weak_state_type weak_subscription;
+    typedef detail::composite_subscription_handle weak_subscription;
 
     static composite_subscription shared_empty;
 
     composite_subscription(detail::tag_composite_subscription_empty et)
         : inner_type(et)
-        , subscription() // use empty base
+        , subscription(inner_type::as_subscription())
     {
     }
 
@@ -370,7 +621,7 @@ public:
 
     composite_subscription()
         : inner_type()
-        , subscription(*static_cast<const inner_type* const>(this))
+        , subscription(inner_type::as_subscription())
     {
     }
 
@@ -401,6 +652,10 @@ public:
 
     using inner_type::clear;
 
+    /// add does not look for s among the children. adding the same
+    /// subscription twice stores it twice and returns two handles, and each
+    /// handle removes one of the two. the child is still unsubscribed once,
+    /// since unsubscribe only acts on the first call.
     inline weak_subscription add(subscription s) const {
         if (s == static_cast<const subscription&>(*this)) {
             // do not nest the same subscription
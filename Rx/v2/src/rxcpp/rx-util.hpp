@@ -505,6 +505,43 @@ inline auto surely(const std::tuple<T...>& tpl)
 
 namespace detail {
 
+/// spin_lock is a test-and-test-and-set lock for critical sections that
+/// are a handful of instructions long. it satisfies Lockable so that it
+/// can be used with std::unique_lock and std::lock_guard.
+class spin_lock
+{
+    std::atomic<bool> locked;
+
+    spin_lock(const spin_lock&);
+    spin_lock& operator=(const spin_lock&);
+public:
+    spin_lock()
+        : locked(false)
+    {
+    }
+
+    inline bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) &&
+            !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    inline void lock() {
+        for (int spins = 0; !try_lock(); ++spins) {
+            // wait for the lock to look free before trying to take it again
+            while (locked.load(std::memory_order_relaxed)) {
+                if (++spins > 64) {
+                    std::this_thread::yield();
+                    spins = 0;
+                }
+            }
+        }
+    }
+
+    inline void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
 template<typename Function>
 class unwinder
 {
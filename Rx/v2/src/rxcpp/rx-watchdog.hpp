@@ -0,0 +1,287 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_WATCHDOG_HPP)
+#define RXCPP_RX_WATCHDOG_HPP
+
+#include "rx-includes.hpp"
+
+namespace rxcpp {
+
+/// what stall_watchdog reports about an action that has run too long
+struct stall_report
+{
+    /// the watched thread, numbered in the order that the threads started
+    size_t worker;
+    std::thread::id thread;
+    /// the innermost subscriber that was in on_next, on_error or
+    /// on_completed when the action was seen, or 0 when there was none
+    trace_id subscriber;
+    /// how long the action had been running
+    std::chrono::steady_clock::duration elapsed;
+};
+
+namespace detail {
+
+// one for each watched thread. written by that thread and read by the
+// watchdogs.
+struct watch_slot
+{
+    watch_slot()
+        : started(0)
+        , subscriber(0)
+        , runs(0)
+        , worker(0)
+    {
+    }
+    // steady_clock ticks when the running action started, 0 while idle
+    std::atomic<long long> started;
+    std::atomic<unsigned long> subscriber;
+    // counts the actions, so that a stall is reported once
+    std::atomic<unsigned long> runs;
+    size_t worker;
+    std::thread::id thread;
+};
+
+class watch_registry
+{
+    watch_registry()
+        : next(0)
+    {
+    }
+public:
+    std::mutex lock;
+    std::vector<watch_slot*> slots;
+    size_t next;
+
+    static watch_registry& instance() {
+        static watch_registry r;
+        return r;
+    }
+};
+
+// the schedulers that own their threads put one at the top of each thread
+// when RXCPP_USE_STALL_WATCHDOG is set. it shows the actions of that thread
+// to the watchdogs until the thread ends.
+class watched_thread
+{
+    typedef watched_thread this_type;
+    watched_thread(const this_type&);
+
+    watch_slot slot;
+
+public:
+    watched_thread()
+    {
+        slot.thread = std::this_thread::get_id();
+        auto& r = watch_registry::instance();
+        {
+            std::unique_lock<std::mutex> guard(r.lock);
+            slot.worker = r.next++;
+            r.slots.push_back(&slot);
+        }
+        current() = &slot;
+    }
+    ~watched_thread()
+    {
+        current() = nullptr;
+        auto& r = watch_registry::instance();
+        std::unique_lock<std::mutex> guard(r.lock);
+        r.slots.erase(std::find(r.slots.begin(), r.slots.end(), &slot));
+    }
+
+    // the slot of the calling thread, if it is watched
+    static watch_slot*& current() {
+        static RXCPP_THREAD_LOCAL watch_slot* s;
+        return s;
+    }
+};
+
+// marks the calling thread busy while one call of an action runs. an
+// action that runs inside another, as current_thread does, is part of the
+// outer one.
+class watched_action
+{
+    typedef watched_action this_type;
+    watched_action(const this_type&);
+
+    watch_slot* slot;
+
+public:
+    watched_action()
+        : slot(watched_thread::current())
+    {
+        if (slot && slot->started.load(std::memory_order_relaxed) == 0) {
+            slot->runs.fetch_add(1, std::memory_order_relaxed);
+            slot->started.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_release);
+        } else {
+            slot = nullptr;
+        }
+    }
+    ~watched_action()
+    {
+        if (slot) {
+            slot->started.store(0, std::memory_order_release);
+        }
+    }
+};
+
+// records the subscriber that the calling thread is in
+class watched_call
+{
+    typedef watched_call this_type;
+    watched_call(const this_type&);
+
+    watch_slot* slot;
+    unsigned long outer;
+
+public:
+    explicit watched_call(const trace_id& id)
+        : slot(watched_thread::current())
+        , outer(0)
+    {
+        if (slot) {
+            outer = slot->subscriber.load(std::memory_order_relaxed);
+            slot->subscriber.store(id.id, std::memory_order_relaxed);
+        }
+    }
+    ~watched_call()
+    {
+        if (slot) {
+            slot->subscriber.store(outer, std::memory_order_relaxed);
+        }
+    }
+};
+
+}
+
+/// stall_watchdog reports actions that run for longer than a threshold, such
+/// as a callback that blocks on a loop thread of event_loop and so stalls
+/// every subscription on that thread.
+///
+/// a thread of the watchdog looks at the threads of new_thread, event_loop,
+/// shards, deadline_pool, work_stealing and reactor a few times per
+/// threshold, and reports each stalled action once, while it is still
+/// running. the report names the thread and the innermost subscriber that
+/// the action was in, which is the one that trace_activity() calls
+/// create_subscriber() with.
+///
+/// the threads are only watched when RXCPP_USE_STALL_WATCHDOG is set, which
+/// adds a clock read to each action and two stores to each call of a
+/// subscriber. otherwise the watchdog never reports.
+class stall_watchdog
+{
+    typedef stall_watchdog this_type;
+    stall_watchdog(const this_type&);
+
+public:
+    typedef std::chrono::steady_clock clock_type;
+    typedef std::function<void(const stall_report&)> on_stall_type;
+
+private:
+    struct state_type
+    {
+        state_type(clock_type::duration t, on_stall_type f)
+            : threshold(t)
+            , on_stall(std::move(f))
+            , stop(false)
+        {
+        }
+        clock_type::duration threshold;
+        on_stall_type on_stall;
+        std::mutex lock;
+        std::condition_variable wake;
+        bool stop;
+        // the run that was last reported for each worker
+        std::map<size_t, unsigned long> reported;
+
+        void scan() {
+            std::vector<stall_report> stalls;
+            auto now = clock_type::now().time_since_epoch().count();
+            std::map<size_t, unsigned long> seen;
+            {
+                auto& r = detail::watch_registry::instance();
+                std::unique_lock<std::mutex> guard(r.lock);
+                for (auto slot : r.slots) {
+                    auto runs = slot->runs.load(std::memory_order_relaxed);
+                    auto started = slot->started.load(std::memory_order_acquire);
+                    auto subscriber = slot->subscriber.load(std::memory_order_relaxed);
+                    if (started == 0 || runs != slot->runs.load(std::memory_order_relaxed)) {
+                        continue;
+                    }
+                    clock_type::duration elapsed(now - started);
+                    if (elapsed < threshold) {
+                        continue;
+                    }
+                    seen[slot->worker] = runs;
+                    auto last = reported.find(slot->worker);
+                    if (last != reported.end() && last->second == runs) {
+                        continue;
+                    }
+                    stall_report s = {slot->worker, slot->thread, trace_id{subscriber}, elapsed};
+                    stalls.push_back(s);
+                }
+            }
+            reported.swap(seen);
+            for (auto& s : stalls) {
+                on_stall(s);
+            }
+        }
+
+        void run() {
+            auto period = (std::max)(threshold / 4, clock_type::duration(std::chrono::milliseconds(1)));
+            std::unique_lock<std::mutex> guard(lock);
+            while (!stop) {
+                wake.wait_for(guard, period);
+                if (stop) {
+                    break;
+                }
+                guard.unlock();
+                scan();
+                guard.lock();
+            }
+        }
+    };
+
+    std::shared_ptr<state_type> state;
+    std::thread thread;
+
+    void start() {
+        auto s = state;
+        thread = std::thread([s](){
+            s->run();
+        });
+    }
+
+public:
+    /// reports to std::cerr
+    explicit stall_watchdog(clock_type::duration threshold)
+        : state(std::make_shared<state_type>(threshold, [](const stall_report& s){
+            std::cerr << "rxcpp: worker " << s.worker << " (thread " << s.thread << ") has run one action for "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(s.elapsed).count() << "ms"
+                << ", in subscriber " << s.subscriber << std::endl;
+        }))
+    {
+        start();
+    }
+    /// on_stall is called on the thread of the watchdog
+    stall_watchdog(clock_type::duration threshold, on_stall_type on_stall)
+        : state(std::make_shared<state_type>(threshold, std::move(on_stall)))
+    {
+        start();
+    }
+    ~stall_watchdog()
+    {
+        {
+            std::unique_lock<std::mutex> guard(state->lock);
+            state->stop = true;
+            state->wake.notify_one();
+        }
+        thread.join();
+    }
+};
+
+}
+
+#endif
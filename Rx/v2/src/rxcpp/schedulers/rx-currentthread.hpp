@@ -21,7 +21,7 @@ struct action_queue
     typedef time_schedulable<clock::time_point> item_type;
 
 private:
-    typedef schedulable_queue<item_type::time_point_type> queue_item_time;
+    typedef select_schedulable_queue<item_type::time_point_type>::type queue_item_time;
 
 public:
     struct current_thread_queue_type {
@@ -199,6 +199,35 @@ private:
             if (scbl.is_subscribed()) {
                 scbl(recursor);
             }
+            drain(recursor);
+        }
+
+        virtual void schedule_batch(const schedulable* first, size_t count) const {
+            {
+                // check ownership
+                if (queue::owned()) {
+                    // already has an owner - delegate
+                    queue::get_worker_interface()->schedule_batch(first, count);
+                    return;
+                }
+
+                // take ownership
+                queue::ensure(std::make_shared<derecurser>());
+            }
+            // release ownership
+            RXCPP_UNWIND_AUTO([]{
+                queue::destroy();
+            });
+
+            auto when = now();
+            for (auto last = first + count; first != last; ++first) {
+                queue::push(queue::item_type(when, *first));
+            }
+            drain(queue::get_recursion().get_recurse());
+        }
+
+    private:
+        static void drain(const recurse& recursor) {
             if (queue::empty()) {
                 return;
             }
@@ -0,0 +1,433 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_SCHEDULER_DEADLINE_HPP)
+#define RXCPP_RX_SCHEDULER_DEADLINE_HPP
+
+#include "../rx-includes.hpp"
+
+namespace rxcpp {
+
+namespace schedulers {
+
+namespace detail {
+
+struct deadline_state
+{
+    typedef scheduler::clock_type clock_type;
+
+    typedef std::function<void(clock_type::time_point, clock_type::time_point)> missed_type;
+
+    // the actions of one worker that are due, in the order they were
+    // scheduled. running is set while a pool thread is in one of them so
+    // that the actions of a worker never overlap.
+    struct worker_queue
+    {
+        struct item_type
+        {
+            clock_type::time_point deadline;
+            schedulable what;
+        };
+
+        worker_queue()
+            : running(false)
+        {
+        }
+
+        std::deque<item_type> due;
+        bool running;
+    };
+    typedef std::shared_ptr<worker_queue> queue_ptr;
+
+    // a worker that is not running and has a due action. there is at most
+    // one per worker, keyed by the deadline of its first due action.
+    struct ready_type
+    {
+        clock_type::time_point deadline;
+        int64_t ordinal;
+        queue_ptr q;
+    };
+    struct ready_later
+    {
+        bool operator()(const ready_type& lhs, const ready_type& rhs) const {
+            return (lhs.deadline == rhs.deadline) ? (lhs.ordinal > rhs.ordinal) : (lhs.deadline > rhs.deadline);
+        }
+    };
+
+    // an action that is not due yet
+    struct pending_type
+    {
+        clock_type::time_point when;
+        int64_t ordinal;
+        clock_type::time_point deadline;
+        queue_ptr q;
+        schedulable what;
+    };
+    struct pending_later
+    {
+        bool operator()(const pending_type& lhs, const pending_type& rhs) const {
+            return (lhs.when == rhs.when) ? (lhs.ordinal > rhs.ordinal) : (lhs.when > rhs.when);
+        }
+    };
+
+    static bool is_dead(const pending_type& p) {
+        return !p.what.is_subscribed();
+    }
+
+    // the smallest pending heap that push compacts
+    static const size_t compact_min = 64;
+
+    // forwards current_thread schedules made by an action to the worker of
+    // the action, the same way that new_thread does.
+    struct running_worker : public worker_interface
+    {
+        explicit running_worker(const schedulable* const* r)
+            : running(r)
+        {
+        }
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+        virtual void schedule(const schedulable& scbl) const {
+            schedule(now(), scbl);
+        }
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            if (!*running) {
+                abort();
+            }
+            (*running)->get_worker().schedule(when, scbl);
+        }
+        const schedulable* const* running;
+    };
+
+    explicit deadline_state(missed_type m)
+        : ordinal(0)
+        , compact_at(compact_min)
+        , missed(std::move(m))
+    {
+    }
+
+    composite_subscription lifetime;
+    mutable std::mutex lock;
+    mutable std::condition_variable wake;
+    std::priority_queue<ready_type, std::vector<ready_type>, ready_later> ready;
+    // a heap ordered by pending_later. push drops the unsubscribed actions
+    // each time it doubles, so that cancelled timeouts do not pile up until
+    // they are due.
+    std::vector<pending_type> pending;
+    int64_t ordinal;
+    size_t compact_at;
+    missed_type missed;
+    std::vector<std::thread> threads;
+
+    // lock must be held
+    void make_due(const queue_ptr& q, clock_type::time_point deadline, const schedulable& scbl) {
+        worker_queue::item_type item = {deadline, scbl};
+        q->due.push_back(std::move(item));
+        if (!q->running && q->due.size() == 1) {
+            make_ready(q);
+        }
+    }
+
+    // lock must be held
+    void make_ready(const queue_ptr& q) {
+        ready_type r = {q->due.front().deadline, ++ordinal, q};
+        ready.push(std::move(r));
+    }
+
+    void push(const queue_ptr& q, clock_type::time_point when, clock_type::time_point deadline, const schedulable& scbl) {
+        if (!scbl.is_subscribed()) {
+            return;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        if (when > clock_type::now()) {
+            pending_type p = {when, ++ordinal, deadline, q, scbl};
+            pending.push_back(std::move(p));
+            std::push_heap(pending.begin(), pending.end(), pending_later());
+            if (pending.size() >= compact_at) {
+                compact();
+            }
+        } else {
+            make_due(q, deadline, scbl);
+        }
+        wake.notify_one();
+    }
+
+    // lock must be held
+    void compact() {
+        pending.erase(std::remove_if(pending.begin(), pending.end(), is_dead), pending.end());
+        std::make_heap(pending.begin(), pending.end(), pending_later());
+        compact_at = (std::max)(pending.size() * 2, size_t(compact_min));
+    }
+
+    // pool threads. takes the ready worker with the earliest deadline and
+    // runs its first due action. running points to it while it runs.
+    void run(const schedulable*& running) {
+        // each action goes back through the queue when it recurses, so a
+        // worker with an earlier deadline can run in between
+        recursion r(false);
+        std::unique_lock<std::mutex> guard(lock);
+        while (lifetime.is_subscribed()) {
+            auto now = clock_type::now();
+            while (!pending.empty() && pending.front().when <= now) {
+                auto& peek = pending.front();
+                make_due(peek.q, peek.deadline, peek.what);
+                std::pop_heap(pending.begin(), pending.end(), pending_later());
+                pending.pop_back();
+            }
+            if (ready.empty()) {
+                if (pending.empty()) {
+                    wake.wait(guard);
+                } else {
+                    wake.wait_until(guard, pending.front().when);
+                }
+                continue;
+            }
+            auto q = ready.top().q;
+            ready.pop();
+            {
+                auto next = std::move(q->due.front());
+                q->due.pop_front();
+                q->running = true;
+                if (!ready.empty()) {
+                    wake.notify_one();
+                }
+                guard.unlock();
+
+                if (next.what.is_subscribed()) {
+                    running = &next.what;
+                    RXCPP_UNWIND_AUTO([&](){
+                        running = nullptr;
+                    });
+                    next.what(r.get_recurse());
+                    if (missed) {
+                        auto finished = clock_type::now();
+                        if (finished > next.deadline) {
+                            missed(next.deadline, finished);
+                        }
+                    }
+                }
+            }
+            guard.lock();
+            q->running = false;
+            if (!q->due.empty()) {
+                make_ready(q);
+            }
+        }
+    }
+};
+
+}
+
+/// deadline_pool runs actions on a pool of threads in earliest deadline
+/// first order.
+///
+/// each action has a deadline. it is the deadline set on the schedulable,
+/// or else the time the action is due plus the budget of the scheduler
+/// that the worker came from. get_scheduler() gives schedulers with
+/// different budgets that share the threads.
+///
+/// the actions of one worker still run in order and never overlap, so the
+/// order across workers is by the deadline of the first due action of each
+/// worker. when an action finishes after its deadline, the missed callback
+/// is called on the pool thread with the deadline and the finish time.
+///
+/// the threads stop when the last copy of the pool is destroyed.
+class deadline_pool
+{
+public:
+    typedef scheduler::clock_type clock_type;
+    typedef detail::deadline_state::missed_type missed_type;
+
+private:
+    typedef detail::deadline_state state_type;
+
+    struct deadline_worker : public worker_interface
+    {
+    private:
+        typedef deadline_worker this_type;
+        deadline_worker(const this_type&);
+
+        std::shared_ptr<state_type> state;
+        state_type::queue_ptr queue;
+        clock_type::duration budget;
+
+        clock_type::time_point deadline_of(clock_type::time_point when, const schedulable& scbl) const {
+            auto deadline = scbl.get_deadline();
+            if (deadline != (clock_type::time_point::max)()) {
+                return deadline;
+            }
+            if (budget >= (clock_type::time_point::max)() - when) {
+                return (clock_type::time_point::max)();
+            }
+            return when + budget;
+        }
+
+    public:
+        virtual ~deadline_worker()
+        {
+        }
+
+        deadline_worker(std::shared_ptr<state_type> s, clock_type::duration b)
+            : state(std::move(s))
+            , queue(std::make_shared<state_type::worker_queue>())
+            , budget(b)
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual void schedule(const schedulable& scbl) const {
+            auto when = now();
+            state->push(queue, when, deadline_of(when, scbl), scbl);
+        }
+
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            state->push(queue, when, deadline_of(when, scbl), scbl);
+        }
+    };
+
+    struct deadline_scheduler : public scheduler_interface
+    {
+    private:
+        typedef deadline_scheduler this_type;
+        deadline_scheduler(const this_type&);
+
+        std::shared_ptr<state_type> state;
+        clock_type::duration budget;
+
+    public:
+        virtual ~deadline_scheduler()
+        {
+        }
+
+        deadline_scheduler(std::shared_ptr<state_type> s, clock_type::duration b)
+            : state(std::move(s))
+            , budget(b)
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual worker create_worker(composite_subscription cs) const {
+            return worker(std::move(cs), std::make_shared<deadline_worker>(state, budget));
+        }
+    };
+
+    // stops the threads when the last pool copy is gone. workers only hold
+    // the state, so they do not keep the threads alive.
+    struct owner
+    {
+        std::shared_ptr<state_type> state;
+
+        explicit owner(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+        ~owner()
+        {
+            {
+                std::unique_lock<std::mutex> guard(state->lock);
+                state->lifetime.unsubscribe();
+                state->wake.notify_all();
+            }
+            for (auto& t : state->threads) {
+                if (t.get_id() != std::this_thread::get_id()) {
+                    t.join();
+                } else {
+                    t.detach();
+                }
+            }
+            std::unique_lock<std::mutex> guard(state->lock);
+            while (!state->ready.empty()) {
+                state->ready.pop();
+            }
+            state->pending.clear();
+        }
+    };
+
+    std::shared_ptr<owner> pool;
+
+    void start(size_t count, thread_factory& tf) {
+        auto state = pool->state;
+        count = (std::max<size_t>)(count, 1);
+        for (size_t i = 0; i < count; ++i) {
+            state->threads.push_back(tf([state](){
+#if RXCPP_USE_STALL_WATCHDOG
+                // show the actions of this thread to stall_watchdog
+                rxcpp::detail::watched_thread watched;
+#endif
+                const schedulable* running = nullptr;
+                // take ownership
+                detail::action_queue::ensure(std::make_shared<state_type::running_worker>(&running));
+                // release ownership
+                RXCPP_UNWIND_AUTO([]{
+                    detail::action_queue::destroy();
+                });
+                state->run(running);
+            }));
+        }
+    }
+
+    static size_t default_thread_count() {
+        return std::thread::hardware_concurrency();
+    }
+
+public:
+    deadline_pool()
+        : pool(std::make_shared<owner>(std::make_shared<state_type>(missed_type())))
+    {
+        thread_factory tf = [](std::function<void()> start){
+            return std::thread(std::move(start));
+        };
+        start(default_thread_count(), tf);
+    }
+    explicit deadline_pool(size_t threads)
+        : pool(std::make_shared<owner>(std::make_shared<state_type>(missed_type())))
+    {
+        thread_factory tf = [](std::function<void()> start){
+            return std::thread(std::move(start));
+        };
+        start(threads, tf);
+    }
+    deadline_pool(size_t threads, missed_type missed)
+        : pool(std::make_shared<owner>(std::make_shared<state_type>(std::move(missed))))
+    {
+        thread_factory tf = [](std::function<void()> start){
+            return std::thread(std::move(start));
+        };
+        start(threads, tf);
+    }
+    deadline_pool(size_t threads, thread_factory tf, missed_type missed)
+        : pool(std::make_shared<owner>(std::make_shared<state_type>(std::move(missed))))
+    {
+        start(threads, tf);
+    }
+
+    /// a scheduler whose actions must finish within budget of the time
+    /// that they are due, unless the schedulable has its own deadline
+    scheduler get_scheduler(clock_type::duration budget) const {
+        return make_scheduler<deadline_scheduler>(pool->state, budget);
+    }
+};
+
+inline scheduler make_deadline(const deadline_pool& pool, deadline_pool::clock_type::duration budget) {
+    return pool.get_scheduler(budget);
+}
+
+/// the pool used by observe_on_deadline when none is given
+inline const deadline_pool& default_deadline_pool() {
+    static deadline_pool p;
+    return p;
+}
+
+}
+
+}
+
+#endif
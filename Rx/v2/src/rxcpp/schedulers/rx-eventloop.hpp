@@ -7,16 +7,122 @@
 
 #include "../rx-includes.hpp"
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace rxcpp {
 
 namespace schedulers {
 
+namespace detail {
+
+/// pin the calling thread to the given cpus. returns false when the
+/// platform does not support it or the cpus are not available.
+inline bool set_current_thread_affinity(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return true;
+    }
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+}
+
 struct event_loop : public scheduler_interface
 {
+public:
+    /// how create_worker picks the loop for a new worker
+    enum placement {
+        /// each new worker goes to the next loop
+        round_robin,
+        /// each new worker goes to the loop with the fewest active workers
+        /// plus queued actions
+        least_loaded
+    };
+
+    /// where the state of each loop is allocated
+    enum numa_policy {
+        /// on the thread that constructs the event_loop
+        numa_default,
+        /// on the loop thread, after it has been pinned, so that a first
+        /// touch allocation policy places it on the node of that thread.
+        /// queue storage that grows later is still allocated by the
+        /// thread that schedules.
+        numa_local
+    };
+
+    /// config sets up the loop threads
+    struct config
+    {
+        config()
+            : thread_count((std::max)(std::thread::hardware_concurrency(), unsigned(4)) - 1)
+            , mode(round_robin)
+            , numa(numa_default)
+            , wait(new_thread::block)
+            , priority_quota(new_thread::default_priority_quota)
+        {
+        }
+        /// the number of loop threads
+        size_t thread_count;
+        /// loop thread i is pinned to cpus[i % cpus.size()]. an empty
+        /// set, or an empty list, leaves the thread unpinned.
+        std::vector<std::vector<int>> cpus;
+        placement mode;
+        numa_policy numa;
+        /// how an idle loop thread waits for work
+        new_thread::wait_strategy wait;
+        /// the priority::high actions a loop runs in a row while
+        /// priority::normal actions are waiting
+        int priority_quota;
+        /// how long one action may tail-recurse before the other actions
+        /// on its loop get a turn. the default has no limit.
+        recursion_budget budget;
+        /// used to create each loop thread. empty means std::thread.
+        thread_factory factory;
+        /// when set, the loop threads that are not pinned are taken from
+        /// this cache, which creates them with its own factory. factory is
+        /// used when max_threads of the cache are running.
+        std::shared_ptr<thread_cache> cache;
+    };
+
+    /// a snapshot of the load on one loop thread.
+    /// queued is the actions that are ready to run on the loop and have not
+    /// been taken yet. timed actions are not counted. queued is only
+    /// tracked in least_loaded mode.
+    struct loop_load
+    {
+        size_t workers;
+        size_t queued;
+    };
+
 private:
     typedef event_loop this_type;
     event_loop(const this_type&);
 
+    struct load_state
+    {
+        load_state()
+            : workers(0)
+            , queued(0)
+        {
+        }
+        std::atomic<size_t> workers;
+        std::atomic<size_t> queued;
+    };
+
     struct loop_worker : public worker_interface
     {
     private:
@@ -31,6 +137,13 @@ private:
         composite_subscription lifetime;
         worker controller;
 
+        // the item that is queued on the loop thread for scbl
+        schedulable bind(const schedulable& scbl) const {
+            auto result = make_schedulable(controller, lifetime, scbl.get_action());
+            result.set_priority(scbl.get_priority());
+            return result;
+        }
+
     public:
         virtual ~loop_worker()
         {
@@ -45,42 +158,132 @@ private:
             return clock_type::now();
         }
 
+        // the counters are those of the loop thread, which all the
+        // workers placed on it share
+        virtual bool get_metrics(worker_metrics& m) const {
+            return controller.get_metrics(m);
+        }
+
         virtual void schedule(const schedulable& scbl) const {
-            controller.schedule(lifetime, scbl.get_action());
+            controller.schedule(bind(scbl));
         }
 
         virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
-            controller.schedule(when, lifetime, scbl.get_action());
+            controller.schedule(when, bind(scbl));
+        }
+
+        virtual void schedule_batch(const schedulable* first, size_t n) const {
+            std::vector<schedulable> batch;
+            batch.reserve(n);
+            for (auto last = first + n; first != last; ++first) {
+                // the loop only sees the lifetime of this worker, so drop
+                // the items that are already unsubscribed here
+                if (first->is_subscribed()) {
+                    batch.push_back(bind(*first));
+                }
+            }
+            controller.schedule_batch(batch);
         }
     };
 
     mutable thread_factory factory;
-    scheduler newthread;
     mutable std::atomic<size_t> count;
+    placement mode;
     std::vector<worker> loops;
+    std::vector<std::shared_ptr<load_state>> loads;
+
+    static thread_factory default_factory() {
+        return [](std::function<void()> start){
+            return std::thread(std::move(start));
+        };
+    }
+
+    static thread_factory pinned_factory(thread_factory tf, std::vector<int> cpus) {
+        if (cpus.empty()) {
+            return tf;
+        }
+        return [tf, cpus](std::function<void()> start){
+            return tf([cpus, start](){
+                detail::set_current_thread_affinity(cpus);
+                start();
+            });
+        };
+    }
+
+    void start(const config& c) {
+        auto threads = (std::max)(c.thread_count, size_t(1));
+        for (size_t i = 0; i != threads; ++i) {
+            auto cpus = c.cpus.empty() ? std::vector<int>() : c.cpus[i % c.cpus.size()];
+            auto tf = pinned_factory(factory, cpus);
+            // a pinned thread must not go back to a cache that others share
+            auto nt = c.cache && cpus.empty()
+                ? std::make_shared<new_thread>(tf, c.wait, c.priority_quota, c.budget, *c.cache)
+                : std::make_shared<new_thread>(tf, c.wait, c.priority_quota, c.budget);
+            auto load = std::make_shared<load_state>();
+            if (mode == least_loaded) {
+                // the loop thread keeps the count of its ready actions
+                nt->count_ready(std::shared_ptr<std::atomic<size_t>>(load, &load->queued));
+            }
+            if (c.numa == numa_local) {
+                // the loop thread allocates its state after it is pinned
+                nt->allocate_on_worker_thread();
+            }
+            scheduler newthread(std::static_pointer_cast<scheduler_interface>(nt));
+            auto loop = newthread.create_worker();
+            loops.push_back(loop);
+            loads.push_back(load);
+        }
+    }
+
+    size_t pick() const {
+        auto next = ++count;
+        if (mode == round_robin) {
+            return next % loops.size();
+        }
+        // start the scan at a different loop each time so that ties
+        // are spread round-robin
+        size_t best = next % loops.size();
+        size_t lightest = (std::numeric_limits<size_t>::max)();
+        for (size_t i = 0; i != loops.size(); ++i) {
+            auto candidate = (next + i) % loops.size();
+            auto& l = *loads[candidate];
+            auto current = l.workers.load(std::memory_order_relaxed) + l.queued.load(std::memory_order_relaxed);
+            if (current < lightest) {
+                lightest = current;
+                best = candidate;
+            }
+        }
+        return best;
+    }
 
 public:
     event_loop()
-        : factory([](std::function<void()> start){
-            return std::thread(std::move(start));
-        })
-        , newthread(make_new_thread())
+        : factory(default_factory())
         , count(0)
+        , mode(round_robin)
     {
-        auto remaining = std::max(std::thread::hardware_concurrency(), unsigned(4));
-        while (--remaining) {
-            loops.push_back(newthread.create_worker());
-        }
+        start(config());
     }
     explicit event_loop(thread_factory tf)
         : factory(tf)
-        , newthread(make_new_thread(tf))
         , count(0)
+        , mode(round_robin)
     {
-        auto remaining = std::max(std::thread::hardware_concurrency(), unsigned(4));
-        while (--remaining) {
-            loops.push_back(newthread.create_worker());
-        }
+        start(config());
+    }
+    event_loop(thread_factory tf, placement p)
+        : factory(tf)
+        , count(0)
+        , mode(p)
+    {
+        start(config());
+    }
+    explicit event_loop(const config& c)
+        : factory(c.factory ? c.factory : default_factory())
+        , count(0)
+        , mode(c.mode)
+    {
+        start(c);
     }
     virtual ~event_loop()
     {
@@ -91,7 +294,36 @@ public:
     }
 
     virtual worker create_worker(composite_subscription cs) const {
-        return worker(cs, std::shared_ptr<loop_worker>(new loop_worker(cs, loops[++count % loops.size()])));
+        auto index = pick();
+        auto l = loads[index];
+        ++l->workers;
+        cs.add([l](){
+            --l->workers;
+        });
+        return worker(cs, std::shared_ptr<loop_worker>(new loop_worker(cs, loops[index])));
+    }
+
+    /// the counters of each loop thread, when RXCPP_USE_SCHEDULER_METRICS
+    /// is set
+    virtual bool get_metrics(std::vector<worker_metrics>& m) const {
+        std::vector<worker_metrics> result(loops.size());
+        for (size_t i = 0; i != loops.size(); ++i) {
+            if (!loops[i].get_metrics(result[i])) {
+                return false;
+            }
+        }
+        m.swap(result);
+        return true;
+    }
+
+    /// the current load on each loop thread
+    std::vector<loop_load> load() const {
+        std::vector<loop_load> result;
+        for (auto& l : loads) {
+            loop_load current = {l->workers.load(), l->queued.load()};
+            result.push_back(current);
+        }
+        return result;
     }
 };
 
@@ -102,6 +334,12 @@ inline scheduler make_event_loop() {
 inline scheduler make_event_loop(thread_factory tf) {
     return make_scheduler<event_loop>(tf);
 }
+inline scheduler make_event_loop(thread_factory tf, event_loop::placement p) {
+    return make_scheduler<event_loop>(tf, p);
+}
+inline scheduler make_event_loop(const event_loop::config& c) {
+    return make_scheduler<event_loop>(c);
+}
 
 }
 
@@ -7,18 +7,439 @@
 
 #include "../rx-includes.hpp"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace rxcpp {
 
 namespace schedulers {
 
 typedef std::function<std::thread(std::function<void()>)> thread_factory;
 
+namespace detail {
+
+/// mpsc_queue is an unbounded lock-free queue with many producers and one
+/// consumer (Vyukov). push is a single exchange. the consumer owns a stub
+/// node, so front and pop never touch the producers' end of the queue.
+template<class T>
+class mpsc_queue
+{
+    struct node
+    {
+        std::atomic<node*> next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T& value() {
+            return *reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    mpsc_queue(const mpsc_queue&);
+    mpsc_queue& operator=(const mpsc_queue&);
+
+    std::atomic<node*> head;
+    node* tail;
+
+    static node* allocate() {
+#if RXCPP_USE_OBJECT_POOL
+        auto n = rxcpp::detail::pool_allocator<node>().allocate(1);
+#else
+        auto n = static_cast<node*>(::operator new(sizeof(node)));
+#endif
+        new (&n->next) std::atomic<node*>(nullptr);
+        return n;
+    }
+    static void deallocate(node* n) {
+#if RXCPP_USE_OBJECT_POOL
+        rxcpp::detail::pool_allocator<node>().deallocate(n, 1);
+#else
+        ::operator delete(n);
+#endif
+    }
+
+public:
+    mpsc_queue()
+        : head(allocate())
+        , tail(head.load())
+    {
+    }
+    ~mpsc_queue() {
+        while (front()) {
+            pop();
+        }
+        deallocate(tail);
+    }
+
+    /// any thread
+    void push(T value) {
+        auto n = allocate();
+        new (&n->storage) T(std::move(value));
+        auto prev = head.exchange(n, std::memory_order_seq_cst);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    /// consumer only. the next item, or null when there is none yet. an
+    /// item whose push has not finished linking is not visible yet.
+    T* front() {
+        auto next = tail->next.load(std::memory_order_acquire);
+        return next ? &next->value() : nullptr;
+    }
+
+    /// consumer only. front must not be null.
+    void pop() {
+        auto next = tail->next.load(std::memory_order_relaxed);
+        next->value().~T();
+        deallocate(tail);
+        tail = next;
+    }
+
+    /// consumer only. true when no push has started since the last pop.
+    /// this is the check to make before parking the consumer.
+    bool idle() const {
+        return head.load(std::memory_order_seq_cst) == tail;
+    }
+};
+
+#if RXCPP_USE_SCHEDULER_METRICS
+
+/// the counters behind worker_metrics. producers count what they queue,
+/// the rest is written by the worker thread alone and may be read from any
+/// thread.
+struct worker_counters
+{
+    typedef worker_metrics::clock_type clock_type;
+
+    worker_counters()
+        : queued(0)
+        , executed(0)
+        , busy(0)
+        , tail_recursions(0)
+        , reschedules(0)
+    {
+        for (auto& bucket : wait) {
+            bucket.store(0);
+        }
+    }
+
+    std::atomic<int64_t> queued;
+    std::atomic<uint64_t> executed;
+    std::atomic<clock_type::rep> busy;
+    std::atomic<uint64_t> tail_recursions;
+    std::atomic<uint64_t> reschedules;
+    std::atomic<uint64_t> wait[worker_metrics::wait_buckets];
+
+    void enqueued() {
+        queued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // worker thread only
+    void dequeued() {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // the queue dropped unsubscribed items when it compacted
+    void dropped(size_t n) {
+        queued.fetch_sub(static_cast<int64_t>(n), std::memory_order_relaxed);
+    }
+
+    // worker thread only
+    void waited(clock_type::duration d) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        int bucket = 0;
+        while (bucket < worker_metrics::wait_buckets - 1 && us >= (static_cast<decltype(us)>(1) << bucket)) {
+            ++bucket;
+        }
+        add(wait[bucket], 1);
+    }
+
+    // worker thread only
+    void ran(clock_type::duration d, const recurse& r) {
+        add(executed, 1);
+        busy.store(busy.load(std::memory_order_relaxed) + d.count(), std::memory_order_relaxed);
+        // the recurse of the worker keeps a running total
+        tail_recursions.store(r.tail_recursions(), std::memory_order_relaxed);
+        reschedules.store(r.rescheduled(), std::memory_order_relaxed);
+    }
+
+    worker_metrics snapshot() const {
+        worker_metrics result;
+        auto q = queued.load(std::memory_order_relaxed);
+        result.queued = q < 0 ? 0 : static_cast<size_t>(q);
+        result.executed = executed.load(std::memory_order_relaxed);
+        result.busy = clock_type::duration(busy.load(std::memory_order_relaxed));
+        result.tail_recursions = tail_recursions.load(std::memory_order_relaxed);
+        result.reschedules = reschedules.load(std::memory_order_relaxed);
+        for (int i = 0; i != worker_metrics::wait_buckets; ++i) {
+            result.wait[i] = wait[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+private:
+    // single writer, so a load and a store is enough
+    static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+#endif
+
+/// tell the cpu that this thread is polling, so that a sibling hardware
+/// thread gets the pipeline and the poll does not flood the memory bus
+inline void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+}
+
+/// thread_cache keeps the threads of ended new_thread workers parked for
+/// a while, and runs the next new worker on a parked thread instead of
+/// creating a thread for it. a new_thread that is given a thread_cache
+/// does not pay for a thread create and join for each short-lived
+/// subscription, as observe_on_new_thread() and subscribe_on do.
+///
+/// a parked thread ends after keep_alive without work. the cache owns at
+/// most max_threads threads, running or parked. a worker that is created
+/// while all of them are running gets a thread of its own that ends with
+/// it, as without a cache.
+///
+/// when the last copy of the cache is destroyed the parked threads end and
+/// are joined. the running threads end with their workers.
+class thread_cache
+{
+public:
+    typedef scheduler_base::clock_type clock_type;
+
+    /// config sets up the cache
+    struct config
+    {
+        config()
+            : keep_alive(std::chrono::seconds(10))
+            , max_threads(256)
+            , max_idle(64)
+        {
+        }
+        /// how long a parked thread waits for a new worker before it ends
+        clock_type::duration keep_alive;
+        /// the threads that the cache owns, running or parked
+        size_t max_threads;
+        /// the threads that may be parked. a thread that ends its worker
+        /// while max_idle others are parked ends too.
+        size_t max_idle;
+        /// used to create each thread. empty means std::thread.
+        thread_factory factory;
+    };
+
+    /// a snapshot of the threads of the cache
+    struct thread_counts
+    {
+        /// the threads that run a worker
+        size_t running;
+        /// the threads that are parked
+        size_t idle;
+        /// the threads that the cache has created
+        uint64_t created;
+    };
+
+private:
+    // one for each thread of the cache
+    struct slot
+    {
+        slot()
+            : parked(false)
+        {
+        }
+        std::thread thread;
+        std::condition_variable wake;
+        // the worker to run, guarded by the lock of the cache
+        std::function<void()> work;
+        bool parked;
+    };
+
+    struct state_type
+    {
+        explicit state_type(const config& c)
+            : settings(c)
+            , created(0)
+            , stopping(false)
+        {
+            if (!settings.factory) {
+                settings.factory = [](std::function<void()> start){
+                    return std::thread(std::move(start));
+                };
+            }
+        }
+
+        config settings;
+        std::mutex lock;
+        std::vector<std::shared_ptr<slot>> slots;
+        // the most recently parked thread is reused first, while it is warm
+        std::vector<std::shared_ptr<slot>> idle;
+        uint64_t created;
+        bool stopping;
+
+        static void serve(std::shared_ptr<state_type> s, std::shared_ptr<slot> me) {
+            std::unique_lock<std::mutex> guard(s->lock);
+            for (;;) {
+                while (me->work) {
+                    auto work = std::move(me->work);
+                    me->work = nullptr;
+                    guard.unlock();
+                    work();
+                    // release the worker before parking
+                    work = nullptr;
+                    guard.lock();
+                }
+                if (s->stopping || s->idle.size() >= s->settings.max_idle) {
+                    break;
+                }
+                me->parked = true;
+                s->idle.push_back(me);
+                auto until = clock_type::now() + s->settings.keep_alive;
+                while (!me->work && !s->stopping) {
+                    if (me->wake.wait_until(guard, until) == std::cv_status::timeout) {
+                        break;
+                    }
+                }
+                if (!me->work) {
+                    me->parked = false;
+                    s->idle.erase(std::find(s->idle.begin(), s->idle.end(), me));
+                    break;
+                }
+            }
+            s->slots.erase(std::find(s->slots.begin(), s->slots.end(), me));
+            // while stopping, the owner joins or detaches the thread
+            if (!s->stopping) {
+                me->thread.detach();
+            }
+        }
+
+        // runs body on a cached thread. false when the cache is full and
+        // body was not taken.
+        bool run(const std::shared_ptr<state_type>& self, std::function<void()>& body) {
+            std::unique_lock<std::mutex> guard(lock);
+            if (stopping) {
+                return false;
+            }
+            if (!idle.empty()) {
+                auto next = std::move(idle.back());
+                idle.pop_back();
+                next->parked = false;
+                next->work = std::move(body);
+                next->wake.notify_one();
+                return true;
+            }
+            if (slots.size() >= settings.max_threads) {
+                return false;
+            }
+            auto next = std::make_shared<slot>();
+            next->work = std::move(body);
+            slots.push_back(next);
+            ++created;
+            // the new thread waits for the lock, so the thread is stored
+            // before it can end
+            next->thread = settings.factory([self, next](){
+                serve(self, next);
+            });
+            return true;
+        }
+    };
+
+    struct owner
+    {
+        explicit owner(const config& c)
+            : state(std::make_shared<state_type>(c))
+        {
+        }
+        ~owner()
+        {
+            std::vector<std::thread> parked;
+            {
+                std::unique_lock<std::mutex> guard(state->lock);
+                state->stopping = true;
+                for (auto& sl : state->slots) {
+                    if (sl->parked) {
+                        sl->wake.notify_one();
+                        parked.push_back(std::move(sl->thread));
+                    } else {
+                        sl->thread.detach();
+                    }
+                }
+            }
+            for (auto& t : parked) {
+                t.join();
+            }
+        }
+        std::shared_ptr<state_type> state;
+    };
+
+    std::shared_ptr<owner> cache;
+
+public:
+    thread_cache()
+        : cache(std::make_shared<owner>(config()))
+    {
+    }
+    explicit thread_cache(const config& c)
+        : cache(std::make_shared<owner>(c))
+    {
+    }
+
+    /// runs body on a cached thread and returns true, or returns false
+    /// and leaves body alone when max_threads are running
+    bool run(std::function<void()>& body) const {
+        return cache->state->run(cache->state, body);
+    }
+
+    /// used to create the threads of the cache
+    thread_factory get_factory() const {
+        return cache->state->settings.factory;
+    }
+
+    thread_counts get_counts() const {
+        auto& s = *cache->state;
+        std::unique_lock<std::mutex> guard(s.lock);
+        thread_counts result = {s.slots.size() - s.idle.size(), s.idle.size(), s.created};
+        return result;
+    }
+};
+
 struct new_thread : public scheduler_interface
 {
+public:
+    /// how a worker thread waits when it has nothing to run
+    enum wait_strategy {
+        /// park on a condition variable straight away. the thread uses no
+        /// cpu while idle, a producer pays for a notify to wake it.
+        block,
+        /// poll for a while, then yield for a while, then park. a burst
+        /// that arrives within tens of microseconds is picked up without
+        /// a wake up.
+        spin_then_park,
+        /// poll and never park. the lowest latency, at the cost of a cpu
+        /// for each worker thread.
+        busy_spin
+    };
+
+    /// the high priority items that a worker runs in a row, by default,
+    /// before it lets one normal priority item through
+    static const int default_priority_quota = 16;
+
 private:
     typedef new_thread this_type;
     new_thread(const this_type&);
 
+    // the polls that spin_then_park makes before it parks
+    static const int spin_count = 2000;
+    static const int yield_count = 64;
+
     struct new_worker : public worker_interface
     {
     private:
@@ -30,8 +451,8 @@ private:
 
         struct new_worker_state : public std::enable_shared_from_this<new_worker_state>
         {
-            typedef detail::schedulable_queue<
-                typename clock_type::time_point> queue_item_time;
+            typedef detail::select_schedulable_queue<
+                typename clock_type::time_point>::type queue_item_time;
 
             typedef queue_item_time::item_type item_type;
 
@@ -45,21 +466,208 @@ private:
                 }
                 else {
                     lifetime.unsubscribe();
-                    worker.detach();
+                    // a worker on a thread_cache thread has no thread of its own
+                    if (worker.joinable()) {
+                        worker.detach();
+                    }
                 }
             }
 
-            explicit new_worker_state(composite_subscription cs)
+            new_worker_state(composite_subscription cs, wait_strategy ws, int quota, const recursion_budget& budget, std::shared_ptr<std::atomic<size_t>> ready)
                 : lifetime(cs)
+                , strategy(ws)
+                , quota(quota)
+                , burst(0)
+                , parked(false)
+                , ready(std::move(ready))
             {
+                r.set_budget(budget);
             }
 
+            // the queues for one priority
+            struct lane
+            {
+                lane()
+                    : timed(false)
+                {
+                }
+                // items scheduled to run now, in the order they were scheduled
+                detail::mpsc_queue<item_type> immediate;
+                // items scheduled for a time, guarded by lock
+                queue_item_time queue;
+                // set while queue may be non-empty, so that the worker thread
+                // only takes the lock when there are timed items
+                std::atomic<bool> timed;
+            };
+
             composite_subscription lifetime;
+            wait_strategy strategy;
+            // the high lane items that may run in a row while the normal
+            // lane has items to run
+            int quota;
+            // worker thread only. the high lane items run in a row
+            mutable int burst;
+            // guards the timed queues and parking
             mutable std::mutex lock;
             mutable std::condition_variable wake;
-            mutable queue_item_time queue;
+            // indexed by priority::type
+            mutable lane lanes[2];
+            // set while the worker thread is waiting on wake
+            mutable std::atomic<bool> parked;
             std::thread worker;
             recursion r;
+#if RXCPP_USE_SCHEDULER_METRICS
+            mutable detail::worker_counters counters;
+#endif
+            // when set, counts the immediate items that are queued
+            std::shared_ptr<std::atomic<size_t>> ready;
+
+            void pushed_immediate() const {
+                if (ready) {
+                    ready->fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            lane& lane_of(const schedulable& scbl) const {
+                return lanes[scbl.get_priority() == priority::high ? priority::high : priority::normal];
+            }
+
+            // true when no lane has an immediate item
+            bool immediate_idle() const {
+                return lanes[priority::high].immediate.idle() && lanes[priority::normal].immediate.idle();
+            }
+
+            // true when nothing is queued in any lane
+            bool all_idle() const {
+                return immediate_idle() && !lanes[priority::high].timed.load() && !lanes[priority::normal].timed.load();
+            }
+
+            // worker thread only. takes the next item in the lane, if one is
+            // due. immediate items and due timed items run in when order.
+            bool take(lane& l, clock_type::time_point now, schedulable& what) const {
+                auto imm = l.immediate.front();
+                if (l.timed.load(std::memory_order_acquire)) {
+                    std::unique_lock<std::mutex> guard(lock);
+                    while (!l.queue.empty()) {
+                        auto& peek = l.queue.top();
+                        if (!peek.what.is_subscribed()) {
+                            l.queue.pop();
+#if RXCPP_USE_SCHEDULER_METRICS
+                            counters.dequeued();
+#endif
+                            continue;
+                        }
+                        if (peek.when <= now && (!imm || peek.when <= imm->when)) {
+#if RXCPP_USE_SCHEDULER_METRICS
+                            counters.dequeued();
+                            counters.waited(now - peek.when);
+#endif
+                            what = peek.what;
+                            l.queue.pop();
+                            l.timed = !l.queue.empty();
+                            return true;
+                        }
+                        break;
+                    }
+                    l.timed = !l.queue.empty();
+                }
+                if (!imm) {
+                    return false;
+                }
+#if RXCPP_USE_SCHEDULER_METRICS
+                counters.dequeued();
+                counters.waited(now - imm->when);
+#endif
+                what = std::move(imm->what);
+                l.immediate.pop();
+                if (ready) {
+                    ready->fetch_sub(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+
+            // worker thread only. takes the next item to run, if one is
+            // due. the high lane goes first, but after quota high items in
+            // a row one normal item is let through.
+            bool next(schedulable& what) const {
+                auto now = clock_type::now();
+                auto& high = lanes[priority::high];
+                auto& normal = lanes[priority::normal];
+                if (burst < quota && take(high, now, what)) {
+                    ++burst;
+                    return true;
+                }
+                burst = 0;
+                if (take(normal, now, what)) {
+                    return true;
+                }
+                if (take(high, now, what)) {
+                    burst = 1;
+                    return true;
+                }
+                return false;
+            }
+
+            // worker thread only. wait, as the strategy says, until
+            // something may be runnable.
+            void idle() const {
+                if (strategy == block) {
+                    park();
+                    return;
+                }
+                // with one cpu the producer cannot run while this thread
+                // polls, so give it the cpu instead
+                static const bool uniprocessor = std::thread::hardware_concurrency() == 1;
+                if (strategy == busy_spin) {
+                    // timed items are polled by next()
+                    if (uniprocessor) {
+                        std::this_thread::yield();
+                    } else {
+                        detail::cpu_relax();
+                    }
+                    return;
+                }
+                auto ready = [this](){
+                    return !lifetime.is_subscribed() || !immediate_idle();
+                };
+                for (int spin = 0; !uniprocessor && spin < spin_count; ++spin) {
+                    if (ready()) {
+                        return;
+                    }
+                    detail::cpu_relax();
+                }
+                for (int spin = 0; spin < yield_count; ++spin) {
+                    if (ready()) {
+                        return;
+                    }
+                    std::this_thread::yield();
+                }
+                park();
+            }
+
+            // worker thread only. wait until something may be runnable.
+            void park() const {
+                std::unique_lock<std::mutex> guard(lock);
+                parked.store(true, std::memory_order_seq_cst);
+                RXCPP_UNWIND_AUTO([&](){parked.store(false, std::memory_order_relaxed);});
+                // a producer that pushed before parked was set is seen here.
+                // a producer that pushes after will see parked and notify.
+                auto ready = [this](){
+                    return !lifetime.is_subscribed() || !immediate_idle();
+                };
+                if (ready()) {
+                    return;
+                }
+                auto& high = lanes[priority::high].queue;
+                auto& normal = lanes[priority::normal].queue;
+                if (high.empty() && normal.empty()) {
+                    wake.wait(guard, [&](){return ready() || !high.empty() || !normal.empty();});
+                } else if (normal.empty() || (!high.empty() && high.top().when <= normal.top().when)) {
+                    wake.wait_until(guard, high.top().when);
+                } else {
+                    wake.wait_until(guard, normal.top().when);
+                }
+            }
         };
 
         std::shared_ptr<new_worker_state> state;
@@ -74,81 +682,231 @@ private:
         {
         }
 
-        new_worker(composite_subscription cs, thread_factory& tf)
-            : state(std::make_shared<new_worker_state>(cs))
-        {
-            auto keepAlive = state;
+        // runs the items of the worker until its lifetime ends
+        static void run(const std::shared_ptr<new_worker_state>& keepAlive) {
+#if RXCPP_USE_STALL_WATCHDOG
+            // show the actions of this thread to stall_watchdog
+            rxcpp::detail::watched_thread watched;
+#endif
+            // take ownership
+            queue::ensure(std::make_shared<new_worker>(keepAlive));
+            // release ownership
+            RXCPP_UNWIND_AUTO([]{
+                queue::destroy();
+            });
+
+            for(;;) {
+                if (!keepAlive->lifetime.is_subscribed()) {
+                    break;
+                }
+                schedulable what;
+                if (!keepAlive->next(what)) {
+                    keepAlive->idle();
+                    continue;
+                }
+                if (!what.is_subscribed()) {
+                    continue;
+                }
+                keepAlive->r.reset(keepAlive->all_idle());
+#if RXCPP_USE_SCHEDULER_METRICS
+                auto start = clock_type::now();
+                what(keepAlive->r.get_recurse());
+                keepAlive->counters.ran(clock_type::now() - start, keepAlive->r.get_recurse());
+#else
+                what(keepAlive->r.get_recurse());
+#endif
+            }
+        }
 
-            state->lifetime.add([keepAlive](){
+        static std::shared_ptr<new_worker_state> make_state(composite_subscription cs, const new_thread& nt) {
+            auto result = std::make_shared<new_worker_state>(cs, nt.strategy, nt.quota, nt.budget, nt.ready);
+            auto keepAlive = result;
+            result->lifetime.add([keepAlive](){
+                std::unique_lock<std::mutex> guard(keepAlive->lock);
                 keepAlive->wake.notify_one();
             });
+            return result;
+        }
 
-            state->worker = tf([keepAlive](){
-
-                // take ownership
-                queue::ensure(std::make_shared<new_worker>(keepAlive));
-                // release ownership
-                RXCPP_UNWIND_AUTO([]{
-                    queue::destroy();
-                });
-
-                for(;;) {
-                    std::unique_lock<std::mutex> guard(keepAlive->lock);
-                    if (keepAlive->queue.empty()) {
-                        keepAlive->wake.wait(guard, [keepAlive](){
-                            return !keepAlive->lifetime.is_subscribed() || !keepAlive->queue.empty();
-                        });
-                    }
-                    if (!keepAlive->lifetime.is_subscribed()) {
-                        break;
-                    }
-                    auto& peek = keepAlive->queue.top();
-                    if (!peek.what.is_subscribed()) {
-                        keepAlive->queue.pop();
-                        continue;
-                    }
-                    if (clock_type::now() < peek.when) {
-                        keepAlive->wake.wait_until(guard, peek.when);
-                        continue;
-                    }
-                    auto what = peek.what;
-                    keepAlive->queue.pop();
-                    keepAlive->r.reset(keepAlive->queue.empty());
-                    guard.unlock();
-                    what(keepAlive->r.get_recurse());
+        new_worker(composite_subscription cs, const new_thread& nt)
+        {
+            if (!nt.state_on_thread) {
+                state = make_state(cs, nt);
+                auto keepAlive = state;
+                std::function<void()> body = [keepAlive](){
+                    run(keepAlive);
+                };
+                if (!nt.cache || !nt.cache->run(body)) {
+                    state->worker = nt.factory(std::move(body));
                 }
-            });
+                return;
+            }
+            // the thread allocates the state, so that a first touch
+            // allocation policy places it on the node of that thread, and
+            // hands it back before it runs the items
+            auto created = std::make_shared<std::promise<std::shared_ptr<new_worker_state>>>();
+            auto published = created->get_future();
+            std::function<void()> body = [cs, &nt, created](){
+                std::shared_ptr<new_worker_state> keepAlive;
+                try {
+                    keepAlive = make_state(cs, nt);
+                } catch(...) {
+                    created->set_exception(std::current_exception());
+                    return;
+                }
+                created->set_value(keepAlive);
+                run(keepAlive);
+            };
+            std::thread worker;
+            if (!nt.cache || !nt.cache->run(body)) {
+                worker = nt.factory(std::move(body));
+            }
+            state = published.get();
+            if (worker.joinable()) {
+                std::unique_lock<std::mutex> guard(state->lock);
+                state->worker = std::move(worker);
+            }
         }
 
         virtual clock_type::time_point now() const {
             return clock_type::now();
         }
 
+#if RXCPP_USE_SCHEDULER_METRICS
+        virtual bool get_metrics(worker_metrics& m) const {
+            m = state->counters.snapshot();
+            std::unique_lock<std::mutex> guard(state->lock);
+            for (auto& l : state->lanes) {
+                auto counts = l.queue.count();
+                m.timed_live += counts.live;
+                m.timed_dead += counts.dead;
+            }
+            return true;
+        }
+#endif
+
         virtual void schedule(const schedulable& scbl) const {
-            schedule(now(), scbl);
+            if (scbl.is_subscribed()) {
+#if RXCPP_USE_SCHEDULER_METRICS
+                state->counters.enqueued();
+#endif
+                state->pushed_immediate();
+                state->lane_of(scbl).immediate.push(new_worker_state::item_type(now(), scbl));
+                state->r.reset(false);
+                // only pay for the lock and the notify when the worker
+                // thread is waiting
+                if (state->parked.load(std::memory_order_seq_cst)) {
+                    std::unique_lock<std::mutex> guard(state->lock);
+                    state->wake.notify_one();
+                }
+            }
+        }
+
+        virtual void schedule_batch(const schedulable* first, size_t count) const {
+            auto when = now();
+            bool pushed = false;
+            for (auto last = first + count; first != last; ++first) {
+                if (first->is_subscribed()) {
+#if RXCPP_USE_SCHEDULER_METRICS
+                    state->counters.enqueued();
+#endif
+                    state->pushed_immediate();
+                    state->lane_of(*first).immediate.push(new_worker_state::item_type(when, *first));
+                    pushed = true;
+                }
+            }
+            if (pushed) {
+                state->r.reset(false);
+                // one wake up for the whole batch
+                if (state->parked.load(std::memory_order_seq_cst)) {
+                    std::unique_lock<std::mutex> guard(state->lock);
+                    state->wake.notify_one();
+                }
+            }
         }
 
         virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
             if (scbl.is_subscribed()) {
                 std::unique_lock<std::mutex> guard(state->lock);
-                state->queue.push(new_worker_state::item_type(when, scbl));
+#if RXCPP_USE_SCHEDULER_METRICS
+                state->counters.enqueued();
+#endif
+                auto& l = state->lane_of(scbl);
+                auto dropped = l.queue.push(new_worker_state::item_type(when, scbl));
+#if RXCPP_USE_SCHEDULER_METRICS
+                state->counters.dropped(dropped);
+#else
+                (void)dropped;
+#endif
+                l.timed = true;
                 state->r.reset(false);
+                if (state->parked) {
+                    state->wake.notify_one();
+                }
             }
-            state->wake.notify_one();
         }
     };
 
     mutable thread_factory factory;
+    wait_strategy strategy;
+    int quota;
+    recursion_budget budget;
+    std::shared_ptr<thread_cache> cache;
+    std::shared_ptr<std::atomic<size_t>> ready;
+    bool state_on_thread;
 
 public:
     new_thread()
         : factory([](std::function<void()> start){
             return std::thread(std::move(start));
         })
+        , strategy(block)
+        , quota(default_priority_quota)
+        , state_on_thread(false)
     {
     }
     explicit new_thread(thread_factory tf)
         : factory(tf)
+        , strategy(block)
+        , quota(default_priority_quota)
+        , state_on_thread(false)
+    {
+    }
+    new_thread(thread_factory tf, wait_strategy ws)
+        : factory(tf)
+        , strategy(ws)
+        , quota(default_priority_quota)
+        , state_on_thread(false)
+    {
+    }
+    /// quota is the number of priority::high items that a worker runs in
+    /// a row while priority::normal items are waiting. it must be at least 1.
+    new_thread(thread_factory tf, wait_strategy ws, int quota)
+        : factory(tf)
+        , strategy(ws)
+        , quota(quota < 1 ? 1 : quota)
+        , state_on_thread(false)
+    {
+    }
+    /// budget limits how long an action may tail-recurse before it goes
+    /// back into the queue behind the other items of the worker.
+    new_thread(thread_factory tf, wait_strategy ws, int quota, recursion_budget budget)
+        : factory(tf)
+        , strategy(ws)
+        , quota(quota < 1 ? 1 : quota)
+        , budget(budget)
+        , state_on_thread(false)
+    {
+    }
+    /// runs the workers on the threads of cache. tf creates the thread of
+    /// a worker that is created while max_threads of the cache are running.
+    new_thread(thread_factory tf, wait_strategy ws, int quota, recursion_budget budget, thread_cache cache)
+        : factory(tf)
+        , strategy(ws)
+        , quota(quota < 1 ? 1 : quota)
+        , budget(budget)
+        , cache(std::make_shared<thread_cache>(std::move(cache)))
+        , state_on_thread(false)
     {
     }
     virtual ~new_thread()
@@ -159,8 +917,22 @@ public:
         return clock_type::now();
     }
 
+    /// the workers created after this call add the immediate items that
+    /// they have queued and not yet taken to count. event_loop uses it to
+    /// see the backlog of each loop. timed items are not counted.
+    void count_ready(std::shared_ptr<std::atomic<size_t>> count) {
+        ready = std::move(count);
+    }
+
+    /// the workers created after this call allocate their state on their
+    /// own thread, rather than on the thread that creates them. event_loop
+    /// uses it for numa_local.
+    void allocate_on_worker_thread() {
+        state_on_thread = true;
+    }
+
     virtual worker create_worker(composite_subscription cs) const {
-        return worker(cs, std::shared_ptr<new_worker>(new new_worker(cs, factory)));
+        return worker(cs, std::shared_ptr<new_worker>(new new_worker(cs, *this)));
     }
 };
 
@@ -171,6 +943,24 @@ inline scheduler make_new_thread() {
 inline scheduler make_new_thread(thread_factory tf) {
     return make_scheduler<new_thread>(tf);
 }
+inline scheduler make_new_thread(thread_factory tf, new_thread::wait_strategy ws) {
+    return make_scheduler<new_thread>(tf, ws);
+}
+inline scheduler make_new_thread(thread_factory tf, new_thread::wait_strategy ws, int quota) {
+    return make_scheduler<new_thread>(tf, ws, quota);
+}
+inline scheduler make_new_thread(thread_factory tf, new_thread::wait_strategy ws, int quota, recursion_budget budget) {
+    return make_scheduler<new_thread>(tf, ws, quota, budget);
+}
+inline scheduler make_new_thread(thread_factory tf, new_thread::wait_strategy ws, int quota, recursion_budget budget, thread_cache cache) {
+    return make_scheduler<new_thread>(tf, ws, quota, budget, std::move(cache));
+}
+/// new_thread on a shared thread_cache with the default config
+inline scheduler make_cached_new_thread() {
+    static thread_cache cache;
+    static auto nt = make_new_thread(cache.get_factory(), new_thread::block, new_thread::default_priority_quota, recursion_budget(), cache);
+    return nt;
+}
 
 }
 
@@ -0,0 +1,403 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_SCHEDULER_REACTOR_HPP)
+#define RXCPP_RX_SCHEDULER_REACTOR_HPP
+
+#include "../rx-includes.hpp"
+
+#if RXCPP_USE_EPOLL
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <system_error>
+
+namespace rxcpp {
+
+namespace schedulers {
+
+namespace detail {
+
+struct reactor_state
+{
+    typedef scheduler::clock_type clock_type;
+
+    typedef select_schedulable_queue<
+        clock_type::time_point>::type queue_item_time;
+
+    typedef queue_item_time::item_type item_type;
+
+    typedef std::function<void(uint32_t)> ready_type;
+    typedef std::function<void(std::exception_ptr)> error_type;
+
+    // one fd registration. only touched on the loop thread once it has
+    // been created.
+    struct watch_state
+    {
+        int fd;
+        uint32_t events;
+        uint64_t id;
+        ready_type ready;
+        error_type error;
+        composite_subscription lifetime;
+    };
+
+    reactor_state()
+        : epfd(-1)
+        , wakefd(-1)
+        , sleeping(false)
+        , next_id(0)
+    {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            throw std::system_error(errno, std::system_category(), "epoll_create1");
+        }
+        wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (wakefd < 0) {
+            auto e = errno;
+            close(epfd);
+            throw std::system_error(e, std::system_category(), "eventfd");
+        }
+        // id 0 is the wake up eventfd
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev) != 0) {
+            auto e = errno;
+            close(wakefd);
+            close(epfd);
+            throw std::system_error(e, std::system_category(), "epoll_ctl");
+        }
+    }
+    ~reactor_state()
+    {
+        close(wakefd);
+        close(epfd);
+    }
+
+    composite_subscription lifetime;
+    int epfd;
+    int wakefd;
+    mutable std::mutex lock;
+    mutable queue_item_time queue;
+    // set, with lock held, while the loop thread is in epoll_wait
+    bool sleeping;
+    recursion r;
+    std::thread worker;
+    // loop thread only
+    uint64_t next_id;
+    std::map<uint64_t, std::shared_ptr<watch_state>> watches;
+
+    void wake() const {
+        uint64_t one = 1;
+        auto written = write(wakefd, &one, sizeof(one));
+        (void)written;
+    }
+
+    void push(clock_type::time_point when, const schedulable& scbl) {
+        if (!scbl.is_subscribed()) {
+            return;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        queue.push(item_type(when, scbl));
+        r.reset(false);
+        // the loop thread only needs the eventfd when it is in epoll_wait
+        if (sleeping) {
+            sleeping = false;
+            wake();
+        }
+    }
+
+    // loop thread only
+    void add(const std::shared_ptr<watch_state>& w) {
+        if (!w->lifetime.is_subscribed()) {
+            return;
+        }
+        w->id = ++next_id;
+        epoll_event ev = {};
+        ev.events = w->events;
+        ev.data.u64 = w->id;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, w->fd, &ev) != 0) {
+            auto e = std::make_exception_ptr(std::system_error(errno, std::system_category(), "epoll_ctl"));
+            w->error(e);
+            return;
+        }
+        watches[w->id] = w;
+    }
+
+    // loop thread only
+    void remove(const std::shared_ptr<watch_state>& w) {
+        auto it = watches.find(w->id);
+        if (it == watches.end()) {
+            return;
+        }
+        epoll_ctl(epfd, EPOLL_CTL_DEL, w->fd, nullptr);
+        watches.erase(it);
+    }
+
+    // loop thread only. runs the actions that are due, up to max_batch so
+    // that ready fds are not starved. returns the epoll_wait timeout.
+    int run_due() {
+        static const int max_batch = 64;
+        for (int ran = 0;; ++ran) {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!queue.empty() && !queue.top().what.is_subscribed()) {
+                queue.pop();
+            }
+            if (queue.empty()) {
+                sleeping = true;
+                return -1;
+            }
+            auto now = clock_type::now();
+            auto& peek = queue.top();
+            if (peek.when > now) {
+                sleeping = true;
+                // round up so that the loop does not wake before the item is due
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(peek.when - now) + std::chrono::milliseconds(1);
+                return static_cast<int>((std::min<long long>)(wait.count(), (std::numeric_limits<int>::max)()));
+            }
+            if (ran == max_batch) {
+                return 0;
+            }
+            auto what = peek.what;
+            queue.pop();
+            r.reset(queue.empty());
+            guard.unlock();
+            what(r.get_recurse());
+        }
+    }
+
+    // loop thread only
+    void run() {
+        static const int max_events = 64;
+        epoll_event events[max_events];
+        while (lifetime.is_subscribed()) {
+            auto timeout = run_due();
+            if (!lifetime.is_subscribed()) {
+                break;
+            }
+            auto count = epoll_wait(epfd, events, max_events, timeout);
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                sleeping = false;
+            }
+            for (int i = 0; i < count; ++i) {
+                auto id = events[i].data.u64;
+                if (id == 0) {
+                    uint64_t value;
+                    auto got = read(wakefd, &value, sizeof(value));
+                    (void)got;
+                    continue;
+                }
+                // a handler earlier in this batch may have removed the watch
+                auto it = watches.find(id);
+                if (it == watches.end()) {
+                    continue;
+                }
+                auto w = it->second;
+                if (w->lifetime.is_subscribed()) {
+                    w->ready(events[i].events);
+                }
+            }
+        }
+        auto remaining = std::move(watches);
+        watches.clear();
+        for (auto& w : remaining) {
+            w.second->lifetime.unsubscribe();
+        }
+    }
+};
+
+}
+
+/// reactor runs an epoll loop on one thread. the same thread runs the
+/// actions scheduled on get_scheduler(), so one thread serves many fds and
+/// the actions that consume them without any hand off.
+///
+/// watch() registers an fd. the callback runs on the loop thread each time
+/// epoll reports the fd ready. the fd is level triggered unless EPOLLET is
+/// in the events. rxcpp::sources::from_fd() wraps this in an observable.
+///
+/// the loop thread stops when the last copy of the reactor is destroyed.
+class reactor
+{
+public:
+    typedef scheduler::clock_type clock_type;
+
+private:
+    typedef detail::reactor_state state_type;
+
+    struct reactor_worker : public worker_interface
+    {
+    private:
+        typedef reactor_worker this_type;
+        reactor_worker(const this_type&);
+
+        std::shared_ptr<state_type> state;
+
+    public:
+        virtual ~reactor_worker()
+        {
+        }
+
+        explicit reactor_worker(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual void schedule(const schedulable& scbl) const {
+            state->push(now(), scbl);
+        }
+
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            state->push(when, scbl);
+        }
+    };
+
+    struct reactor_scheduler : public scheduler_interface
+    {
+    private:
+        typedef reactor_scheduler this_type;
+        reactor_scheduler(const this_type&);
+
+        std::shared_ptr<state_type> state;
+
+    public:
+        virtual ~reactor_scheduler()
+        {
+        }
+
+        explicit reactor_scheduler(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual worker create_worker(composite_subscription cs) const {
+            return worker(std::move(cs), std::make_shared<reactor_worker>(state));
+        }
+    };
+
+    // stops the loop thread when the last reactor copy is gone. workers
+    // only hold the state, so they do not keep the thread alive.
+    struct owner
+    {
+        std::shared_ptr<state_type> state;
+
+        explicit owner(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+        ~owner()
+        {
+            {
+                std::unique_lock<std::mutex> guard(state->lock);
+                state->lifetime.unsubscribe();
+                state->wake();
+            }
+            if (state->worker.get_id() != std::this_thread::get_id()) {
+                state->worker.join();
+            } else {
+                state->worker.detach();
+            }
+            std::unique_lock<std::mutex> guard(state->lock);
+            while (!state->queue.empty()) {
+                state->queue.pop();
+            }
+        }
+    };
+
+    std::shared_ptr<owner> loop;
+    scheduler sc;
+
+    void start(thread_factory& tf) {
+        auto state = loop->state;
+        state->worker = tf([state](){
+#if RXCPP_USE_STALL_WATCHDOG
+            // show the actions of this thread to stall_watchdog
+            rxcpp::detail::watched_thread watched;
+#endif
+            // take ownership
+            detail::action_queue::ensure(std::make_shared<reactor_worker>(state));
+            // release ownership
+            RXCPP_UNWIND_AUTO([]{
+                detail::action_queue::destroy();
+            });
+            state->run();
+        });
+    }
+
+public:
+    reactor()
+        : loop(std::make_shared<owner>(std::make_shared<state_type>()))
+        , sc(make_scheduler<reactor_scheduler>(loop->state))
+    {
+        thread_factory tf = [](std::function<void()> start){
+            return std::thread(std::move(start));
+        };
+        start(tf);
+    }
+    explicit reactor(thread_factory tf)
+        : loop(std::make_shared<owner>(std::make_shared<state_type>()))
+        , sc(make_scheduler<reactor_scheduler>(loop->state))
+    {
+        start(tf);
+    }
+
+    /// the scheduler that runs actions on the loop thread
+    scheduler get_scheduler() const {
+        return sc;
+    }
+
+    /// call ready with the epoll events each time fd is ready for events.
+    /// error is called if the fd cannot be added to the epoll set.
+    /// both are called on the loop thread. unsubscribe the result to stop
+    /// watching. the fd is not closed.
+    composite_subscription watch(int fd, uint32_t events, state_type::ready_type ready, state_type::error_type error) const {
+        auto w = std::make_shared<state_type::watch_state>();
+        w->fd = fd;
+        w->events = events;
+        w->id = 0;
+        w->ready = std::move(ready);
+        w->error = std::move(error);
+        auto state = loop->state;
+        auto controller = sc.create_worker();
+        controller.schedule([state, w](const schedulable&){
+            state->add(w);
+        });
+        w->lifetime.add([state, w, controller](){
+            controller.schedule([state, w](const schedulable&){
+                state->remove(w);
+            });
+        });
+        return w->lifetime;
+    }
+};
+
+inline scheduler make_reactor(const reactor& r) {
+    return r.get_scheduler();
+}
+
+/// the reactor shared by from_fd and observe_on_reactor when none is given
+inline const reactor& default_reactor() {
+    static reactor r;
+    return r;
+}
+
+}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,251 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_SCHEDULER_RUN_LOOP_HPP)
+#define RXCPP_RX_SCHEDULER_RUN_LOOP_HPP
+
+#include "../rx-includes.hpp"
+
+namespace rxcpp {
+
+namespace schedulers {
+
+namespace detail {
+
+struct run_loop_state
+{
+    typedef scheduler::clock_type clock_type;
+
+    typedef select_schedulable_queue<
+        clock_type::time_point>::type queue_item_time;
+
+    typedef queue_item_time::item_type item_type;
+
+    run_loop_state()
+    {
+    }
+
+    composite_subscription lifetime;
+    mutable std::mutex lock;
+    mutable queue_item_time queue;
+    recursion r;
+    std::function<void(clock_type::time_point)> notify_earlier_wakeup;
+
+    // the time of the first subscribed item. called with lock held.
+    clock_type::time_point due() const {
+        while (!queue.empty() && !queue.top().what.is_subscribed()) {
+            queue.pop();
+        }
+        return queue.empty() ? (clock_type::time_point::max)() : queue.top().when;
+    }
+
+    void push(clock_type::time_point when, const schedulable& scbl) {
+        if (!lifetime.is_subscribed() || !scbl.is_subscribed()) {
+            return;
+        }
+        std::function<void(clock_type::time_point)> notify;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (when < due()) {
+                notify = notify_earlier_wakeup;
+            }
+            queue.push(item_type(when, scbl));
+            r.reset(false);
+        }
+        // outside the lock so that the host may call back into the loop
+        if (notify) {
+            notify(when);
+        }
+    }
+};
+
+}
+
+/// run_loop is a queue of scheduled actions that is drained by the thread
+/// that owns it, for a host that already has a main loop, such as a game
+/// frame or a gui message pump.
+///
+/// any thread may schedule on the scheduler from get_scheduler(). nothing
+/// runs until the host calls dispatch_one() or dispatch_until(). the host
+/// uses next_due_time() to decide how long it may sleep, and may set a
+/// callback that is told when an item is scheduled ahead of that time.
+///
+/// the run_loop also takes over current_thread on the thread that creates
+/// it, unless current_thread is already active there, so that work for
+/// current_thread on that thread is queued on the run_loop instead of
+/// being run inside schedule(). it must be destroyed on that thread.
+class run_loop
+{
+public:
+    typedef scheduler::clock_type clock_type;
+
+private:
+    typedef run_loop this_type;
+    run_loop(const this_type&);
+    run_loop& operator=(const this_type&);
+
+    typedef detail::run_loop_state state_type;
+
+    struct run_loop_worker : public worker_interface
+    {
+    private:
+        typedef run_loop_worker this_type;
+        run_loop_worker(const this_type&);
+
+        std::shared_ptr<state_type> state;
+
+    public:
+        virtual ~run_loop_worker()
+        {
+        }
+
+        explicit run_loop_worker(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual void schedule(const schedulable& scbl) const {
+            state->push(now(), scbl);
+        }
+
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            state->push(when, scbl);
+        }
+    };
+
+    struct run_loop_scheduler : public scheduler_interface
+    {
+    private:
+        typedef run_loop_scheduler this_type;
+        run_loop_scheduler(const this_type&);
+
+        std::shared_ptr<state_type> state;
+
+    public:
+        virtual ~run_loop_scheduler()
+        {
+        }
+
+        explicit run_loop_scheduler(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual worker create_worker(composite_subscription cs) const {
+            return worker(std::move(cs), std::make_shared<run_loop_worker>(state));
+        }
+    };
+
+    std::shared_ptr<state_type> state;
+    scheduler sc;
+    bool owner;
+
+    // runs the first queued action if it is due. it may tail-recurse for up
+    // to limit while nothing else is queued. zero does not allow it.
+    bool dispatch(clock_type::duration limit) const {
+        std::unique_lock<std::mutex> guard(state->lock);
+        if (state->due() > clock_type::now()) {
+            return false;
+        }
+        auto what = state->queue.top().what;
+        state->queue.pop();
+        state->r.set_budget(recursion_budget(0, limit));
+        state->r.reset(limit != clock_type::duration::zero() && state->queue.empty());
+        guard.unlock();
+        if (what.is_subscribed()) {
+            what(state->r.get_recurse());
+        }
+        return true;
+    }
+
+public:
+    run_loop()
+        : state(std::make_shared<state_type>())
+        , sc(make_scheduler<run_loop_scheduler>(state))
+        , owner(!detail::action_queue::owned())
+    {
+        if (owner) {
+            // current_thread on this thread now schedules on the run_loop
+            detail::action_queue::ensure(std::make_shared<run_loop_worker>(state));
+        }
+    }
+    ~run_loop()
+    {
+        state->lifetime.unsubscribe();
+
+        std::unique_lock<std::mutex> guard(state->lock);
+        while (!state->queue.empty()) {
+            state->queue.pop();
+        }
+        guard.unlock();
+
+        if (owner) {
+            detail::action_queue::destroy();
+        }
+    }
+
+    /// the scheduler that queues actions on this run_loop
+    scheduler get_scheduler() const {
+        return sc;
+    }
+
+    /// true when there is nothing queued
+    bool empty() const {
+        std::unique_lock<std::mutex> guard(state->lock);
+        return state->due() == (clock_type::time_point::max)();
+    }
+
+    /// the time that the first queued action is due, time_point::max()
+    /// when there is nothing queued
+    clock_type::time_point next_due_time() const {
+        std::unique_lock<std::mutex> guard(state->lock);
+        return state->due();
+    }
+
+    /// run the first queued action if it is due. returns false when nothing
+    /// was due. an action that asks to recurse is queued again, so each
+    /// call runs one step of it. only the thread that owns the loop should
+    /// call this.
+    bool dispatch_one() const {
+        return dispatch(clock_type::duration::zero());
+    }
+
+    /// run the actions that are due until none are left or the deadline
+    /// has passed. never sleeps. returns the number of actions that ran.
+    /// an action may tail-recurse in place while nothing else is queued,
+    /// but only until the deadline.
+    size_t dispatch_until(clock_type::time_point deadline) const {
+        size_t count = 0;
+        for (auto now = clock_type::now(); now < deadline && dispatch(deadline - now); now = clock_type::now()) {
+            ++count;
+        }
+        return count;
+    }
+
+    /// f is called, from the thread that scheduled, when an action is
+    /// queued ahead of the previous next_due_time(). a host that sleeps
+    /// until next_due_time() uses this to wake up early.
+    void set_notify_earlier_wakeup(std::function<void(clock_type::time_point)> f) {
+        std::unique_lock<std::mutex> guard(state->lock);
+        state->notify_earlier_wakeup = std::move(f);
+    }
+};
+
+inline scheduler make_run_loop(const run_loop& r) {
+    return r.get_scheduler();
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,422 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_SCHEDULER_SHARDED_HPP)
+#define RXCPP_RX_SCHEDULER_SHARDED_HPP
+
+#include "../rx-includes.hpp"
+
+namespace rxcpp {
+
+namespace schedulers {
+
+namespace detail {
+
+struct shard_state
+{
+    typedef scheduler::clock_type clock_type;
+
+    typedef select_schedulable_queue<
+        clock_type::time_point>::type queue_item_time;
+
+    typedef queue_item_time::item_type item_type;
+
+    shard_state(size_t i, const recursion_budget& budget)
+        : index(i)
+        , parked(false)
+    {
+        r.set_budget(budget);
+    }
+
+    size_t index;
+    composite_subscription lifetime;
+    std::thread thread;
+
+    // shard thread only, so there are no locks or atomics on this path
+    std::deque<schedulable> local;
+    queue_item_time timed;
+    recursion r;
+
+    // from other threads
+    mpsc_queue<item_type> inbox;
+    // guards parking
+    std::mutex lock;
+    std::condition_variable wake;
+    // set while the shard thread is waiting on wake
+    std::atomic<bool> parked;
+
+    // the shard that the calling thread runs, if any
+    static shard_state*& current() {
+        static RXCPP_THREAD_LOCAL shard_state* s;
+        return s;
+    }
+
+    void push(clock_type::time_point when, const schedulable& scbl, bool timed_item) {
+        if (current() == this) {
+            if (timed_item) {
+                timed.push(item_type(when, scbl));
+            } else {
+                local.push_back(scbl);
+                // the running action yields to it at its next recursion
+                r.reset(false);
+            }
+            return;
+        }
+        inbox.push(item_type(when, scbl));
+        if (parked.load(std::memory_order_seq_cst)) {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.notify_one();
+        }
+    }
+
+    // shard thread only. moves what other threads sent and the timed items
+    // that are due onto the local queue.
+    void collect() {
+        auto now = clock_type::now();
+        while (auto next = inbox.front()) {
+            if (next->when <= now) {
+                local.push_back(std::move(next->what));
+            } else {
+                timed.push(std::move(*next));
+            }
+            inbox.pop();
+        }
+        while (!timed.empty() && timed.top().when <= now) {
+            local.push_back(timed.top().what);
+            timed.pop();
+        }
+    }
+
+    // shard thread only. wait until something may be runnable.
+    void park() {
+        std::unique_lock<std::mutex> guard(lock);
+        parked.store(true, std::memory_order_seq_cst);
+        RXCPP_UNWIND_AUTO([&](){parked.store(false, std::memory_order_relaxed);});
+        // a producer that pushed before parked was set is seen here.
+        // a producer that pushes after will see parked and notify.
+        if (!lifetime.is_subscribed() || !inbox.idle()) {
+            return;
+        }
+        if (timed.empty()) {
+            wake.wait(guard);
+        } else {
+            wake.wait_until(guard, timed.top().when);
+        }
+    }
+
+    // shard thread only
+    void run() {
+        current() = this;
+        RXCPP_UNWIND_AUTO([](){current() = nullptr;});
+        while (lifetime.is_subscribed()) {
+            collect();
+            if (local.empty()) {
+                park();
+                continue;
+            }
+            // run what is queued now. what these schedule runs next round,
+            // after the inbox has been collected again.
+            for (auto n = local.size(); n != 0; --n) {
+                auto what = std::move(local.front());
+                local.pop_front();
+                if (!what.is_subscribed()) {
+                    continue;
+                }
+                r.reset(local.empty() && inbox.idle());
+                what(r.get_recurse());
+            }
+        }
+        local.clear();
+        while (!timed.empty()) {
+            timed.pop();
+        }
+        // release what was sent before the stop, so that an action that
+        // will never run is destroyed
+        while (inbox.front()) {
+            inbox.pop();
+        }
+    }
+};
+
+}
+
+/// shards runs one thread per shard, each pinned to its own cpu, and the
+/// shards share nothing.
+///
+/// an action scheduled from the thread of its shard goes onto a queue that
+/// only that thread touches, with no lock and no atomic. an action
+/// scheduled from any other thread goes through the lock-free inbox of the
+/// shard, so a message from one shard to another costs one exchange.
+/// current_thread on a shard thread uses the queue of the shard.
+///
+/// shard_local<T> keeps one T per shard, such as a subject, created on
+/// that shard. subjects::channel<T> passes values from any thread to
+/// subscribers on one shard. with RXCPP_USE_OBJECT_POOL each shard thread
+/// also gets its own block cache.
+///
+/// the threads stop when the last copy of the shards is destroyed.
+class shards
+{
+public:
+    typedef scheduler::clock_type clock_type;
+
+    static const size_t default_budget_items = 1024;
+
+    /// config sets up the shard threads
+    struct config
+    {
+        config()
+            : shard_count(std::max(std::thread::hardware_concurrency(), unsigned(1)))
+            , pin(true)
+            , budget(default_budget_items, clock_type::duration::zero())
+        {
+        }
+        /// the number of shards
+        size_t shard_count;
+        /// shard i is pinned to cpus[i % cpus.size()], or to cpu i when
+        /// cpus is empty
+        std::vector<int> cpus;
+        /// false leaves the shard threads unpinned
+        bool pin;
+        /// how long one action may tail-recurse before the shard collects
+        /// what other threads sent. the other thread cannot stop the
+        /// recursion itself, so by default this is 1024 items.
+        recursion_budget budget;
+        /// used to create each shard thread. empty means std::thread.
+        thread_factory factory;
+    };
+
+private:
+    typedef detail::shard_state state_type;
+
+    struct shard_worker : public worker_interface
+    {
+    private:
+        typedef shard_worker this_type;
+        shard_worker(const this_type&);
+
+        std::shared_ptr<state_type> state;
+
+    public:
+        virtual ~shard_worker()
+        {
+        }
+
+        explicit shard_worker(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual void schedule(const schedulable& scbl) const {
+            state->push(now(), scbl, false);
+        }
+
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            state->push(when, scbl, true);
+        }
+    };
+
+    struct shard_scheduler : public scheduler_interface
+    {
+    private:
+        typedef shard_scheduler this_type;
+        shard_scheduler(const this_type&);
+
+        std::shared_ptr<state_type> state;
+
+    public:
+        virtual ~shard_scheduler()
+        {
+        }
+
+        explicit shard_scheduler(std::shared_ptr<state_type> s)
+            : state(std::move(s))
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual worker create_worker(composite_subscription cs) const {
+            return worker(std::move(cs), std::make_shared<shard_worker>(state));
+        }
+    };
+
+    // stops the threads when the last copy is gone. workers only hold the
+    // state of their shard, so they do not keep the threads alive.
+    struct owner
+    {
+        std::vector<std::shared_ptr<state_type>> states;
+
+        ~owner()
+        {
+            for (auto& s : states) {
+                std::unique_lock<std::mutex> guard(s->lock);
+                s->lifetime.unsubscribe();
+                s->wake.notify_one();
+            }
+            for (auto& s : states) {
+                if (s->thread.get_id() != std::this_thread::get_id()) {
+                    s->thread.join();
+                } else {
+                    s->thread.detach();
+                }
+            }
+        }
+    };
+
+    std::shared_ptr<owner> group;
+    std::vector<scheduler> schedulers;
+
+    void start(const config& c) {
+        auto count = (std::max)(c.shard_count, size_t(1));
+        thread_factory tf = c.factory;
+        if (!tf) {
+            tf = [](std::function<void()> start){
+                return std::thread(std::move(start));
+            };
+        }
+        for (size_t i = 0; i != count; ++i) {
+            auto state = std::make_shared<state_type>(i, c.budget);
+            group->states.push_back(state);
+            schedulers.push_back(make_scheduler<shard_scheduler>(state));
+            std::vector<int> cpus;
+            if (c.pin) {
+                cpus.push_back(c.cpus.empty() ? static_cast<int>(i) : c.cpus[i % c.cpus.size()]);
+            }
+            state->thread = tf([state, cpus](){
+#if RXCPP_USE_STALL_WATCHDOG
+                // show the actions of this thread to stall_watchdog
+                rxcpp::detail::watched_thread watched;
+#endif
+                // a shard with no cpu of its own still runs, unpinned
+                detail::set_current_thread_affinity(cpus);
+                // take ownership
+                detail::action_queue::ensure(std::make_shared<shard_worker>(state));
+                // release ownership
+                RXCPP_UNWIND_AUTO([]{
+                    detail::action_queue::destroy();
+                });
+                state->run();
+            });
+        }
+    }
+
+public:
+    shards()
+        : group(std::make_shared<owner>())
+    {
+        start(config());
+    }
+    explicit shards(const config& c)
+        : group(std::make_shared<owner>())
+    {
+        start(c);
+    }
+
+    /// the number of shards
+    size_t size() const {
+        return schedulers.size();
+    }
+
+    /// the scheduler whose workers run on shard i
+    scheduler get_scheduler(size_t i) const {
+        return schedulers[i % schedulers.size()];
+    }
+
+    /// the shard that the calling thread runs, or size() when the caller is
+    /// not one of these shard threads
+    size_t this_shard() const {
+        auto current = state_type::current();
+        if (current && current->index < group->states.size() && group->states[current->index].get() == current) {
+            return current->index;
+        }
+        return size();
+    }
+};
+
+inline scheduler make_shard(const shards& s, size_t i) {
+    return s.get_scheduler(i);
+}
+
+/// shard_local keeps one T for each shard. each T is created on the thread
+/// of its shard, and should only be used from there.
+///
+/// the constructor waits until every shard has created its T, so it must
+/// not be called from a shard thread, where the wait could deadlock with
+/// a shard that is waiting the same way. it aborts when it is. when an
+/// action that creates a T is dropped without running, or the factory
+/// throws, the constructor throws.
+template<class T>
+class shard_local
+{
+    shards group;
+    std::shared_ptr<std::vector<std::unique_ptr<T>>> slots;
+
+public:
+    template<class Factory>
+    shard_local(shards s, Factory factory)
+        : group(std::move(s))
+        , slots(std::make_shared<std::vector<std::unique_ptr<T>>>(group.size()))
+    {
+        if (detail::shard_state::current()) {
+            abort();
+        }
+        std::vector<std::future<void>> created;
+        std::vector<worker> workers;
+        for (size_t i = 0; i != group.size(); ++i) {
+            auto slot = &(*slots)[i];
+            auto factory_ptr = &factory;
+            // only the action owns the promise, so it is broken when the
+            // action is destroyed without running
+            auto done = std::make_shared<std::promise<void>>();
+            created.push_back(done->get_future());
+            workers.push_back(group.get_scheduler(i).create_worker());
+            workers.back().schedule([slot, factory_ptr, done](const schedulable&){
+                try {
+                    slot->reset(new T((*factory_ptr)()));
+                    done->set_value();
+                } catch(...) {
+                    done->set_exception(std::current_exception());
+                }
+            });
+        }
+        // the actions use factory, so all of them must be done before an
+        // error leaves the constructor
+        for (auto& f : created) {
+            f.wait();
+        }
+        for (auto& w : workers) {
+            w.unsubscribe();
+        }
+        for (auto& f : created) {
+            f.get();
+        }
+    }
+
+    /// the T of shard i
+    T& at(size_t i) const {
+        return *(*slots)[i];
+    }
+
+    /// the T of the calling shard thread
+    T& local() const {
+        auto i = group.this_shard();
+        if (i == group.size()) {
+            abort();
+        }
+        return at(i);
+    }
+};
+
+}
+
+}
+
+#endif
@@ -82,6 +82,14 @@ public:
             state->schedule_relative(state->to_relative(when - now()), scbl);
         }
 
+        virtual void schedule_batch(const schedulable* first, size_t count) const {
+            // the whole batch is due at the same virtual time
+            auto when = state->clock();
+            for (auto last = first + count; first != last; ++first) {
+                state->schedule_absolute(when, *first);
+            }
+        }
+
         void schedule_absolute(absolute when, const schedulable& scbl) const {
             state->schedule_absolute(when, scbl);
         }
@@ -0,0 +1,488 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_SCHEDULER_TIMING_WHEEL_HPP)
+#define RXCPP_RX_SCHEDULER_TIMING_WHEEL_HPP
+
+#include "../rx-includes.hpp"
+
+// the default tick of a timing_wheel_queue over a clock, in microseconds
+#if !defined(RXCPP_TIMING_WHEEL_TICK_US)
+#define RXCPP_TIMING_WHEEL_TICK_US 1000
+#endif
+
+namespace rxcpp {
+
+namespace schedulers {
+
+namespace detail {
+
+/// maps the time points of a queue onto the ticks of a timing wheel.
+/// the ticks only need to be monotonic in the time point.
+template<class TimePoint, class Enable = void>
+struct timing_wheel_traits;
+
+template<class TimePoint>
+struct timing_wheel_traits<TimePoint, typename std::enable_if<std::is_integral<TimePoint>::value>::type>
+{
+    typedef TimePoint resolution_type;
+
+    static resolution_type default_resolution() {
+        return 1;
+    }
+    static int64_t ticks(TimePoint when, resolution_type resolution) {
+        return static_cast<int64_t>(when / resolution);
+    }
+};
+
+template<class Clock, class Duration>
+struct timing_wheel_traits<std::chrono::time_point<Clock, Duration>>
+{
+    typedef Duration resolution_type;
+
+    static resolution_type default_resolution() {
+        return std::max(
+            std::chrono::duration_cast<resolution_type>(std::chrono::microseconds(RXCPP_TIMING_WHEEL_TICK_US)),
+            resolution_type(1));
+    }
+    static int64_t ticks(std::chrono::time_point<Clock, Duration> when, resolution_type resolution) {
+        return static_cast<int64_t>(when.time_since_epoch() / resolution);
+    }
+};
+
+/// timing_wheel_queue is a drop-in replacement for schedulable_queue.
+///
+/// items are hashed by tick into a hierarchy of 4 wheels of 64 slots,
+/// 2^24 ticks in all, with an overflow list for anything further out.
+/// push links the item into its slot in O(1). the wheels are only
+/// cascaded when top or pop need the next item, and only the items that
+/// share the earliest tick are ordered, on the same when then fifo order
+/// as schedulable_queue.
+///
+/// items that are unsubscribed while they wait are dropped the next
+/// time their slot is cascaded, instead of staying in the queue until
+/// they reach the top. so cancel is the O(1) unsubscribe, and the memory
+/// is reclaimed at the latest by the time the item would have become due.
+/// push also compacts each time the queue doubles, as schedulable_queue
+/// does, so that long timeouts do not pile up while they wait.
+///
+/// the tick resolution only changes how many items share a slot. it does
+/// not change the order in which items are returned.
+template<class TimePoint>
+class timing_wheel_queue {
+public:
+    typedef time_schedulable<TimePoint> item_type;
+    typedef const item_type& const_reference;
+    typedef timing_wheel_traits<TimePoint> traits;
+    typedef typename traits::resolution_type resolution_type;
+
+private:
+    timing_wheel_queue(const timing_wheel_queue&);
+    timing_wheel_queue& operator=(const timing_wheel_queue&);
+
+    static const int slot_bits = 6;
+    static const int slot_count = 1 << slot_bits;
+    static const int level_count = 4;
+
+    struct node
+    {
+        typename std::aligned_storage<sizeof(item_type), alignof(item_type)>::type storage;
+        int64_t ordinal;
+        int64_t tick;
+        node* next;
+
+        item_type& item() {
+            return *reinterpret_cast<item_type*>(&storage);
+        }
+    };
+
+    struct level
+    {
+        uint64_t occupied;
+        node* slots[slot_count];
+    };
+
+    struct compare_node
+    {
+        bool operator()(node* lhs, node* rhs) const {
+            if (lhs->item().when == rhs->item().when) {
+                return lhs->ordinal > rhs->ordinal;
+            }
+            else {
+                return lhs->item().when > rhs->item().when;
+            }
+        }
+    };
+
+    // a heap on compare_node, so that compact() and count() can see it all
+    typedef std::vector<node*> ready_type;
+
+    // a block of nodes. the nodes follow the header in the same allocation.
+    struct chunk
+    {
+        chunk* next;
+        size_t count;
+        typename std::aligned_storage<sizeof(node), alignof(node)>::type align;
+    };
+
+    // nodes held in the queue itself, so that the few items of a short
+    // lived queue do not allocate
+    static const size_t local_count = 4;
+    static const size_t chunk_min = 16;
+    static const size_t chunk_max = 1024;
+    // the smallest queue that push compacts
+    static const size_t compact_min = 64;
+
+    resolution_type resolution;
+    int64_t ordinal;
+    // the tick of the first item pushed. the wheels index ticks after it.
+    int64_t origin;
+    bool started;
+    // every item in the wheels is after cursor, every ready item is at
+    // or before it.
+    mutable uint64_t cursor;
+    mutable size_t pending;
+    size_t compact_at;
+    mutable ready_type ready;
+    mutable std::unique_ptr<level[]> levels;
+    mutable std::vector<node*> overflow;
+    mutable node* free;
+    chunk* chunks;
+    typename std::aligned_storage<sizeof(node) * local_count, alignof(node)>::type local;
+
+    static int lowest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(bits);
+#else
+        int result = 0;
+        while (!(bits & 1)) {
+            bits >>= 1;
+            ++result;
+        }
+        return result;
+#endif
+    }
+
+    static int highest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(bits);
+#else
+        int result = 0;
+        while (bits >>= 1) {
+            ++result;
+        }
+        return result;
+#endif
+    }
+
+    node* allocate() {
+        if (!free) {
+            // the chunks double from 16 nodes
+            size_t count = chunks ? chunks->count * 2 : chunk_min;
+            count = count > chunk_max ? chunk_max : count;
+            auto c = static_cast<chunk*>(::operator new(sizeof(chunk) + sizeof(node) * count));
+            c->next = chunks;
+            c->count = count;
+            chunks = c;
+            auto nodes = reinterpret_cast<node*>(c + 1);
+            for (size_t i = 0; i != count; ++i) {
+                nodes[i].next = free;
+                free = &nodes[i];
+            }
+        }
+        auto result = free;
+        free = free->next;
+        return result;
+    }
+
+    void release(node* n) const {
+        n->item().~item_type();
+        n->next = free;
+        free = n;
+    }
+
+    // the tick of n relative to origin, or 0 when it is before origin
+    uint64_t offset(node* n) const {
+        return n->tick > origin ? static_cast<uint64_t>(n->tick - origin) : 0;
+    }
+
+    void place(node* n) const {
+        auto at = offset(n);
+        if (at <= cursor) {
+            ready.push_back(n);
+            std::push_heap(ready.begin(), ready.end(), compare_node());
+            return;
+        }
+        ++pending;
+        auto diff = at ^ cursor;
+        if (diff >> (slot_bits * level_count)) {
+            overflow.push_back(n);
+            return;
+        }
+        if (!levels) {
+            levels.reset(new level[level_count]());
+        }
+        auto l = highest_bit(diff) / slot_bits;
+        auto s = (at >> (slot_bits * l)) & (slot_count - 1);
+        auto& wheel = levels[l];
+        n->next = wheel.slots[s];
+        wheel.slots[s] = n;
+        wheel.occupied |= uint64_t(1) << s;
+    }
+
+    // re-place a list of items against the current cursor, dropping any
+    // that were unsubscribed while they waited
+    void cascade(node* n) const {
+        while (n) {
+            auto next = n->next;
+            --pending;
+            if (n->item().what.is_subscribed()) {
+                place(n);
+            } else {
+                release(n);
+            }
+            n = next;
+        }
+    }
+
+    node* pop_ready() const {
+        std::pop_heap(ready.begin(), ready.end(), compare_node());
+        auto n = ready.back();
+        ready.pop_back();
+        return n;
+    }
+
+    static bool is_dead(node* n) {
+        return !n->item().what.is_subscribed();
+    }
+
+    // move the cursor forward until there is a subscribed item at the top
+    // or nothing is left
+    void settle() const {
+        for (;;) {
+            while (!ready.empty() && !ready.front()->item().what.is_subscribed()) {
+                release(pop_ready());
+            }
+            if (!ready.empty() || pending == 0) {
+                break;
+            }
+            bool found = false;
+            for (int l = 0; levels && l != level_count && !found; ++l) {
+                auto shift = slot_bits * l;
+                auto digit = (cursor >> shift) & (slot_count - 1);
+                auto& wheel = levels[l];
+                auto later = digit == slot_count - 1 ? 0 : wheel.occupied & (~uint64_t(0) << (digit + 1));
+                if (!later) {
+                    continue;
+                }
+                found = true;
+                auto s = static_cast<uint64_t>(lowest_bit(later));
+                // the slot starts the next span of this level
+                auto span = shift + slot_bits;
+                cursor = (span < 64 ? (cursor >> span) << span : 0) | (s << shift);
+                auto list = wheel.slots[s];
+                wheel.slots[s] = nullptr;
+                wheel.occupied &= ~(uint64_t(1) << s);
+                cascade(list);
+            }
+            if (!found && !overflow.empty()) {
+                // the wheels are empty, jump to the earliest overflow item
+                std::vector<node*> far;
+                far.swap(overflow);
+                uint64_t earliest = std::numeric_limits<uint64_t>::max();
+                for (auto n : far) {
+                    earliest = std::min(earliest, offset(n));
+                }
+                cursor = earliest;
+                node* list = nullptr;
+                for (auto n : far) {
+                    n->next = list;
+                    list = n;
+                }
+                cascade(list);
+            }
+        }
+    }
+
+public:
+    timing_wheel_queue()
+        : resolution(traits::default_resolution())
+        , ordinal(0)
+        , origin(0)
+        , started(false)
+        , cursor(0)
+        , pending(0)
+        , compact_at(compact_min)
+        , free(nullptr)
+        , chunks(nullptr)
+    {
+        auto nodes = reinterpret_cast<node*>(&local);
+        for (size_t i = 0; i != local_count; ++i) {
+            nodes[i].next = free;
+            free = &nodes[i];
+        }
+    }
+
+    /// resolution is the span of time that shares one slot
+    explicit timing_wheel_queue(resolution_type resolution)
+        : resolution(resolution)
+        , ordinal(0)
+        , origin(0)
+        , started(false)
+        , cursor(0)
+        , pending(0)
+        , compact_at(compact_min)
+        , free(nullptr)
+        , chunks(nullptr)
+    {
+        auto nodes = reinterpret_cast<node*>(&local);
+        for (size_t i = 0; i != local_count; ++i) {
+            nodes[i].next = free;
+            free = &nodes[i];
+        }
+    }
+
+    ~timing_wheel_queue() {
+        for (auto n : ready) {
+            n->item().~item_type();
+        }
+        for (auto n : overflow) {
+            n->item().~item_type();
+        }
+        for (int l = 0; levels && l != level_count; ++l) {
+            for (auto n : levels[l].slots) {
+                for (; n; n = n->next) {
+                    n->item().~item_type();
+                }
+            }
+        }
+        while (chunks) {
+            auto next = chunks->next;
+            ::operator delete(chunks);
+            chunks = next;
+        }
+    }
+
+    const_reference top() const {
+        settle();
+        return ready.front()->item();
+    }
+
+    void pop() {
+        settle();
+        release(pop_ready());
+    }
+
+    /// unsubscribed items are dropped rather than returned
+    bool empty() const {
+        settle();
+        return ready.empty();
+    }
+
+    /// the number of items in the queue, including unsubscribed items
+    /// that have not been dropped yet
+    size_t size() const {
+        return ready.size() + pending;
+    }
+
+    /// drop the unsubscribed items now rather than when their slots are
+    /// cascaded. returns the number dropped.
+    size_t compact() {
+        auto drop = [this](std::vector<node*>& nodes) -> size_t {
+            auto live = std::partition(nodes.begin(), nodes.end(), [](node* n){return !is_dead(n);});
+            for (auto it = live; it != nodes.end(); ++it) {
+                release(*it);
+            }
+            auto removed = static_cast<size_t>(nodes.end() - live);
+            nodes.erase(live, nodes.end());
+            return removed;
+        };
+        auto dropped = drop(ready);
+        std::make_heap(ready.begin(), ready.end(), compare_node());
+        auto far = drop(overflow);
+        pending -= far;
+        dropped += far;
+        for (int l = 0; levels && l != level_count; ++l) {
+            auto& wheel = levels[l];
+            for (int s = 0; s != slot_count; ++s) {
+                for (node** link = &wheel.slots[s]; *link;) {
+                    auto n = *link;
+                    if (is_dead(n)) {
+                        *link = n->next;
+                        release(n);
+                        --pending;
+                        ++dropped;
+                    } else {
+                        link = &n->next;
+                    }
+                }
+                if (!wheel.slots[s]) {
+                    wheel.occupied &= ~(uint64_t(1) << s);
+                }
+            }
+        }
+        return dropped;
+    }
+
+    /// counts the live and dead items. O(n).
+    queue_counts count() const {
+        queue_counts result = {0, 0};
+        auto add = [&](node* n){
+            ++(is_dead(n) ? result.dead : result.live);
+        };
+        std::for_each(ready.begin(), ready.end(), add);
+        std::for_each(overflow.begin(), overflow.end(), add);
+        for (int l = 0; levels && l != level_count; ++l) {
+            for (auto n : levels[l].slots) {
+                for (; n; n = n->next) {
+                    add(n);
+                }
+            }
+        }
+        return result;
+    }
+
+    /// returns the number of unsubscribed items that the push dropped.
+    size_t push(const item_type& value) {
+        return push(item_type(value));
+    }
+
+    size_t push(item_type&& value) {
+        auto n = allocate();
+        new (&n->storage) item_type(std::move(value));
+        n->ordinal = ordinal++;
+        n->tick = traits::ticks(n->item().when, resolution);
+        if (!started) {
+            started = true;
+            origin = n->tick;
+        }
+        place(n);
+        size_t dropped = 0;
+        if (size() >= compact_at) {
+            dropped = compact();
+            compact_at = (std::max)(size() * 2, size_t(compact_min));
+        }
+        return dropped;
+    }
+};
+
+/// the queue used for timed schedulables by new_thread, current_thread and
+/// virtual_time. timing_wheel_queue when RXCPP_USE_TIMING_WHEEL is set.
+template<class TimePoint>
+struct select_schedulable_queue
+{
+#if RXCPP_USE_TIMING_WHEEL
+    typedef timing_wheel_queue<TimePoint> type;
+#else
+    typedef schedulable_queue<TimePoint> type;
+#endif
+};
+
+}
+
+}
+
+}
+
+#endif
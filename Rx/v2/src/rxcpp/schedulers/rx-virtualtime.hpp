@@ -170,8 +170,8 @@ struct virtual_time : public detail::virtual_time_base<Absolute, Relative>
 
     typedef typename base::item_type item_type;
 
-    typedef detail::schedulable_queue<
-        typename item_type::time_point_type> queue_item_time;
+    typedef typename detail::select_schedulable_queue<
+        typename item_type::time_point_type>::type queue_item_time;
 
     mutable queue_item_time queue;
 
@@ -204,14 +204,18 @@ protected:
 
     virtual void schedule_absolute(typename base::absolute when, const schedulable& a) const
     {
-        // use a separate subscription here so that a's subscription is not affected
+        // use a separate subscription here so that a's subscription is not affected.
+        // it ends with a, so that the queue can drop a cancelled a before it is due.
+        composite_subscription cs;
+        auto held = a.get_subscription().add(cs);
         auto run = make_schedulable(
             a.get_worker(),
-            composite_subscription(),
-            [a](const schedulable& scbl) {
+            cs,
+            [a, held](const schedulable& scbl) {
                 rxsc::recursion r;
                 r.reset(false);
                 if (scbl.is_subscribed()) {
+                    a.get_subscription().remove(held);
                     scbl.unsubscribe(); // unsubscribe() run, not a;
                     a(r.get_recurse());
                 }
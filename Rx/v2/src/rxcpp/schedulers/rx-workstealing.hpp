@@ -0,0 +1,642 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_SCHEDULER_WORK_STEALING_HPP)
+#define RXCPP_RX_SCHEDULER_WORK_STEALING_HPP
+
+#include "../rx-includes.hpp"
+
+namespace rxcpp {
+
+namespace schedulers {
+
+namespace detail {
+
+/// chase_lev_deque is the work-stealing deque of Chase and Lev using the
+/// memory orders from "Correct and Efficient Work-Stealing for Weak Memory
+/// Models" (Le, Pop, Cohen, Zappa Nardelli). the owning thread pushes and
+/// pops at the bottom, any other thread may steal from the top.
+template<class T>
+class chase_lev_deque
+{
+    typedef chase_lev_deque<T> this_type;
+    chase_lev_deque(const this_type&);
+
+    struct ring
+    {
+        explicit ring(int64_t c)
+            : capacity(c)
+            , items(new std::atomic<T>[c])
+        {
+        }
+        T get(int64_t i) const {
+            return items[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        void put(int64_t i, T v) {
+            items[i & (capacity - 1)].store(v, std::memory_order_relaxed);
+        }
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::atomic<ring*> array;
+    // a thief may still be reading a ring that has been replaced, so
+    // the rings are only released with the deque.
+    std::vector<std::unique_ptr<ring>> rings;
+
+    ring* grow(ring* a, int64_t b, int64_t t) {
+        rings.emplace_back(new ring(a->capacity * 2));
+        auto r = rings.back().get();
+        for (auto i = t; i != b; ++i) {
+            r->put(i, a->get(i));
+        }
+        array.store(r, std::memory_order_release);
+        return r;
+    }
+
+public:
+    chase_lev_deque()
+        : top(0)
+        , bottom(0)
+    {
+        rings.emplace_back(new ring(64));
+        array.store(rings.back().get(), std::memory_order_relaxed);
+    }
+
+    /// owner only
+    void push(T v) {
+        auto b = bottom.load(std::memory_order_relaxed);
+        auto t = top.load(std::memory_order_acquire);
+        auto a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
+        }
+        a->put(b, v);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /// owner only
+    bool pop(T& out) {
+        auto b = bottom.load(std::memory_order_relaxed) - 1;
+        auto a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        out = a->get(b);
+        if (t == b) {
+            // last item - race the thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    /// any thread. fails when empty or when another thread won the race.
+    bool steal(T& out) {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        auto a = array.load(std::memory_order_acquire);
+        out = a->get(t);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    /// any thread. only a hint when other threads are pushing or stealing.
+    bool empty() const {
+        return bottom.load(std::memory_order_acquire) <= top.load(std::memory_order_acquire);
+    }
+};
+
+}
+
+/// work_stealing runs workers on a fixed pool of threads.
+///
+/// each worker is a strand with its own time ordered queue, so the actions
+/// scheduled on one worker run in-order with no overlap. a strand that has
+/// actions ready is pushed onto the deque of the pool thread that made it
+/// ready (or onto a shared queue when made ready off the pool). idle pool
+/// threads steal ready strands from the other deques, so a hot pipeline
+/// does not hold back the workers that were created next to it.
+struct work_stealing : public scheduler_interface
+{
+private:
+    typedef work_stealing this_type;
+    work_stealing(const this_type&);
+
+    struct pool_state;
+    struct thread_state;
+
+    struct strand : public worker_interface
+    {
+    private:
+        typedef strand this_type;
+        strand(const this_type&);
+
+        typedef detail::schedulable_queue<
+            typename clock_type::time_point> queue_item_time;
+
+        typedef queue_item_time::item_type item_type;
+
+        enum {
+            // actions run before a busy strand goes to the back of the line
+            max_batch = 64
+        };
+
+        std::shared_ptr<pool_state> pool;
+        mutable std::mutex lock;
+        mutable queue_item_time queue;
+        // true while the strand is on a deque or running
+        mutable bool queued;
+        // keeps the strand alive while it is queued
+        mutable std::shared_ptr<const strand> self;
+        recursion r;
+
+        std::shared_ptr<const strand> shared_this() const {
+            return std::static_pointer_cast<const strand>(shared_from_this());
+        }
+
+    public:
+        explicit strand(std::shared_ptr<pool_state> p)
+            : pool(std::move(p))
+            , queued(false)
+        {
+        }
+        virtual ~strand()
+        {
+        }
+
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+
+        virtual void schedule(const schedulable& scbl) const {
+            schedule(now(), scbl);
+        }
+
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            if (!scbl.is_subscribed()) {
+                return;
+            }
+            bool ready = false;
+            bool timed = false;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                queue.push(item_type(when, scbl));
+                r.reset(false);
+                if (!queued) {
+                    if (when <= now()) {
+                        queued = true;
+                        self = shared_this();
+                        ready = true;
+                    } else {
+                        timed = true;
+                    }
+                }
+            }
+            if (ready) {
+                pool->submit(this);
+            } else if (timed) {
+                pool->arm(when, shared_this());
+            }
+        }
+
+        /// called by the timer when an item may have come due
+        void make_ready() const {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if (queued || queue.empty() || now() < queue.top().when) {
+                    return;
+                }
+                queued = true;
+                self = shared_this();
+            }
+            pool->submit(this);
+        }
+
+        /// called when the worker is unsubscribed
+        void clear() const {
+            queue_item_time dead;
+            std::unique_lock<std::mutex> guard(lock);
+            std::swap(dead, queue);
+            guard.unlock();
+        }
+
+        /// called when the pool stops with this strand still queued
+        void abandon() const {
+            queue_item_time dead;
+            std::shared_ptr<const strand> keepAlive;
+            std::unique_lock<std::mutex> guard(lock);
+            std::swap(dead, queue);
+            queued = false;
+            keepAlive = std::move(self);
+            guard.unlock();
+        }
+
+        /// called on a pool thread
+        void run() const {
+            std::shared_ptr<const strand> keepAlive;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                keepAlive = self;
+            }
+            for (int n = 0; n < max_batch; ++n) {
+                std::unique_lock<std::mutex> guard(lock);
+                if (queue.empty()) {
+                    break;
+                }
+                auto& peek = queue.top();
+                if (!peek.what.is_subscribed()) {
+                    queue.pop();
+                    continue;
+                }
+                if (now() < peek.when) {
+                    break;
+                }
+                auto what = peek.what;
+                queue.pop();
+                r.reset(queue.empty());
+                guard.unlock();
+                what(r.get_recurse());
+            }
+
+            std::unique_lock<std::mutex> guard(lock);
+            while (!queue.empty() && !queue.top().what.is_subscribed()) {
+                queue.pop();
+            }
+            if (!queue.empty() && queue.top().when <= now()) {
+                guard.unlock();
+                // still busy - let the other ready strands run first
+                pool->requeue(this);
+                return;
+            }
+            queued = false;
+            self.reset();
+            bool timed = !queue.empty();
+            auto next = timed ? queue.top().when : clock_type::time_point();
+            guard.unlock();
+            if (timed) {
+                pool->arm(next, keepAlive);
+            }
+        }
+    };
+
+    /// forwards current_thread schedules made by an action to the strand
+    /// that is running the action, the same way that new_thread does.
+    struct running_strand : public worker_interface
+    {
+        explicit running_strand(thread_state* ts)
+            : ts(ts)
+        {
+        }
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
+        virtual void schedule(const schedulable& scbl) const {
+            schedule(now(), scbl);
+        }
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            if (!ts->running) {
+                abort();
+            }
+            ts->running->schedule(when, scbl);
+        }
+        thread_state* ts;
+    };
+
+    struct thread_state
+    {
+        thread_state(pool_state* p, size_t i)
+            : pool(p)
+            , index(i)
+            , running(nullptr)
+        {
+        }
+        pool_state* pool;
+        size_t index;
+        const strand* running;
+        detail::chase_lev_deque<const strand*> deque;
+    };
+
+    struct timer_item
+    {
+        timer_item(clock_type::time_point when, std::weak_ptr<const strand> what)
+            : when(when)
+            , what(std::move(what))
+        {
+        }
+        bool operator<(const timer_item& o) const {
+            return when > o.when;
+        }
+        clock_type::time_point when;
+        std::weak_ptr<const strand> what;
+    };
+
+    struct pool_state : public std::enable_shared_from_this<pool_state>
+    {
+        typedef detail::action_queue queue;
+
+        static thread_state*& current() {
+            static RXCPP_THREAD_LOCAL thread_state* ts;
+            return ts;
+        }
+
+        std::vector<std::unique_ptr<thread_state>> threads;
+        std::vector<std::thread> workers;
+        std::atomic<bool> stopping;
+
+        // strands made ready off the pool and busy strands that finished a batch
+        std::mutex shared_lock;
+        std::deque<const strand*> shared;
+
+        // pool threads with nothing to run wait here
+        std::mutex sleep_lock;
+        std::condition_variable sleep_wake;
+        std::atomic<int> sleepers;
+
+        std::mutex timer_lock;
+        std::condition_variable timer_wake;
+        std::priority_queue<timer_item> timers;
+        std::thread timer;
+
+        explicit pool_state(size_t count)
+            : stopping(false)
+            , sleepers(0)
+        {
+            for (size_t i = 0; i != count; ++i) {
+                threads.emplace_back(new thread_state(this, i));
+            }
+        }
+
+        void start(thread_factory& tf) {
+            // a pool thread that is detached by stop() still needs the state
+            auto keepAlive = shared_from_this();
+            for (auto& ts : threads) {
+                auto t = ts.get();
+                workers.push_back(tf([keepAlive, t](){
+#if RXCPP_USE_STALL_WATCHDOG
+                    // show the actions of this thread to stall_watchdog
+                    rxcpp::detail::watched_thread watched;
+#endif
+                    current() = t;
+                    // current_thread schedules from an action go to its strand
+                    queue::ensure(std::make_shared<running_strand>(t));
+                    RXCPP_UNWIND_AUTO([]{
+                        queue::destroy();
+                        current() = nullptr;
+                    });
+                    keepAlive->work(*t);
+                }));
+            }
+            timer = tf([keepAlive](){
+                keepAlive->tick();
+            });
+        }
+
+        void stop() {
+            {
+                std::unique_lock<std::mutex> guard(sleep_lock);
+                stopping = true;
+                sleep_wake.notify_all();
+            }
+            {
+                std::unique_lock<std::mutex> guard(timer_lock);
+                timer_wake.notify_all();
+            }
+            auto finish = [](std::thread& t){
+                if (t.joinable()) {
+                    if (t.get_id() != std::this_thread::get_id()) {
+                        t.join();
+                    } else {
+                        t.detach();
+                    }
+                }
+            };
+            for (auto& t : workers) {
+                finish(t);
+            }
+            finish(timer);
+            // release the strands that were still queued
+            const strand* s = nullptr;
+            for (auto& ts : threads) {
+                while (ts->deque.steal(s)) {
+                    s->abandon();
+                }
+            }
+            std::deque<const strand*> remaining;
+            {
+                std::unique_lock<std::mutex> guard(shared_lock);
+                std::swap(remaining, shared);
+            }
+            for (auto s : remaining) {
+                s->abandon();
+            }
+        }
+
+        void wake_one() {
+            // pairs with the fence in work() so that either this thread
+            // sees the sleeper or the sleeper sees the new strand
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_relaxed) > 0) {
+                std::unique_lock<std::mutex> guard(sleep_lock);
+                sleep_wake.notify_one();
+            }
+        }
+
+        void push_shared(const strand* s) {
+            {
+                std::unique_lock<std::mutex> guard(shared_lock);
+                shared.push_back(s);
+            }
+            wake_one();
+        }
+
+        void submit(const strand* s) {
+            if (stopping) {
+                s->abandon();
+                return;
+            }
+            auto ts = current();
+            if (ts && ts->pool == this) {
+                ts->deque.push(s);
+                wake_one();
+                return;
+            }
+            push_shared(s);
+        }
+
+        void requeue(const strand* s) {
+            if (stopping) {
+                s->abandon();
+                return;
+            }
+            push_shared(s);
+        }
+
+        void arm(clock_type::time_point when, std::weak_ptr<const strand> s) {
+            std::unique_lock<std::mutex> guard(timer_lock);
+            bool first = timers.empty() || when < timers.top().when;
+            timers.push(timer_item(when, std::move(s)));
+            if (first) {
+                timer_wake.notify_one();
+            }
+        }
+
+        bool find(thread_state& ts, const strand*& s) {
+            if (ts.deque.pop(s)) {
+                return true;
+            }
+            {
+                std::unique_lock<std::mutex> guard(shared_lock);
+                if (!shared.empty()) {
+                    s = shared.front();
+                    shared.pop_front();
+                    return true;
+                }
+            }
+            auto count = threads.size();
+            for (size_t i = 1; i != count; ++i) {
+                auto& victim = *threads[(ts.index + i) % count];
+                if (victim.deque.steal(s)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool has_work() {
+            {
+                std::unique_lock<std::mutex> guard(shared_lock);
+                if (!shared.empty()) {
+                    return true;
+                }
+            }
+            for (auto& ts : threads) {
+                if (!ts->deque.empty()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(thread_state& ts) {
+            const strand* s = nullptr;
+            for (;;) {
+                bool found = find(ts, s);
+                for (int spin = 0; !found && spin < 64 && !stopping; ++spin) {
+                    std::this_thread::yield();
+                    found = find(ts, s);
+                }
+                if (!found) {
+                    std::unique_lock<std::mutex> guard(sleep_lock);
+                    if (stopping) {
+                        break;
+                    }
+                    sleepers.fetch_add(1);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (!has_work()) {
+                        sleep_wake.wait(guard);
+                    }
+                    sleepers.fetch_sub(1);
+                    continue;
+                }
+                ts.running = s;
+                s->run();
+                ts.running = nullptr;
+            }
+        }
+
+        void tick() {
+            std::unique_lock<std::mutex> guard(timer_lock);
+            while (!stopping) {
+                if (timers.empty()) {
+                    timer_wake.wait(guard);
+                    continue;
+                }
+                auto when = timers.top().when;
+                if (clock_type::now() < when) {
+                    timer_wake.wait_until(guard, when);
+                    continue;
+                }
+                auto s = timers.top().what.lock();
+                timers.pop();
+                guard.unlock();
+                if (s) {
+                    s->make_ready();
+                }
+                s.reset();
+                guard.lock();
+            }
+        }
+    };
+
+    mutable thread_factory factory;
+    std::shared_ptr<pool_state> state;
+
+    static size_t default_count() {
+        return std::max(std::thread::hardware_concurrency(), unsigned(4));
+    }
+
+public:
+    work_stealing()
+        : factory([](std::function<void()> start){
+            return std::thread(std::move(start));
+        })
+        , state(std::make_shared<pool_state>(default_count()))
+    {
+        state->start(factory);
+    }
+    explicit work_stealing(thread_factory tf, size_t count = default_count())
+        : factory(tf)
+        , state(std::make_shared<pool_state>(std::max(count, size_t(1))))
+    {
+        state->start(factory);
+    }
+    virtual ~work_stealing()
+    {
+        state->stop();
+    }
+
+    virtual clock_type::time_point now() const {
+        return clock_type::now();
+    }
+
+    virtual worker create_worker(composite_subscription cs) const {
+        auto s = std::make_shared<strand>(state);
+        std::weak_ptr<strand> weak = s;
+        cs.add([weak](){
+            if (auto s = weak.lock()) {
+                s->clear();
+            }
+        });
+        return worker(std::move(cs), s);
+    }
+};
+
+inline scheduler make_work_stealing() {
+    static auto ws = make_scheduler<work_stealing>();
+    return ws;
+}
+inline scheduler make_work_stealing(thread_factory tf) {
+    return make_scheduler<work_stealing>(tf);
+}
+inline scheduler make_work_stealing(thread_factory tf, size_t count) {
+    return make_scheduler<work_stealing>(tf, count);
+}
+
+}
+
+}
+
+#endif
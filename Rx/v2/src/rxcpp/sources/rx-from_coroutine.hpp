@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_SOURCES_RX_FROM_COROUTINE_HPP)
+#define RXCPP_SOURCES_RX_FROM_COROUTINE_HPP
+
+#include "../rx-includes.hpp"
+
+#if RXCPP_USE_COROUTINES
+
+namespace rxcpp {
+
+namespace sources {
+
+namespace detail {
+
+template<class T, class Factory, class Coordination>
+struct from_coroutine : public source_base<T>
+{
+    typedef typename std::decay<Coordination>::type coordination_type;
+
+    Factory factory;
+    coordination_type coordination;
+
+    from_coroutine(Factory f, coordination_type cn)
+        : factory(std::move(f))
+        , coordination(std::move(cn))
+    {
+    }
+
+    template<class Subscriber>
+    void on_subscribe(Subscriber o) const {
+        static_assert(is_subscriber<Subscriber>::value, "subscribe must be passed a subscriber");
+
+        // creates a worker whose lifetime is the same as this subscription
+        auto coordinator = coordination.create_coordinator(o.get_subscription());
+
+        auto controller = coordinator.get_worker();
+
+        std::optional<async_generator<T>> generator;
+        try {
+            generator.emplace(factory());
+        } catch(...) {
+            o.on_error(std::current_exception());
+            return;
+        }
+        generator->start(o.as_dynamic(), std::move(controller));
+    }
+};
+
+}
+
+/// an observable that calls factory for each subscription and runs the
+/// async_generator that it returns on a worker from the coordination.
+template<class Factory>
+auto from_coroutine(Factory f)
+    ->      observable<typename std::invoke_result<Factory&>::type::value_type, detail::from_coroutine<typename std::invoke_result<Factory&>::type::value_type, Factory, identity_one_worker>> {
+    typedef typename std::invoke_result<Factory&>::type::value_type value_type;
+    return  observable<value_type, detail::from_coroutine<value_type, Factory, identity_one_worker>>(
+                                   detail::from_coroutine<value_type, Factory, identity_one_worker>(std::move(f), identity_current_thread()));
+}
+template<class Factory, class Coordination>
+auto from_coroutine(Factory f, Coordination cn)
+    ->      observable<typename std::invoke_result<Factory&>::type::value_type, detail::from_coroutine<typename std::invoke_result<Factory&>::type::value_type, Factory, Coordination>> {
+    typedef typename std::invoke_result<Factory&>::type::value_type value_type;
+    return  observable<value_type, detail::from_coroutine<value_type, Factory, Coordination>>(
+                                   detail::from_coroutine<value_type, Factory, Coordination>(std::move(f), std::move(cn)));
+}
+
+}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_SOURCES_RX_FROM_FD_HPP)
+#define RXCPP_SOURCES_RX_FROM_FD_HPP
+
+#include "../rx-includes.hpp"
+
+#if RXCPP_USE_EPOLL
+
+namespace rxcpp {
+
+namespace sources {
+
+namespace detail {
+
+template<class T>
+struct from_fd : public source_base<T>
+{
+    int fd;
+    uint32_t events;
+    rxsc::reactor loop;
+
+    from_fd(int fd, uint32_t events, rxsc::reactor r)
+        : fd(fd)
+        , events(events)
+        , loop(std::move(r))
+    {
+    }
+
+    template<class Subscriber>
+    void on_subscribe(Subscriber o) const {
+        static_assert(is_subscriber<Subscriber>::value, "subscribe must be passed a subscriber");
+
+        auto watch = loop.watch(fd, events,
+            [o](uint32_t ready){
+                o.on_next(T(ready));
+            },
+            [o](std::exception_ptr e){
+                o.on_error(e);
+            });
+        o.add(watch);
+    }
+};
+
+}
+
+/// emits the epoll events each time fd is ready for events, on the loop
+/// thread of the reactor. the fd is level triggered unless EPOLLET is in
+/// the events, so the subscriber should read or write until it would block
+/// before it returns. the fd is not closed when the subscription ends.
+template<class T = uint32_t>
+auto from_fd(int fd, uint32_t events, rxsc::reactor r)
+    ->      observable<T, detail::from_fd<T>> {
+    return  observable<T, detail::from_fd<T>>(detail::from_fd<T>(fd, events, std::move(r)));
+}
+
+template<class T = uint32_t>
+auto from_fd(int fd, uint32_t events)
+    ->      observable<T, detail::from_fd<T>> {
+    return  observable<T, detail::from_fd<T>>(detail::from_fd<T>(fd, events, rxsc::default_reactor()));
+}
+
+}
+
+}
+
+#endif
+
+#endif
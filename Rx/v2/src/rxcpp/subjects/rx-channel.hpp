@@ -0,0 +1,171 @@
+// Copyright (c) Microsoft Open Technologies, Inc. All rights reserved. See License.txt in the project root for license information.
+
+#pragma once
+
+#if !defined(RXCPP_RX_CHANNEL_HPP)
+#define RXCPP_RX_CHANNEL_HPP
+
+#include "../rx-includes.hpp"
+
+namespace rxcpp {
+
+namespace subjects {
+
+namespace detail {
+
+template<class T>
+class channel_state : public std::enable_shared_from_this<channel_state<T>>
+{
+    typedef channel_state<T> this_type;
+    channel_state(const this_type&);
+
+    // a value, or the end of the stream when value is empty
+    struct message_type
+    {
+        rxu::detail::maybe<T> value;
+        std::exception_ptr error;
+    };
+
+    // destination only
+    void deliver(message_type& m) {
+        if (done) {
+            return;
+        }
+        if (!m.value.empty()) {
+            auto subscribed = std::remove_if(observers.begin(), observers.end(), [](const subscriber<T>& o){
+                return !o.is_subscribed();
+            });
+            observers.erase(subscribed, observers.end());
+            for (auto& o : observers) {
+                o.on_next(m.value.get());
+            }
+            return;
+        }
+        done = true;
+        error = m.error;
+        auto last = std::move(observers);
+        observers.clear();
+        for (auto& o : last) {
+            if (error) {
+                o.on_error(error);
+            } else {
+                o.on_completed();
+            }
+        }
+    }
+
+    // destination only
+    void drain() {
+        // an exchange, so that the pushes of a sender that saw true are
+        // visible below
+        scheduled.exchange(false);
+        while (auto m = queue.front()) {
+            deliver(*m);
+            queue.pop();
+        }
+    }
+
+public:
+    explicit channel_state(rxsc::worker w)
+        : destination(std::move(w))
+        , scheduled(false)
+        , done(false)
+    {
+    }
+
+    rxsc::worker destination;
+    rxsc::detail::mpsc_queue<message_type> queue;
+    // set while a drain is queued on the destination
+    std::atomic<bool> scheduled;
+    // destination only
+    std::vector<subscriber<T>> observers;
+    bool done;
+    std::exception_ptr error;
+
+    // any thread
+    void send(rxu::detail::maybe<T> value, std::exception_ptr e) {
+        message_type m = {std::move(value), e};
+        queue.push(std::move(m));
+        if (!scheduled.exchange(true)) {
+            auto self = this->shared_from_this();
+            destination.schedule([self](const rxsc::schedulable&){
+                self->drain();
+            });
+        }
+    }
+
+    // destination only
+    void add(subscriber<T> o) {
+        if (done) {
+            if (error) {
+                o.on_error(error);
+            } else {
+                o.on_completed();
+            }
+            return;
+        }
+        observers.push_back(std::move(o));
+    }
+};
+
+}
+
+/// channel passes values from any thread to the subscribers of one
+/// destination, such as a shard from rxcpp::schedulers::shards.
+///
+/// senders push onto a lock-free queue and the first send after a drain
+/// schedules the next drain on the destination worker. the subscribers
+/// are kept and called on the destination, so delivery takes no lock.
+/// like a subject, values sent before a subscriber has been added on the
+/// destination are not replayed to it.
+template<class T>
+class channel
+{
+    typedef detail::channel_state<T> state_type;
+
+    composite_subscription lifetime;
+    std::shared_ptr<state_type> state;
+
+public:
+    explicit channel(rxsc::scheduler destination)
+        : state(std::make_shared<state_type>(destination.create_worker()))
+    {
+    }
+    channel(rxsc::scheduler destination, composite_subscription cs)
+        : lifetime(std::move(cs))
+        , state(std::make_shared<state_type>(destination.create_worker()))
+    {
+    }
+
+    /// the sending end. it may be used from any thread, but the calls must
+    /// not overlap, as for any subscriber.
+    subscriber<T> get_subscriber() const {
+        auto s = state;
+        return make_subscriber<T>(lifetime,
+            [s](T v){
+                s->send(rxu::detail::maybe<T>(std::move(v)), std::exception_ptr());
+            },
+            [s](std::exception_ptr e){
+                s->send(rxu::detail::maybe<T>(), e);
+            },
+            [s](){
+                s->send(rxu::detail::maybe<T>(), std::exception_ptr());
+            }).as_dynamic();
+    }
+
+    /// the receiving end. subscribers are called on the destination.
+    observable<T> get_observable() const {
+        auto s = state;
+        return make_observable_dynamic<T>([s](subscriber<T> o){
+            s->destination.schedule([s, o](const rxsc::schedulable&){
+                s->add(o);
+            });
+        });
+    }
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#if !defined(RXCPP_TEST_COUNTDOWN_HPP)
+#define RXCPP_TEST_COUNTDOWN_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace {
+
+// blocks until done() has been called as many times as the count that it
+// was constructed with
+class countdown
+{
+    std::mutex lock;
+    std::condition_variable wake;
+    int remaining;
+public:
+    explicit countdown(int count) : remaining(count) {}
+    void done() {
+        std::unique_lock<std::mutex> guard(lock);
+        if (--remaining == 0) {
+            wake.notify_all();
+        }
+    }
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [this](){return remaining == 0;});
+    }
+    bool wait_for(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> guard(lock);
+        return wake.wait_for(guard, timeout, [this](){return remaining == 0;});
+    }
+};
+
+}
+
+#endif
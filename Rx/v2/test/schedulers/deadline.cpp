@@ -0,0 +1,229 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+// keeps the only thread of a pool busy until release is set, so that the
+// actions scheduled meanwhile are all queued when it returns
+std::promise<void> hold(const rxsc::worker& w) {
+    std::promise<void> release;
+    auto gate = release.get_future().share();
+    countdown started(1);
+    w.schedule([&started, gate](const rxsc::schedulable&){
+        started.done();
+        gate.wait();
+    });
+    started.wait();
+    return release;
+}
+
+}
+
+SCENARIO("deadline_pool runs the earliest deadline first", "[deadline][scheduler]"){
+    GIVEN("a deadline_pool with one thread"){
+        rxsc::deadline_pool pool(1);
+        auto sc = pool.get_scheduler(std::chrono::seconds(1));
+        auto blocker = sc.create_worker();
+        WHEN("actions with explicit deadlines are queued out of order"){
+            auto release = hold(blocker);
+            std::vector<int> order;
+            countdown finished(4);
+            std::vector<rxsc::worker> workers;
+            auto start = sc.now();
+            for (int i : {3, 1, 0, 2}) {
+                workers.push_back(sc.create_worker());
+                auto scbl = rxsc::make_schedulable(workers.back(), [&, i](const rxsc::schedulable&){
+                    order.push_back(i);
+                    finished.done();
+                });
+                scbl.set_deadline(start + std::chrono::milliseconds(100 * (i + 1)));
+                workers.back().schedule(scbl);
+            }
+            release.set_value();
+            finished.wait();
+            THEN("they ran in deadline order"){
+                REQUIRE(order == std::vector<int>({0, 1, 2, 3}));
+            }
+            for (auto& w : workers) {
+                w.unsubscribe();
+            }
+        }
+        WHEN("actions are queued on schedulers with different budgets"){
+            auto release = hold(blocker);
+            auto slow = pool.get_scheduler(std::chrono::seconds(10)).create_worker();
+            auto fast = pool.get_scheduler(std::chrono::milliseconds(10)).create_worker();
+            std::vector<std::string> order;
+            countdown finished(2);
+            slow.schedule([&](const rxsc::schedulable&){
+                order.push_back("slow");
+                finished.done();
+            });
+            fast.schedule([&](const rxsc::schedulable&){
+                order.push_back("fast");
+                finished.done();
+            });
+            release.set_value();
+            finished.wait();
+            THEN("the tighter budget ran first"){
+                REQUIRE(order == std::vector<std::string>({"fast", "slow"}));
+            }
+            slow.unsubscribe();
+            fast.unsubscribe();
+        }
+        WHEN("a timed action is scheduled"){
+            auto w = sc.create_worker();
+            countdown finished(1);
+            auto start = w.now();
+            rxsc::scheduler::clock_type::time_point ran;
+            w.schedule(start + std::chrono::milliseconds(20), [&](const rxsc::schedulable&){
+                ran = w.now();
+                finished.done();
+            });
+            finished.wait();
+            THEN("it did not run before it was due"){
+                REQUIRE(ran >= start + std::chrono::milliseconds(20));
+            }
+            w.unsubscribe();
+        }
+        WHEN("timed actions are cancelled long before they are due"){
+            auto held = std::make_shared<int>(0);
+            auto later = sc.now() + std::chrono::hours(1);
+            for (int i = 0; i < 200; ++i) {
+                auto w = sc.create_worker();
+                w.schedule(later, [held](const rxsc::schedulable&){});
+                w.unsubscribe();
+            }
+            THEN("the pool let go of most of them before they were due"){
+                REQUIRE(held.use_count() < 100);
+            }
+        }
+        WHEN("current_thread is used in an action"){
+            auto w = sc.create_worker();
+            std::vector<int> order;
+            countdown finished(1);
+            w.schedule([&](const rxsc::schedulable&){
+                rxsc::make_current_thread().create_worker().schedule([&](const rxsc::schedulable&){
+                    order.push_back(2);
+                    finished.done();
+                });
+                order.push_back(1);
+            });
+            finished.wait();
+            THEN("it queued onto the worker instead of running inline"){
+                REQUIRE(order == std::vector<int>({1, 2}));
+            }
+            w.unsubscribe();
+        }
+        blocker.unsubscribe();
+    }
+}
+
+SCENARIO("deadline_pool keeps the actions of a worker in order", "[deadline][scheduler]"){
+    GIVEN("a deadline_pool with 4 threads"){
+        rxsc::deadline_pool pool(4);
+        auto w = pool.get_scheduler(std::chrono::milliseconds(1)).create_worker();
+        WHEN("actions with falling deadlines are scheduled on one worker"){
+            const int count = 200;
+            std::vector<int> order;
+            std::atomic<int> active(0);
+            bool overlapped = false;
+            countdown finished(count);
+            auto start = w.now();
+            for (int i = 0; i < count; ++i) {
+                auto scbl = rxsc::make_schedulable(w, [&, i](const rxsc::schedulable&){
+                    if (++active != 1) {
+                        overlapped = true;
+                    }
+                    order.push_back(i);
+                    --active;
+                    finished.done();
+                });
+                scbl.set_deadline(start + std::chrono::milliseconds(count - i));
+                w.schedule(scbl);
+            }
+            finished.wait();
+            THEN("they ran in the order they were scheduled, one at a time"){
+                std::vector<int> expected;
+                for (int i = 0; i < count; ++i) {
+                    expected.push_back(i);
+                }
+                REQUIRE(order == expected);
+                REQUIRE(!overlapped);
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("deadline_pool reports missed deadlines", "[deadline][scheduler]"){
+    GIVEN("a deadline_pool with a missed callback"){
+        std::mutex lock;
+        std::vector<std::pair<rxsc::scheduler::clock_type::time_point, rxsc::scheduler::clock_type::time_point>> misses;
+        rxsc::deadline_pool pool(1, [&](rxsc::scheduler::clock_type::time_point deadline, rxsc::scheduler::clock_type::time_point finished){
+            std::unique_lock<std::mutex> guard(lock);
+            misses.push_back(std::make_pair(deadline, finished));
+        });
+        auto w = pool.get_scheduler(std::chrono::seconds(10)).create_worker();
+        WHEN("one action finishes after its deadline and one before"){
+            countdown finished(2);
+            auto late = rxsc::make_schedulable(w, [&](const rxsc::schedulable&){
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                finished.done();
+            });
+            auto deadline = w.now() + std::chrono::milliseconds(1);
+            late.set_deadline(deadline);
+            w.schedule(late);
+            w.schedule([&](const rxsc::schedulable&){
+                finished.done();
+            });
+            finished.wait();
+            // the callback runs after the action returns
+            countdown drained(1);
+            w.schedule([&](const rxsc::schedulable&){
+                drained.done();
+            });
+            drained.wait();
+            THEN("only the late action was reported"){
+                std::unique_lock<std::mutex> guard(lock);
+                REQUIRE(misses.size() == 1);
+                REQUIRE(misses[0].first == deadline);
+                REQUIRE(misses[0].second > deadline);
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("observe_on_deadline", "[deadline][observe_on][scheduler]"){
+    GIVEN("a range observed on a deadline_pool"){
+        rxsc::deadline_pool pool(2);
+        WHEN("the values are observed"){
+            std::vector<int> values;
+            std::set<std::thread::id> threads;
+            countdown finished(1);
+            rxs::range(1, 100)
+                .observe_on(rx::observe_on_deadline(pool, std::chrono::milliseconds(10)))
+                .subscribe(
+                    [&](int v){
+                        values.push_back(v);
+                        threads.insert(std::this_thread::get_id());
+                    },
+                    [&](){
+                        finished.done();
+                    });
+            finished.wait();
+            THEN("they arrived in order on the pool"){
+                REQUIRE(values.size() == 100);
+                REQUIRE(values.front() == 1);
+                REQUIRE(values.back() == 100);
+                REQUIRE(std::is_sorted(values.begin(), values.end()));
+                REQUIRE(threads.count(std::this_thread::get_id()) == 0);
+            }
+        }
+    }
+}
@@ -0,0 +1,322 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+std::shared_ptr<rxsc::event_loop> make_loops(rxsc::event_loop::placement p) {
+    return std::make_shared<rxsc::event_loop>([](std::function<void()> start){
+        return std::thread(std::move(start));
+    }, p);
+}
+
+size_t total_workers(const std::vector<rxsc::event_loop::loop_load>& load) {
+    size_t result = 0;
+    for (auto& l : load) {
+        result += l.workers;
+    }
+    return result;
+}
+
+// waits up to a second for the queued actions to run
+size_t total_queued(const rxsc::event_loop& el) {
+    size_t result = 0;
+    auto deadline = el.now() + std::chrono::seconds(1);
+    do {
+        result = 0;
+        for (auto& l : el.load()) {
+            result += l.queued;
+        }
+    } while (result != 0 && el.now() < deadline && (std::this_thread::yield(), true));
+    return result;
+}
+
+}
+
+SCENARIO("event_loop least_loaded placement", "[event_loop][scheduler]"){
+    GIVEN("an event_loop in least_loaded mode"){
+        auto el = make_loops(rxsc::event_loop::least_loaded);
+        rxsc::scheduler sc(std::static_pointer_cast<rxsc::scheduler_interface>(el));
+        auto loops = el->load().size();
+
+        WHEN("one worker per loop is created"){
+            std::vector<rxsc::worker> w;
+            for (size_t i = 0; i != loops; ++i) {
+                w.push_back(sc.create_worker());
+            }
+            THEN("each loop has one worker"){
+                for (auto& l : el->load()) {
+                    REQUIRE(l.workers == 1);
+                }
+            }
+            AND_WHEN("a worker is unsubscribed and another is created"){
+                w.front().unsubscribe();
+                REQUIRE(total_workers(el->load()) == loops - 1);
+                w.front() = sc.create_worker();
+                THEN("the new worker fills the empty loop"){
+                    for (auto& l : el->load()) {
+                        REQUIRE(l.workers == 1);
+                    }
+                }
+            }
+            for (auto& wk : w) {
+                wk.unsubscribe();
+            }
+        }
+
+        WHEN("a loop has a backlog of actions"){
+            std::mutex lock;
+            std::condition_variable wake;
+            bool blocked = true;
+            std::atomic<int> ran(0);
+
+            auto busy = sc.create_worker();
+            busy.schedule([&](const rxsc::schedulable&){
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&](){return !blocked;});
+            });
+            for (int i = 0; i < 10; ++i) {
+                busy.schedule([&](const rxsc::schedulable&){
+                    ++ran;
+                });
+            }
+
+            std::vector<rxsc::worker> w;
+            for (size_t i = 0; i != loops * 2; ++i) {
+                w.push_back(sc.create_worker());
+            }
+            auto load = el->load();
+
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                blocked = false;
+                wake.notify_all();
+            }
+            while (ran != 10) {
+                std::this_thread::yield();
+            }
+
+            THEN("the queue depth is visible"){
+                size_t queued = 0;
+                for (auto& l : load) {
+                    queued += l.queued;
+                }
+                REQUIRE(queued >= 10);
+            }
+            THEN("new workers avoid the busy loop"){
+                for (auto& l : load) {
+                    if (l.queued >= 10) {
+                        REQUIRE(l.workers == 1);
+                    } else {
+                        REQUIRE(l.workers >= 2);
+                    }
+                }
+            }
+            THEN("the queue drains"){
+                REQUIRE(total_queued(*el) == 0);
+            }
+            for (auto& wk : w) {
+                wk.unsubscribe();
+            }
+            busy.unsubscribe();
+        }
+    }
+}
+
+SCENARIO("event_loop least_loaded counts rescheduled actions", "[event_loop][scheduler]"){
+    GIVEN("an event_loop in least_loaded mode"){
+        auto el = make_loops(rxsc::event_loop::least_loaded);
+        rxsc::scheduler sc(std::static_pointer_cast<rxsc::scheduler_interface>(el));
+        WHEN("an action reschedules itself"){
+            auto w = sc.create_worker();
+            std::mutex lock;
+            std::condition_variable wake;
+            int remaining = 100;
+            w.schedule([&](const rxsc::schedulable& self){
+                std::unique_lock<std::mutex> guard(lock);
+                if (--remaining == 0) {
+                    wake.notify_all();
+                    return;
+                }
+                guard.unlock();
+                self.schedule();
+            });
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&](){return remaining == 0;});
+            }
+            THEN("the queue depth returns to zero"){
+                REQUIRE(total_queued(*el) == 0);
+            }
+            w.unsubscribe();
+        }
+    }
+}
+
+SCENARIO("event_loop least_loaded drops cancelled actions from the queue depth", "[event_loop][scheduler]"){
+    GIVEN("an event_loop in least_loaded mode with one loop"){
+        rxsc::event_loop::config c;
+        c.thread_count = 1;
+        c.mode = rxsc::event_loop::least_loaded;
+        auto el = std::make_shared<rxsc::event_loop>(c);
+        rxsc::scheduler sc(std::static_pointer_cast<rxsc::scheduler_interface>(el));
+        WHEN("100 workers each schedule an action an hour out and then end"){
+            for (int i = 0; i != 100; ++i) {
+                auto w = sc.create_worker();
+                w.schedule(w.now() + std::chrono::hours(1), [](const rxsc::schedulable&){});
+                w.unsubscribe();
+            }
+            THEN("the loop has no workers and nothing queued"){
+                REQUIRE(total_queued(*el) == 0);
+                REQUIRE(total_workers(el->load()) == 0);
+            }
+        }
+        WHEN("actions queued behind a blocked action are unsubscribed"){
+            std::promise<void> release;
+            auto gate = release.get_future().share();
+            countdown finished(1);
+            int ran = 0;
+
+            // the count drops before the blocked action returns, so the gate
+            // is held by value and the action is waited for before leaving
+            auto busy = sc.create_worker();
+            busy.schedule([&finished, gate](const rxsc::schedulable&){
+                gate.wait();
+                finished.done();
+            });
+            auto w = sc.create_worker();
+            for (int i = 0; i != 10; ++i) {
+                w.schedule([&](const rxsc::schedulable&){
+                    ++ran;
+                });
+            }
+            auto load = el->load();
+            w.unsubscribe();
+            release.set_value();
+            THEN("they were counted while they waited and dropped once they were skipped"){
+                REQUIRE(load.front().queued >= 10);
+                REQUIRE(total_queued(*el) == 0);
+                REQUIRE(ran == 0);
+            }
+            finished.wait();
+            busy.unsubscribe();
+        }
+    }
+}
+
+SCENARIO("event_loop config", "[event_loop][scheduler]"){
+    GIVEN("an event_loop config for 2 threads pinned to cpu 0"){
+        rxsc::event_loop::config c;
+        c.thread_count = 2;
+        c.cpus.push_back(std::vector<int>(1, 0));
+        c.numa = rxsc::event_loop::numa_local;
+        auto el = std::make_shared<rxsc::event_loop>(c);
+        rxsc::scheduler sc(std::static_pointer_cast<rxsc::scheduler_interface>(el));
+        WHEN("actions run on each loop"){
+            std::mutex lock;
+            std::condition_variable wake;
+            int remaining = 2;
+            std::vector<std::thread::id> threads;
+            std::vector<int> cpus;
+            std::vector<rxsc::worker> w;
+            for (int i = 0; i < 2; ++i) {
+                w.push_back(sc.create_worker());
+                w.back().schedule([&](const rxsc::schedulable&){
+                    std::unique_lock<std::mutex> guard(lock);
+                    threads.push_back(std::this_thread::get_id());
+#if defined(__linux__)
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    sched_getaffinity(0, sizeof(set), &set);
+                    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                        if (CPU_ISSET(cpu, &set)) {
+                            cpus.push_back(cpu);
+                        }
+                    }
+#endif
+                    if (--remaining == 0) {
+                        wake.notify_all();
+                    }
+                });
+            }
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&](){return remaining == 0;});
+            }
+            THEN("there are 2 loop threads"){
+                REQUIRE(el->load().size() == 2);
+                REQUIRE(threads.size() == 2);
+                REQUIRE(threads[0] != threads[1]);
+            }
+#if defined(__linux__)
+            THEN("each loop thread is pinned to cpu 0"){
+                REQUIRE(cpus == std::vector<int>({0, 0}));
+            }
+#endif
+            for (auto& wk : w) {
+                wk.unsubscribe();
+            }
+        }
+    }
+}
+
+SCENARIO("event_loop cpu placement", "[hide][event_loop][scheduler][numa][long][perf]"){
+    GIVEN("a producer pinned to the first cpu"){
+        WHEN("actions are sent to a loop pinned to the same cpu and to the last cpu"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int last = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+            const int actions = 200000;
+
+            // on a multi-socket host the last cpu is usually on another
+            // socket, so the second run pays for the cross-socket traffic
+            // on every hand off. pinning both sides avoids that.
+            auto run = [&](const char* label, int loopcpu, rxsc::event_loop::numa_policy numa) {
+                rxsc::event_loop::config c;
+                c.thread_count = 1;
+                c.cpus.push_back(std::vector<int>(1, loopcpu));
+                c.numa = numa;
+                auto sc = rxsc::make_event_loop(c);
+                auto w = sc.create_worker();
+
+                std::mutex lock;
+                std::condition_variable wake;
+                bool done = false;
+                long total = 0;
+                auto start = clock::now();
+                std::thread producer([&](){
+                    rxsc::detail::set_current_thread_affinity(std::vector<int>(1, 0));
+                    for (int i = 0; i < actions; ++i) {
+                        w.schedule([&, i](const rxsc::schedulable&){
+                            total += i;
+                            if (i == actions - 1) {
+                                std::unique_lock<std::mutex> guard(lock);
+                                done = true;
+                                wake.notify_all();
+                            }
+                        });
+                    }
+                });
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    wake.wait(guard, [&](){return done;});
+                }
+                producer.join();
+                auto finish = clock::now();
+                auto msElapsed = duration_cast<milliseconds>(finish-start);
+                std::cout << label << actions << " actions, " << msElapsed.count() << "ms elapsed, " << actions / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+                w.unsubscribe();
+            };
+
+            for (int runs = 0; runs < 3; ++runs) {
+                run("loop on cpu 0, numa_local   : ", 0, rxsc::event_loop::numa_local);
+                run("loop on last cpu, default   : ", last, rxsc::event_loop::numa_default);
+                run("loop on last cpu, numa_local: ", last, rxsc::event_loop::numa_local);
+            }
+        }
+    }
+}
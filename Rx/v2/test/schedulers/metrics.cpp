@@ -0,0 +1,229 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+#if RXCPP_USE_SCHEDULER_METRICS
+// the counters are updated after each action returns, so poll until the
+// worker has caught up
+rxsc::worker_metrics metrics_after(const rxsc::worker& w, uint64_t executed) {
+    rxsc::worker_metrics m;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (w.get_metrics(m) && m.executed < executed && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    return m;
+}
+#endif
+
+}
+
+SCENARIO("worker_metrics wait quantiles", "[metrics][scheduler]"){
+    GIVEN("a snapshot with waits in two buckets"){
+        rxsc::worker_metrics m;
+        m.wait[0] = 50;
+        m.wait[3] = 40;
+        m.wait[rxsc::worker_metrics::wait_buckets - 1] = 10;
+        THEN("the quantiles are the upper bounds of the buckets"){
+            REQUIRE(m.wait_quantile(0.5) == std::chrono::microseconds(1));
+            REQUIRE(m.wait_quantile(0.9) == std::chrono::microseconds(8));
+            REQUIRE(m.wait_quantile(0.99) == (rxsc::worker_metrics::clock_type::duration::max)());
+        }
+    }
+}
+
+#if !RXCPP_USE_SCHEDULER_METRICS
+
+SCENARIO("scheduler metrics are off by default", "[metrics][scheduler]"){
+    GIVEN("new_thread and event_loop"){
+        auto w = rxsc::make_new_thread().create_worker();
+        std::vector<rxsc::worker_metrics> loops;
+        rxsc::worker_metrics m;
+        THEN("no counters are kept"){
+            REQUIRE(!w.get_metrics(m));
+            REQUIRE(!rxsc::make_event_loop().get_metrics(loops));
+            REQUIRE(!rxsc::make_current_thread().create_worker().get_metrics(m));
+        }
+        w.unsubscribe();
+    }
+}
+
+#else
+
+SCENARIO("new_thread metrics", "[metrics][new_thread][scheduler]"){
+    GIVEN("a new_thread worker"){
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("100 actions run"){
+            countdown finished(100);
+            for (int i = 0; i < 100; ++i) {
+                w.schedule([&](const rxsc::schedulable&){
+                    finished.done();
+                });
+            }
+            finished.wait();
+            auto m = metrics_after(w, 100);
+            THEN("each was counted"){
+                REQUIRE(m.executed == 100);
+                REQUIRE(m.queued == 0);
+                uint64_t waits = 0;
+                for (auto count : m.wait) {
+                    waits += count;
+                }
+                REQUIRE(waits == 100);
+                REQUIRE(m.busy > rxsc::worker_metrics::clock_type::duration::zero());
+            }
+        }
+        WHEN("actions queue up behind a running action"){
+            std::promise<void> release;
+            auto gate = release.get_future().share();
+            countdown started(1);
+            countdown finished(11);
+            w.schedule([&, gate](const rxsc::schedulable&){
+                started.done();
+                gate.wait();
+                finished.done();
+            });
+            started.wait();
+            for (int i = 0; i < 10; ++i) {
+                w.schedule([&](const rxsc::schedulable&){
+                    finished.done();
+                });
+            }
+            rxsc::worker_metrics m;
+            REQUIRE(w.get_metrics(m));
+            release.set_value();
+            finished.wait();
+            THEN("the queue depth was counted"){
+                REQUIRE(m.queued == 10);
+                REQUIRE(metrics_after(w, 11).queued == 0);
+            }
+        }
+        WHEN("timed actions are cancelled while they wait"){
+            std::vector<rx::composite_subscription> lifetimes;
+            auto later = w.now() + std::chrono::hours(1);
+            for (int i = 0; i < 10; ++i) {
+                lifetimes.push_back(rx::composite_subscription());
+                w.schedule(later, rxsc::make_schedulable(w, lifetimes.back(), [](const rxsc::schedulable&){}));
+            }
+            for (int i = 0; i < 6; ++i) {
+                lifetimes[i].unsubscribe();
+            }
+            rxsc::worker_metrics m;
+            REQUIRE(w.get_metrics(m));
+            THEN("the live and dead entries were counted"){
+                REQUIRE(m.timed_live == 4);
+                REQUIRE(m.timed_dead == 6);
+            }
+            for (auto& cs : lifetimes) {
+                cs.unsubscribe();
+            }
+        }
+        WHEN("cancelled timed actions are compacted out of the queue"){
+            auto later = w.now() + std::chrono::hours(1);
+            for (int i = 0; i < 200; ++i) {
+                rx::composite_subscription cs;
+                w.schedule(later, rxsc::make_schedulable(w, cs, [](const rxsc::schedulable&){}));
+                cs.unsubscribe();
+            }
+            rx::composite_subscription lifetime;
+            for (int i = 0; i < 100; ++i) {
+                w.schedule(later, rxsc::make_schedulable(w, lifetime, [](const rxsc::schedulable&){}));
+            }
+            rxsc::worker_metrics m;
+            REQUIRE(w.get_metrics(m));
+            THEN("the dropped entries are no longer counted as queued"){
+                REQUIRE(m.timed_live == 100);
+                REQUIRE(m.timed_dead < 200);
+                REQUIRE(m.queued == m.timed_live + m.timed_dead);
+            }
+            lifetime.unsubscribe();
+        }
+        WHEN("an action recurses with nothing else queued"){
+            countdown finished(1);
+            int runs = 0;
+            w.schedule([&](const rxsc::schedulable& self){
+                if (++runs < 4) {
+                    self();
+                    return;
+                }
+                finished.done();
+            });
+            finished.wait();
+            auto m = metrics_after(w, 1);
+            THEN("each recursion ran in place"){
+                REQUIRE(m.executed == 1);
+                REQUIRE(m.tail_recursions == 3);
+                REQUIRE(m.reschedules == 0);
+            }
+        }
+        WHEN("an action recurses while another is queued"){
+            std::promise<void> release;
+            auto gate = release.get_future().share();
+            countdown started(1);
+            countdown finished(2);
+            w.schedule([&, gate](const rxsc::schedulable&){
+                started.done();
+                gate.wait();
+            });
+            started.wait();
+            bool again = true;
+            w.schedule([&](const rxsc::schedulable& self){
+                if (again) {
+                    again = false;
+                    self();
+                    return;
+                }
+                finished.done();
+            });
+            w.schedule([&](const rxsc::schedulable&){
+                finished.done();
+            });
+            release.set_value();
+            finished.wait();
+            auto m = metrics_after(w, 4);
+            THEN("the recursion was queued again"){
+                REQUIRE(m.executed == 4);
+                REQUIRE(m.reschedules == 1);
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("event_loop metrics", "[metrics][event_loop][scheduler]"){
+    GIVEN("an event_loop with 2 threads"){
+        rxsc::event_loop::config c;
+        c.thread_count = 2;
+        auto sc = rxsc::make_event_loop(c);
+        WHEN("actions run on each loop"){
+            auto w0 = sc.create_worker();
+            auto w1 = sc.create_worker();
+            countdown finished(30);
+            for (int i = 0; i < 10; ++i) {
+                w0.schedule([&](const rxsc::schedulable&){finished.done();});
+                w1.schedule([&](const rxsc::schedulable&){finished.done();});
+                w1.schedule([&](const rxsc::schedulable&){finished.done();});
+            }
+            finished.wait();
+            metrics_after(w0, 10);
+            metrics_after(w1, 20);
+            std::vector<rxsc::worker_metrics> loops;
+            REQUIRE(sc.get_metrics(loops));
+            THEN("each loop thread has its own counters"){
+                REQUIRE(loops.size() == 2);
+                std::vector<uint64_t> executed = {loops[0].executed, loops[1].executed};
+                std::sort(executed.begin(), executed.end());
+                REQUIRE(executed == std::vector<uint64_t>({10, 20}));
+            }
+            w0.unsubscribe();
+            w1.unsubscribe();
+        }
+    }
+}
+
+#endif
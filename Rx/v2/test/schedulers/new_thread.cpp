@@ -0,0 +1,400 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+SCENARIO("mpsc_queue", "[new_thread][scheduler]"){
+    GIVEN("an mpsc_queue"){
+        rxsc::detail::mpsc_queue<int> q;
+        THEN("it starts idle and empty"){
+            REQUIRE(q.idle());
+            REQUIRE(q.front() == nullptr);
+        }
+        WHEN("4 threads push 10K items each"){
+            const int producers = 4;
+            const int count = 10000;
+            std::vector<std::thread> threads;
+            for (int p = 0; p < producers; ++p) {
+                threads.emplace_back([&, p](){
+                    for (int i = 0; i < count; ++i) {
+                        q.push(p * count + i);
+                    }
+                });
+            }
+            std::vector<int> last(producers, -1);
+            bool inorder = true;
+            int popped = 0;
+            while (popped != producers * count) {
+                auto v = q.front();
+                if (!v) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                auto p = *v / count;
+                inorder = inorder && *v % count == last[p] + 1;
+                last[p] = *v % count;
+                q.pop();
+                ++popped;
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            THEN("each producer's items come out in the order they were pushed"){
+                REQUIRE(inorder);
+                REQUIRE(q.idle());
+                REQUIRE(q.front() == nullptr);
+            }
+        }
+    }
+}
+
+SCENARIO("new_thread with many producers", "[new_thread][scheduler]"){
+    GIVEN("a new_thread worker"){
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("4 threads schedule 10K actions each"){
+            const int producers = 4;
+            const int count = 10000;
+            std::vector<int> last(producers, -1);
+            bool inorder = true;
+            countdown finished(producers * count);
+            std::vector<std::thread> threads;
+            for (int p = 0; p < producers; ++p) {
+                threads.emplace_back([&, p](){
+                    for (int i = 0; i < count; ++i) {
+                        w.schedule([&, p, i](const rxsc::schedulable&){
+                            inorder = inorder && i == last[p] + 1;
+                            last[p] = i;
+                            finished.done();
+                        });
+                        // let the worker park now and then
+                        if (i % 1000 == 0) {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                    }
+                });
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+            finished.wait();
+            THEN("every action ran, in order for each producer"){
+                REQUIRE(inorder);
+                for (auto l : last) {
+                    REQUIRE(l == count - 1);
+                }
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("new_thread runs immediate and timed actions in time order", "[new_thread][scheduler]"){
+    GIVEN("a new_thread worker"){
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("a timed action comes due behind immediate actions"){
+            std::vector<int> order;
+            countdown finished(4);
+            auto start = w.now();
+            w.schedule(start + std::chrono::milliseconds(20), [&](const rxsc::schedulable&){
+                order.push_back(3);
+                finished.done();
+            });
+            w.schedule([&](const rxsc::schedulable&){
+                order.push_back(1);
+                finished.done();
+            });
+            w.schedule(start, [&](const rxsc::schedulable&){
+                order.push_back(0);
+                finished.done();
+            });
+            w.schedule([&](const rxsc::schedulable&){
+                order.push_back(2);
+                finished.done();
+            });
+            finished.wait();
+            THEN("they ran in time order, no earlier than requested"){
+                REQUIRE(order == std::vector<int>({0, 1, 2, 3}));
+                REQUIRE(w.now() >= start + std::chrono::milliseconds(20));
+            }
+        }
+        WHEN("the worker is parked"){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            countdown finished(1);
+            w.schedule([&](const rxsc::schedulable&){
+                finished.done();
+            });
+            THEN("an immediate action wakes it"){
+                finished.wait();
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("new_thread wait strategies", "[new_thread][scheduler]"){
+    auto tf = [](std::function<void()> start){
+        return std::thread(std::move(start));
+    };
+    std::vector<rxsc::new_thread::wait_strategy> strategies = {
+        rxsc::new_thread::block,
+        rxsc::new_thread::spin_then_park,
+        rxsc::new_thread::busy_spin};
+    for (auto ws : strategies) {
+        GIVEN("a new_thread worker with wait strategy " << ws){
+            auto w = rxsc::make_new_thread(tf, ws).create_worker();
+            WHEN("immediate actions arrive in bursts with timed actions between"){
+                std::vector<int> order;
+                countdown finished(31);
+                auto start = w.now();
+                w.schedule(start + std::chrono::milliseconds(5), [&](const rxsc::schedulable&){
+                    order.push_back(30);
+                    finished.done();
+                });
+                for (int burst = 0; burst < 3; ++burst) {
+                    for (int i = 0; i < 10; ++i) {
+                        w.schedule([&, burst, i](const rxsc::schedulable&){
+                            order.push_back(burst * 10 + i);
+                            finished.done();
+                        });
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+                finished.wait();
+                THEN("the bursts ran in order and the timed action ran no earlier than requested"){
+                    std::vector<int> expected;
+                    for (int i = 0; i < 31; ++i) {
+                        expected.push_back(i);
+                    }
+                    // the timed action may come due during the bursts
+                    order.erase(std::find(order.begin(), order.end(), 30));
+                    expected.pop_back();
+                    REQUIRE(order == expected);
+                    REQUIRE(w.now() >= start + std::chrono::milliseconds(5));
+                }
+            }
+            w.unsubscribe();
+        }
+    }
+}
+
+namespace {
+
+// holds a worker thread in an action until release() so that the actions
+// scheduled meanwhile are all queued when it looks at its lanes again
+class hold
+{
+    std::promise<void> released;
+    std::shared_future<void> gate;
+    countdown started;
+public:
+    explicit hold(const rxsc::worker& w)
+        : gate(released.get_future().share())
+        , started(1)
+    {
+        auto g = gate;
+        auto s = &started;
+        w.schedule([g, s](const rxsc::schedulable&){
+            s->done();
+            g.wait();
+        });
+        started.wait();
+    }
+    void release() {
+        released.set_value();
+    }
+};
+
+// schedule an action on w, in lane p, that appends tag to order
+void schedule_tagged(const rxsc::worker& w, rxsc::priority::type p, std::vector<char>& order, char tag, countdown& finished) {
+    auto scbl = rxsc::make_schedulable(w, [&order, tag, &finished](const rxsc::schedulable&){
+        order.push_back(tag);
+        finished.done();
+    });
+    scbl.set_priority(p);
+    w.schedule(scbl);
+}
+
+}
+
+SCENARIO("new_thread priority lanes", "[new_thread][scheduler][priority]"){
+    GIVEN("a new_thread worker"){
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("high priority actions are scheduled behind normal ones"){
+            std::vector<char> order;
+            countdown finished(8);
+            hold busy(w);
+            for (int i = 0; i < 5; ++i) {
+                schedule_tagged(w, rxsc::priority::normal, order, 'n', finished);
+            }
+            for (int i = 0; i < 3; ++i) {
+                schedule_tagged(w, rxsc::priority::high, order, 'h', finished);
+            }
+            busy.release();
+            finished.wait();
+            THEN("the high lane was drained first"){
+                REQUIRE(std::string(order.begin(), order.end()) == "hhhnnnnn");
+            }
+        }
+        WHEN("a timed high priority action comes due behind normal ones"){
+            std::vector<char> order;
+            countdown finished(4);
+            hold busy(w);
+            auto due = w.now();
+            for (int i = 0; i < 3; ++i) {
+                schedule_tagged(w, rxsc::priority::normal, order, 'n', finished);
+            }
+            auto scbl = rxsc::make_schedulable(w, [&](const rxsc::schedulable&){
+                order.push_back('h');
+                finished.done();
+            });
+            scbl.set_priority(rxsc::priority::high);
+            w.schedule(due, scbl);
+            busy.release();
+            finished.wait();
+            THEN("it ran first"){
+                REQUIRE(std::string(order.begin(), order.end()) == "hnnn");
+            }
+        }
+        w.unsubscribe();
+    }
+    GIVEN("a new_thread worker with a priority quota of 2"){
+        auto tf = [](std::function<void()> start){
+            return std::thread(std::move(start));
+        };
+        auto w = rxsc::make_new_thread(tf, rxsc::new_thread::block, 2).create_worker();
+        WHEN("the high lane has more actions than the quota"){
+            std::vector<char> order;
+            countdown finished(10);
+            hold busy(w);
+            for (int i = 0; i < 4; ++i) {
+                schedule_tagged(w, rxsc::priority::normal, order, 'n', finished);
+            }
+            for (int i = 0; i < 6; ++i) {
+                schedule_tagged(w, rxsc::priority::high, order, 'h', finished);
+            }
+            busy.release();
+            finished.wait();
+            THEN("a normal action runs after each quota of high ones"){
+                REQUIRE(std::string(order.begin(), order.end()) == "hhnhhnhhnn");
+            }
+        }
+        w.unsubscribe();
+    }
+    GIVEN("an event_loop worker"){
+        rxsc::event_loop::config c;
+        c.thread_count = 1;
+        auto w = rxsc::make_event_loop(c).create_worker();
+        WHEN("high priority actions are scheduled behind normal ones"){
+            std::vector<char> order;
+            countdown finished(6);
+            hold busy(w);
+            for (int i = 0; i < 3; ++i) {
+                schedule_tagged(w, rxsc::priority::normal, order, 'n', finished);
+            }
+            for (int i = 0; i < 3; ++i) {
+                schedule_tagged(w, rxsc::priority::high, order, 'h', finished);
+            }
+            busy.release();
+            finished.wait();
+            THEN("the loop drained the high lane first"){
+                REQUIRE(std::string(order.begin(), order.end()) == "hhhnnn");
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("new_thread ping-pong latency", "[hide][new_thread][scheduler][long][perf]"){
+    GIVEN("two new_thread workers"){
+        WHEN("an action is passed back and forth between them"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int trips = 5000;
+
+            auto tf = [](std::function<void()> start){
+                return std::thread(std::move(start));
+            };
+
+            auto run = [&](const char* label, rxsc::new_thread::wait_strategy ws) {
+                auto sc = rxsc::make_new_thread(tf, ws);
+                auto ping = sc.create_worker();
+                auto pong = sc.create_worker();
+                std::vector<long long> samples;
+                samples.reserve(trips);
+                countdown finished(1);
+                clock::time_point sent;
+
+                std::function<void()> serve = [&](){
+                    sent = clock::now();
+                    pong.schedule([&](const rxsc::schedulable&){
+                        ping.schedule([&](const rxsc::schedulable&){
+                            samples.push_back(duration_cast<nanoseconds>(clock::now() - sent).count());
+                            if (samples.size() == static_cast<size_t>(trips)) {
+                                finished.done();
+                                return;
+                            }
+                            // leave the workers idle between trips so that
+                            // the wait strategy is on the path
+                            std::this_thread::sleep_for(microseconds(50));
+                            serve();
+                        });
+                    });
+                };
+                ping.schedule([&](const rxsc::schedulable&){
+                    serve();
+                });
+                finished.wait();
+                ping.unsubscribe();
+                pong.unsubscribe();
+
+                std::sort(samples.begin(), samples.end());
+                std::cout << label << trips << " round trips, p50 " << samples[trips / 2] / 1000.0 << "us, p99 " << samples[trips * 99 / 100] / 1000.0 << "us" << std::endl;
+            };
+
+            for (int runs = 0; runs < 3; ++runs) {
+                run("block          : ", rxsc::new_thread::block);
+                run("spin_then_park : ", rxsc::new_thread::spin_then_park);
+                run("busy_spin      : ", rxsc::new_thread::busy_spin);
+            }
+        }
+    }
+}
+
+SCENARIO("new_thread producer handoff", "[hide][new_thread][scheduler][long][perf]"){
+    GIVEN("a new_thread worker"){
+        WHEN("producer threads schedule actions on it"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int actions = 1000000;
+
+            for (int producers = 1; producers <= 4; producers *= 2) {
+                auto w = rxsc::make_new_thread().create_worker();
+                countdown finished(actions);
+                auto start = clock::now();
+                std::vector<std::thread> threads;
+                for (int p = 0; p < producers; ++p) {
+                    threads.emplace_back([&](){
+                        for (int i = 0; i < actions / producers; ++i) {
+                            w.schedule([&](const rxsc::schedulable&){
+                                finished.done();
+                            });
+                        }
+                    });
+                }
+                for (auto& t : threads) {
+                    t.join();
+                }
+                finished.wait();
+                auto finish = clock::now();
+                auto msElapsed = duration_cast<milliseconds>(finish-start);
+                std::cout << "new_thread handoff : " << producers << " producers, " << actions << " actions, " << msElapsed.count() << "ms elapsed, " << actions / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+                w.unsubscribe();
+            }
+        }
+    }
+}
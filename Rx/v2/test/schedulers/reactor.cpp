@@ -0,0 +1,123 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+#if RXCPP_USE_EPOLL
+
+#include <sys/eventfd.h>
+
+SCENARIO("reactor runs actions on its loop thread", "[reactor][scheduler]"){
+    GIVEN("a reactor"){
+        rxsc::reactor loop;
+        auto w = loop.get_scheduler().create_worker();
+        WHEN("immediate and timed actions are scheduled"){
+            std::vector<int> order;
+            std::set<std::thread::id> threads;
+            countdown finished(4);
+            auto start = w.now();
+            auto record = [&](int i){
+                return [&, i](const rxsc::schedulable&){
+                    order.push_back(i);
+                    threads.insert(std::this_thread::get_id());
+                    finished.done();
+                };
+            };
+            w.schedule(start + std::chrono::milliseconds(20), record(3));
+            w.schedule(start + std::chrono::milliseconds(10), record(2));
+            w.schedule(record(0));
+            w.schedule(record(1));
+            finished.wait();
+            THEN("they ran in time order on one other thread"){
+                REQUIRE(order == std::vector<int>({0, 1, 2, 3}));
+                REQUIRE(w.now() >= start + std::chrono::milliseconds(20));
+                REQUIRE(threads.size() == 1);
+                REQUIRE(*threads.begin() != std::this_thread::get_id());
+            }
+        }
+        WHEN("an eventfd is watched and actions are scheduled from its callback"){
+            int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            REQUIRE(efd >= 0);
+            std::vector<std::string> order;
+            countdown finished(1);
+            auto watch = loop.watch(efd, EPOLLIN,
+                [&](uint32_t){
+                    uint64_t value = 0;
+                    if (read(efd, &value, sizeof(value)) != sizeof(value)) {
+                        return;
+                    }
+                    order.push_back("ready");
+                    w.schedule([&](const rxsc::schedulable&){
+                        order.push_back("action");
+                        finished.done();
+                    });
+                },
+                [](std::exception_ptr){});
+            uint64_t one = 1;
+            REQUIRE(write(efd, &one, sizeof(one)) == sizeof(one));
+            finished.wait();
+            THEN("the callback and the action ran on the loop"){
+                REQUIRE(order == std::vector<std::string>({"ready", "action"}));
+            }
+            watch.unsubscribe();
+            close(efd);
+        }
+    }
+}
+
+SCENARIO("reactor fd fan-in", "[hide][reactor][scheduler][long][perf]"){
+    GIVEN("a reactor and eventfds"){
+        WHEN("writers signal the eventfds that one loop thread watches"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int fds = 1000;
+            const int signals = 200;
+
+            rxsc::reactor loop;
+            std::vector<int> efd;
+            for (int i = 0; i < fds; ++i) {
+                efd.push_back(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+            }
+            std::atomic<long> received(0);
+            const long total = long(fds) * signals;
+            countdown finished(1);
+            rx::composite_subscription watches;
+            for (auto fd : efd) {
+                watches.add(rx::observable<>::from_fd(fd, EPOLLIN, loop)
+                    .subscribe([&, fd](uint32_t){
+                        uint64_t value = 0;
+                        if (read(fd, &value, sizeof(value)) == sizeof(value)) {
+                            if ((received += value) == total) {
+                                finished.done();
+                            }
+                        }
+                    }));
+            }
+            auto start = clock::now();
+            std::thread writer([&](){
+                uint64_t one = 1;
+                for (int s = 0; s < signals; ++s) {
+                    for (auto fd : efd) {
+                        if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+                            abort();
+                        }
+                    }
+                }
+            });
+            writer.join();
+            finished.wait();
+            auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+            std::cout << "reactor fan-in : " << fds << " fds, " << total << " signals, " << msElapsed.count() << "ms elapsed, " << total / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+            watches.unsubscribe();
+            for (auto fd : efd) {
+                close(fd);
+            }
+        }
+    }
+}
+
+#endif
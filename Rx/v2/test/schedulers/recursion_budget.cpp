@@ -0,0 +1,206 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+// counts what is scheduled on it and never runs it
+struct counting_worker : public rxsc::worker_interface
+{
+    counting_worker() : scheduled(0) {}
+
+    mutable int scheduled;
+
+    virtual clock_type::time_point now() const {
+        return clock_type::now();
+    }
+    virtual void schedule(const rxsc::schedulable&) const {
+        ++scheduled;
+    }
+    virtual void schedule(clock_type::time_point, const rxsc::schedulable&) const {
+        ++scheduled;
+    }
+};
+
+}
+
+SCENARIO("recursion budget ends a run of tail recursion", "[recursion][scheduler]"){
+    GIVEN("an action that always asks to recurse, on a worker that counts what it is given"){
+        auto counter = std::make_shared<counting_worker>();
+        rx::composite_subscription cs;
+        rxsc::worker w(cs, counter);
+        int calls = 0;
+        auto scbl = rxsc::make_schedulable(w, [&](const rxsc::schedulable& self){
+            if (++calls < 1000) {
+                self();
+            }
+        });
+        rxsc::recursion r;
+        WHEN("there is no budget"){
+            scbl(r.get_recurse());
+            THEN("the action recursed in place until it stopped asking"){
+                REQUIRE(calls == 1000);
+                REQUIRE(counter->scheduled == 0);
+            }
+        }
+        WHEN("the budget is 10 items"){
+            r.set_budget(rxsc::recursion_budget(10, std::chrono::nanoseconds::zero()));
+            scbl(r.get_recurse());
+            THEN("the action ran 10 times and then scheduled itself again"){
+                REQUIRE(calls == 10);
+                REQUIRE(counter->scheduled == 1);
+            }
+            scbl(r.get_recurse());
+            THEN("the next run had a new budget"){
+                REQUIRE(calls == 20);
+                REQUIRE(counter->scheduled == 2);
+            }
+        }
+        WHEN("the budget is a time"){
+            r.set_budget(rxsc::recursion_budget(0, std::chrono::milliseconds(5)));
+            auto slow = rxsc::make_schedulable(w, [&](const rxsc::schedulable& self){
+                ++calls;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                self();
+            });
+            slow(r.get_recurse());
+            THEN("the action stopped after the time ran out"){
+                REQUIRE(calls >= 1);
+                REQUIRE(calls <= 5);
+                REQUIRE(counter->scheduled == 1);
+            }
+        }
+        cs.unsubscribe();
+    }
+}
+
+SCENARIO("a recursing action on a shard takes turns", "[recursion][shards][scheduler]"){
+    GIVEN("one shard with a budget of 8 items"){
+        rxsc::shards::config c;
+        c.shard_count = 1;
+        c.pin = false;
+        c.budget = rxsc::recursion_budget(8, std::chrono::nanoseconds::zero());
+        rxsc::shards group(c);
+        auto w = group.get_scheduler(0).create_worker();
+        WHEN("the action schedules onto its own shard while it recurses"){
+            std::atomic<int> calls(0);
+            int seen = 0;
+            countdown finished(2);
+            w.schedule([&](const rxsc::schedulable& self){
+                if (calls == 0) {
+                    w.schedule([&](const rxsc::schedulable&){
+                        seen = calls;
+                        finished.done();
+                    });
+                }
+                if (++calls < 100) {
+                    self();
+                } else {
+                    finished.done();
+                }
+            });
+            finished.wait();
+            THEN("the new action ran after the next call instead of after the last"){
+                REQUIRE(seen == 1);
+                REQUIRE(calls == 100);
+            }
+        }
+        WHEN("another thread schedules onto the shard while the action recurses"){
+            std::atomic<int> calls(0);
+            int seen = 0;
+            countdown finished(2);
+            w.schedule([&](const rxsc::schedulable& self){
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                if (++calls < 100) {
+                    self();
+                } else {
+                    finished.done();
+                }
+            });
+            while (calls == 0) {
+                std::this_thread::yield();
+            }
+            w.schedule([&](const rxsc::schedulable&){
+                seen = calls;
+                finished.done();
+            });
+            finished.wait();
+            THEN("it ran within a budget or two instead of after the last call"){
+                REQUIRE(seen < 100);
+                REQUIRE(calls == 100);
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("event_loop passes its budget to the loop threads", "[recursion][event_loop][scheduler]"){
+    GIVEN("an event_loop with a budget of 4 items"){
+        rxsc::event_loop::config c;
+        c.thread_count = 1;
+        c.budget = rxsc::recursion_budget(4, std::chrono::nanoseconds::zero());
+        auto loop = rxsc::make_event_loop(c);
+        WHEN("a range is produced on it"){
+            std::vector<int> values;
+            countdown finished(1);
+            rxs::range(1, 100, rx::identity_one_worker(rxsc::make_same_worker(loop.create_worker())))
+                .subscribe(
+                    [&](int v){values.push_back(v);},
+                    [&](){finished.done();});
+            finished.wait();
+            THEN("every value arrived in order across the runs"){
+                REQUIRE(values.size() == 100);
+                REQUIRE(values.front() == 1);
+                REQUIRE(values.back() == 100);
+                REQUIRE(std::is_sorted(values.begin(), values.end()));
+            }
+        }
+    }
+}
+
+SCENARIO("recursion budget latency", "[hide][recursion][shards][scheduler][long][perf]"){
+    GIVEN("one shard running a long tail-recursive producer"){
+        WHEN("another thread schedules a probe onto the shard"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int each = 20000000;
+            size_t budgets[] = {0, 1024, 64};
+            for (auto items : budgets) {
+                rxsc::shards::config c;
+                c.shard_count = 1;
+                c.budget = rxsc::recursion_budget(items, nanoseconds::zero());
+                rxsc::shards group(c);
+                auto w = group.get_scheduler(0).create_worker();
+                std::atomic<int> calls(0);
+                clock::time_point probed;
+                countdown finished(2);
+                auto start = clock::now();
+                w.schedule([&](const rxsc::schedulable& self){
+                    if (calls.fetch_add(1, std::memory_order_relaxed) + 1 < each) {
+                        self();
+                    } else {
+                        finished.done();
+                    }
+                });
+                while (calls == 0) {
+                    std::this_thread::yield();
+                }
+                auto sent = clock::now();
+                w.schedule([&](const rxsc::schedulable&){
+                    probed = clock::now();
+                    finished.done();
+                });
+                finished.wait();
+                auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+                auto usProbe = duration_cast<microseconds>(probed - sent);
+                std::cout << "budget " << items << " items : " << each << " calls, " << msElapsed.count() << "ms elapsed, " << each / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec, probe waited " << usProbe.count() << "us" << std::endl;
+                w.unsubscribe();
+            }
+        }
+    }
+}
@@ -0,0 +1,162 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+
+SCENARIO("run_loop only runs actions when dispatched", "[run_loop][scheduler]"){
+    GIVEN("a run_loop"){
+        rxsc::run_loop rl;
+        auto w = rl.get_scheduler().create_worker();
+        THEN("it starts empty"){
+            REQUIRE(rl.empty());
+            REQUIRE(rl.next_due_time() == (rxsc::run_loop::clock_type::time_point::max)());
+            REQUIRE(!rl.dispatch_one());
+        }
+        WHEN("actions are scheduled from another thread"){
+            std::vector<int> order;
+            std::thread producer([&](){
+                for (int i = 0; i < 3; ++i) {
+                    w.schedule([&, i](const rxsc::schedulable&){
+                        order.push_back(i);
+                    });
+                }
+            });
+            producer.join();
+            THEN("nothing has run yet"){
+                REQUIRE(order.empty());
+                REQUIRE(!rl.empty());
+                REQUIRE(rl.next_due_time() <= w.now());
+            }
+            THEN("dispatch_one runs them one at a time, in order"){
+                REQUIRE(rl.dispatch_one());
+                REQUIRE(order == std::vector<int>({0}));
+                REQUIRE(rl.dispatch_one());
+                REQUIRE(rl.dispatch_one());
+                REQUIRE(!rl.dispatch_one());
+                REQUIRE(order == std::vector<int>({0, 1, 2}));
+                REQUIRE(rl.empty());
+            }
+        }
+        WHEN("an action is scheduled for later"){
+            bool ran = false;
+            auto due = w.now() + std::chrono::milliseconds(20);
+            w.schedule(due, [&](const rxsc::schedulable&){
+                ran = true;
+            });
+            THEN("next_due_time reports it and it only runs once due"){
+                REQUIRE(rl.next_due_time() == due);
+                REQUIRE(!rl.dispatch_one());
+                REQUIRE(rl.dispatch_until(w.now() + std::chrono::milliseconds(1)) == 0);
+                REQUIRE(!ran);
+                std::this_thread::sleep_until(rl.next_due_time());
+                REQUIRE(rl.dispatch_until(w.now() + std::chrono::milliseconds(100)) == 1);
+                REQUIRE(ran);
+            }
+        }
+        WHEN("an action is scheduled ahead of the next due time"){
+            std::vector<rxsc::run_loop::clock_type::time_point> wakeups;
+            rl.set_notify_earlier_wakeup([&](rxsc::run_loop::clock_type::time_point when){
+                wakeups.push_back(when);
+            });
+            auto now = w.now();
+            w.schedule(now + std::chrono::seconds(10), [](const rxsc::schedulable&){});
+            w.schedule(now + std::chrono::seconds(20), [](const rxsc::schedulable&){});
+            w.schedule(now + std::chrono::seconds(5), [](const rxsc::schedulable&){});
+            THEN("the host is told about each earlier wake up"){
+                REQUIRE(wakeups.size() == 2);
+                REQUIRE(wakeups[0] == now + std::chrono::seconds(10));
+                REQUIRE(wakeups[1] == now + std::chrono::seconds(5));
+            }
+        }
+        WHEN("an action is unsubscribed before it is dispatched"){
+            bool ran = false;
+            rx::composite_subscription cs;
+            w.schedule(rxsc::make_schedulable(w, cs, [&](const rxsc::schedulable&){
+                ran = true;
+            }));
+            cs.unsubscribe();
+            THEN("it is dropped"){
+                REQUIRE(rl.empty());
+                REQUIRE(!rl.dispatch_one());
+                REQUIRE(!ran);
+            }
+        }
+    }
+}
+
+SCENARIO("run_loop drains observables on the host thread", "[run_loop][scheduler][observe_on]"){
+    GIVEN("a run_loop"){
+        rxsc::run_loop rl;
+        WHEN("a range is subscribed on the thread that owns the run_loop"){
+            std::vector<int> values;
+            rxs::range(1, 3).subscribe([&](int v){values.push_back(v);});
+            THEN("current_thread work waits for dispatch"){
+                REQUIRE(values.empty());
+                while (rl.dispatch_one()) {
+                }
+                REQUIRE(values == std::vector<int>({1, 2, 3}));
+            }
+        }
+        WHEN("values from another thread are observed on the run_loop"){
+            auto host = std::this_thread::get_id();
+            std::vector<int> values;
+            bool onhost = true;
+            bool done = false;
+            rxs::range(1, 100)
+                .subscribe_on(rx::observe_on_new_thread())
+                .observe_on(rx::observe_on_run_loop(rl))
+                .subscribe(
+                    [&](int v){
+                        values.push_back(v);
+                        onhost = onhost && std::this_thread::get_id() == host;
+                    },
+                    [&](){
+                        done = true;
+                    });
+            // a host frame loop
+            auto deadline = rl.get_scheduler().now() + std::chrono::seconds(5);
+            while (!done && rl.get_scheduler().now() < deadline) {
+                auto frame = rl.get_scheduler().now() + std::chrono::milliseconds(1);
+                rl.dispatch_until(frame);
+                std::this_thread::sleep_until((std::min)(frame, rl.next_due_time()));
+            }
+            THEN("all the values arrive on the host thread"){
+                REQUIRE(done);
+                REQUIRE(values.size() == 100);
+                REQUIRE(onhost);
+            }
+        }
+    }
+}
+
+SCENARIO("run_loop keeps a recursing action to the frame", "[run_loop][recursion][scheduler]"){
+    GIVEN("a run_loop and an action that always asks to recurse"){
+        rxsc::run_loop rl;
+        auto w = rl.get_scheduler().create_worker();
+        int calls = 0;
+        w.schedule([&](const rxsc::schedulable& self){
+            ++calls;
+            self();
+        });
+        WHEN("dispatch_one is called"){
+            REQUIRE(rl.dispatch_one());
+            THEN("one step ran and the action was queued again"){
+                REQUIRE(calls == 1);
+                REQUIRE(!rl.empty());
+            }
+        }
+        WHEN("dispatch_until is given a 5ms frame"){
+            auto start = w.now();
+            rl.dispatch_until(start + std::chrono::milliseconds(5));
+            auto elapsed = w.now() - start;
+            THEN("the action recursed in place and returned at the deadline"){
+                REQUIRE(calls > 1);
+                REQUIRE(elapsed < std::chrono::milliseconds(100));
+                REQUIRE(!rl.empty());
+            }
+        }
+        w.unsubscribe();
+    }
+}
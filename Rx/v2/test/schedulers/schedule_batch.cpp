@@ -0,0 +1,149 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "rxcpp/rx-test.hpp"
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+// count actions that append their index to order and then call done.
+// the action at skip is unsubscribed before it is scheduled.
+std::vector<rxsc::schedulable> make_batch(const rxsc::worker& w, int count, int skip, std::vector<int>& order, countdown* done) {
+    std::vector<rxsc::schedulable> batch;
+    for (int i = 0; i < count; ++i) {
+        rx::composite_subscription cs;
+        batch.push_back(rxsc::make_schedulable(w, cs, [&order, done, i](const rxsc::schedulable&){
+            order.push_back(i);
+            if (done) {
+                done->done();
+            }
+        }));
+        if (i == skip) {
+            cs.unsubscribe();
+        }
+    }
+    return batch;
+}
+
+std::vector<int> expected(int count, int skip) {
+    std::vector<int> result;
+    for (int i = 0; i < count; ++i) {
+        if (i != skip) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+}
+
+SCENARIO("schedule_batch runs the batch in order", "[schedule_batch][scheduler]"){
+    const int count = 100;
+    const int skip = 42;
+    GIVEN("a new_thread worker"){
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("a batch is scheduled"){
+            std::vector<int> order;
+            countdown finished(count - 1);
+            w.schedule_batch(make_batch(w, count, skip, order, &finished));
+            finished.wait();
+            THEN("the subscribed actions ran in order"){
+                REQUIRE(order == expected(count, skip));
+            }
+        }
+        w.unsubscribe();
+    }
+    GIVEN("an event_loop worker"){
+        auto w = rxsc::make_event_loop().create_worker();
+        WHEN("a batch is scheduled"){
+            std::vector<int> order;
+            countdown finished(count - 1);
+            w.schedule_batch(make_batch(w, count, skip, order, &finished));
+            finished.wait();
+            THEN("the subscribed actions ran in order"){
+                REQUIRE(order == expected(count, skip));
+            }
+        }
+        w.unsubscribe();
+    }
+    GIVEN("a current_thread worker"){
+        auto w = rxsc::make_current_thread().create_worker();
+        WHEN("a batch is scheduled"){
+            std::vector<int> order;
+            w.schedule_batch(make_batch(w, count, skip, order, nullptr));
+            THEN("the subscribed actions ran in order before it returned"){
+                REQUIRE(order == expected(count, skip));
+            }
+        }
+        WHEN("a batch is scheduled from an action"){
+            std::vector<int> order;
+            w.schedule([&](const rxsc::schedulable&){
+                w.schedule_batch(make_batch(w, count, skip, order, nullptr));
+                order.push_back(-1);
+            });
+            THEN("the batch ran after the action returned"){
+                auto result = expected(count, skip);
+                result.insert(result.begin(), -1);
+                REQUIRE(order == result);
+            }
+        }
+    }
+    GIVEN("a test worker"){
+        auto sc = rxsc::make_test();
+        auto w = sc.create_worker();
+        WHEN("a batch is scheduled"){
+            std::vector<int> order;
+            w.schedule_batch(make_batch(w, count, skip, order, nullptr));
+            THEN("nothing ran until the clock advanced"){
+                REQUIRE(order.empty());
+                w.start();
+                REQUIRE(order == expected(count, skip));
+                REQUIRE(w.clock() == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("schedule_batch new_thread fan out", "[hide][schedule_batch][scheduler][long][perf]"){
+    const int batches = 2000;
+    const int size = 64;
+    GIVEN("a new_thread worker"){
+        WHEN("items are scheduled one at a time"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            auto w = rxsc::make_new_thread().create_worker();
+            std::vector<int> order;
+            countdown finished(batches * size);
+            auto start = clock::now();
+            for (int b = 0; b < batches; ++b) {
+                for (auto& scbl : make_batch(w, size, -1, order, &finished)) {
+                    w.schedule(scbl);
+                }
+            }
+            finished.wait();
+            auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+            std::cout << "schedule one at a time : " << batches * size << " items, " << msElapsed.count() << "ms elapsed, " << batches * size / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+            w.unsubscribe();
+        }
+        WHEN("items are scheduled in batches"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            auto w = rxsc::make_new_thread().create_worker();
+            std::vector<int> order;
+            countdown finished(batches * size);
+            auto start = clock::now();
+            for (int b = 0; b < batches; ++b) {
+                w.schedule_batch(make_batch(w, size, -1, order, &finished));
+            }
+            finished.wait();
+            auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+            std::cout << "schedule_batch of " << size << " : " << batches * size << " items, " << msElapsed.count() << "ms elapsed, " << batches * size / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+            w.unsubscribe();
+        }
+    }
+}
@@ -0,0 +1,260 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+namespace rxsub=rxcpp::subjects;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+// schedules itself again until remaining reaches 0, so that each step
+// goes through the queue of the worker
+struct chain
+{
+    rxsc::worker w;
+    std::shared_ptr<int> remaining;
+    countdown* finished;
+
+    void operator()(const rxsc::schedulable&) const {
+        if (--*remaining == 0) {
+            finished->done();
+            return;
+        }
+        w.schedule(*this);
+    }
+};
+
+rxsc::shards::config three_shards() {
+    rxsc::shards::config c;
+    c.shard_count = 3;
+    return c;
+}
+
+}
+
+SCENARIO("shards run each worker on its own shard thread", "[shards][scheduler]"){
+    GIVEN("3 shards"){
+        rxsc::shards group(three_shards());
+        REQUIRE(group.size() == 3);
+        REQUIRE(group.this_shard() == 3);
+        WHEN("each shard is asked where it runs"){
+            std::vector<std::thread::id> threads(3);
+            std::vector<size_t> indexes(3);
+            countdown finished(3);
+            for (size_t i = 0; i != 3; ++i) {
+                auto w = group.get_scheduler(i).create_worker();
+                w.schedule([&, i](const rxsc::schedulable&){
+                    threads[i] = std::this_thread::get_id();
+                    indexes[i] = group.this_shard();
+                    finished.done();
+                });
+            }
+            finished.wait();
+            THEN("each ran on a different thread that knows its index"){
+                REQUIRE(std::set<std::thread::id>(threads.begin(), threads.end()).size() == 3);
+                REQUIRE(indexes == std::vector<size_t>({0, 1, 2}));
+            }
+        }
+        WHEN("actions are scheduled from the shard and from outside"){
+            auto w = group.get_scheduler(1).create_worker();
+            std::vector<int> order;
+            countdown finished(5);
+            auto record = [&](int i){
+                return [&, i](const rxsc::schedulable&){
+                    order.push_back(i);
+                    finished.done();
+                };
+            };
+            auto start = w.now();
+            w.schedule(start + std::chrono::milliseconds(10), record(5));
+            w.schedule([&](const rxsc::schedulable&){
+                order.push_back(0);
+                // scheduled on the shard thread, onto the local queue
+                w.schedule(record(2));
+                w.schedule(record(3));
+                finished.done();
+            });
+            w.schedule(record(1));
+            finished.wait();
+            THEN("each source kept its order and the timed action ran last"){
+                REQUIRE(order.size() == 5);
+                REQUIRE(order.front() == 0);
+                REQUIRE(std::find(order.begin(), order.end(), 2) < std::find(order.begin(), order.end(), 3));
+                REQUIRE(order.back() == 5);
+                REQUIRE(w.now() >= start + std::chrono::milliseconds(10));
+            }
+            w.unsubscribe();
+        }
+        WHEN("current_thread is used on a shard"){
+            auto w = group.get_scheduler(2).create_worker();
+            std::vector<int> order;
+            countdown finished(1);
+            w.schedule([&](const rxsc::schedulable&){
+                rxsc::make_current_thread().create_worker().schedule([&](const rxsc::schedulable&){
+                    order.push_back(2);
+                    finished.done();
+                });
+                order.push_back(1);
+            });
+            finished.wait();
+            THEN("it queued onto the shard instead of running inline"){
+                REQUIRE(order == std::vector<int>({1, 2}));
+            }
+            w.unsubscribe();
+        }
+    }
+}
+
+SCENARIO("shard_local keeps one value per shard", "[shards][scheduler]"){
+    GIVEN("3 shards and a subject on each"){
+        rxsc::shards group(three_shards());
+        rxsc::shard_local<std::thread::id> created(group, [](){
+            return std::this_thread::get_id();
+        });
+        rxsc::shard_local<rxsub::subject<int>> subjects(group, [](){
+            return rxsub::subject<int>();
+        });
+        WHEN("each shard publishes to its local subject"){
+            std::vector<int> received(3);
+            std::vector<int> local(3);
+            countdown finished(3);
+            for (size_t i = 0; i != 3; ++i) {
+                group.get_scheduler(i).create_worker().schedule([&, i](const rxsc::schedulable&){
+                    local[i] = created.local() == std::this_thread::get_id();
+                    auto& s = subjects.local();
+                    s.get_observable().subscribe([&, i](int v){received[i] = v;});
+                    s.get_subscriber().on_next(static_cast<int>(i) + 10);
+                    finished.done();
+                });
+            }
+            finished.wait();
+            THEN("each shard saw only its own value, created on its own thread"){
+                REQUIRE(received == std::vector<int>({10, 11, 12}));
+                REQUIRE(local == std::vector<int>({1, 1, 1}));
+            }
+        }
+    }
+    GIVEN("3 shards and a factory that fails on one of them"){
+        rxsc::shards group(three_shards());
+        WHEN("a shard_local is created"){
+            std::atomic<int> calls(0);
+            auto create = [&](){
+                ++calls;
+                if (group.this_shard() == 1) {
+                    throw std::runtime_error("shard 1");
+                }
+                return 0;
+            };
+            THEN("the error leaves the constructor after every shard has run the factory"){
+                REQUIRE_THROWS_AS(rxsc::shard_local<int>(group, create), std::runtime_error);
+                REQUIRE(calls == 3);
+            }
+        }
+    }
+}
+
+SCENARIO("channel passes values between shards", "[shards][channel][subjects]"){
+    GIVEN("3 shards and a channel into shard 0"){
+        rxsc::shards group(three_shards());
+        rxsub::channel<int> inbound(group.get_scheduler(0));
+        WHEN("shards 1 and 2 send into it"){
+            const int count = 1000;
+            std::vector<int> values;
+            std::set<size_t> shards;
+            countdown subscribed(1);
+            countdown finished(1);
+            inbound.get_observable().subscribe(
+                [&](int v){
+                    values.push_back(v);
+                    shards.insert(group.this_shard());
+                },
+                [&](){finished.done();});
+            // the subscribe is queued on shard 0 ahead of this
+            group.get_scheduler(0).create_worker().schedule([&](const rxsc::schedulable&){
+                subscribed.done();
+            });
+            subscribed.wait();
+            countdown sent(2);
+            for (size_t from = 1; from != 3; ++from) {
+                auto out = inbound.get_subscriber();
+                group.get_scheduler(from).create_worker().schedule([&, out, from](const rxsc::schedulable&){
+                    for (int i = 0; i != count; ++i) {
+                        out.on_next(static_cast<int>(from) * count + i);
+                    }
+                    sent.done();
+                });
+            }
+            sent.wait();
+            inbound.get_subscriber().on_completed();
+            finished.wait();
+            THEN("all values arrived on shard 0, in order for each sender"){
+                REQUIRE(values.size() == 2 * count);
+                REQUIRE(shards == std::set<size_t>({0}));
+                std::vector<int> one, two;
+                for (auto v : values) {
+                    (v < 2 * count ? one : two).push_back(v);
+                }
+                REQUIRE(std::is_sorted(one.begin(), one.end()));
+                REQUIRE(std::is_sorted(two.begin(), two.end()));
+            }
+        }
+    }
+}
+
+SCENARIO("shard coordinations", "[shards][observe_on][scheduler]"){
+    GIVEN("3 shards"){
+        rxsc::shards group(three_shards());
+        WHEN("a range produced on shard 1 is observed on shard 2"){
+            std::set<size_t> produced, observed;
+            std::vector<int> values;
+            countdown finished(1);
+            rxs::range(1, 100, rx::identity_shard(group, 1))
+                .map([&](int v){
+                    produced.insert(group.this_shard());
+                    return v;
+                })
+                .observe_on(rx::observe_on_shard(group, 2))
+                .subscribe(
+                    [&](int v){
+                        observed.insert(group.this_shard());
+                        values.push_back(v);
+                    },
+                    [&](){finished.done();});
+            finished.wait();
+            THEN("each side stayed on its shard"){
+                REQUIRE(values.size() == 100);
+                REQUIRE(std::is_sorted(values.begin(), values.end()));
+                REQUIRE(produced == std::set<size_t>({1}));
+                REQUIRE(observed == std::set<size_t>({2}));
+            }
+        }
+    }
+}
+
+SCENARIO("shards scale", "[hide][shards][scheduler][long][perf]"){
+    GIVEN("one shard per cpu"){
+        WHEN("each shard runs a local chain of actions"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int each = 1000000;
+            for (size_t count = 1; count <= std::max(std::thread::hardware_concurrency(), 1u); count *= 2) {
+                rxsc::shards::config c;
+                c.shard_count = count;
+                rxsc::shards group(c);
+                countdown finished(static_cast<int>(count));
+                auto start = clock::now();
+                for (size_t i = 0; i != count; ++i) {
+                    auto w = group.get_scheduler(i).create_worker();
+                    chain next = {w, std::make_shared<int>(each), &finished};
+                    w.schedule(next);
+                }
+                finished.wait();
+                auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+                std::cout << "shards " << count << " : " << count * each << " actions, " << msElapsed.count() << "ms elapsed, " << count * each / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+// keeps what a watchdog reports
+struct stall_log
+{
+    std::mutex lock;
+    std::vector<rx::stall_report> reports;
+
+    rx::stall_watchdog::on_stall_type recorder() {
+        return [this](const rx::stall_report& s){
+            std::unique_lock<std::mutex> guard(lock);
+            reports.push_back(s);
+        };
+    }
+    std::vector<rx::stall_report> get() {
+        std::unique_lock<std::mutex> guard(lock);
+        return reports;
+    }
+};
+
+}
+
+#if !RXCPP_USE_STALL_WATCHDOG
+
+SCENARIO("stall watchdog is off by default", "[watchdog][scheduler]"){
+    GIVEN("a watchdog and a new_thread worker"){
+        stall_log log;
+        rx::stall_watchdog watchdog(std::chrono::milliseconds(10), log.recorder());
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("an action blocks for longer than the threshold"){
+            countdown finished(1);
+            w.schedule([&](const rxsc::schedulable&){
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                finished.done();
+            });
+            finished.wait();
+            THEN("nothing was reported"){
+                REQUIRE(log.get().empty());
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+#else
+
+SCENARIO("stall watchdog reports a blocked action once", "[watchdog][new_thread][scheduler]"){
+    GIVEN("a watchdog with a 20ms threshold and a new_thread worker"){
+        stall_log log;
+        rx::stall_watchdog watchdog(std::chrono::milliseconds(20), log.recorder());
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("many short actions run"){
+            countdown finished(1);
+            int remaining = 1000;
+            w.schedule([&](const rxsc::schedulable& self){
+                if (--remaining == 0) {
+                    finished.done();
+                    return;
+                }
+                self();
+            });
+            finished.wait();
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+            THEN("nothing was reported"){
+                REQUIRE(log.get().empty());
+            }
+        }
+        WHEN("an action blocks for 5 thresholds"){
+            countdown finished(1);
+            std::thread::id thread;
+            w.schedule([&](const rxsc::schedulable&){
+                thread = std::this_thread::get_id();
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                finished.done();
+            });
+            finished.wait();
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+            auto reports = log.get();
+            THEN("it was reported once, with its thread and no subscriber"){
+                REQUIRE(reports.size() == 1);
+                REQUIRE(reports[0].thread == thread);
+                REQUIRE(reports[0].subscriber.id == 0);
+                REQUIRE(reports[0].elapsed >= std::chrono::milliseconds(20));
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("stall watchdog names the blocked subscriber", "[watchdog][event_loop][scheduler]"){
+    GIVEN("a watchdog with a 20ms threshold and an event_loop with one thread"){
+        stall_log log;
+        rx::stall_watchdog watchdog(std::chrono::milliseconds(20), log.recorder());
+        rxsc::event_loop::config c;
+        c.thread_count = 1;
+        auto loop = rxsc::make_event_loop(c);
+        WHEN("a subscriber observed on the loop blocks on one value"){
+            countdown finished(1);
+            std::thread::id thread;
+            auto blocking = rx::make_subscriber<int>(
+                [&](int v){
+                    thread = std::this_thread::get_id();
+                    if (v == 2) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                },
+                [&](){finished.done();});
+            rxs::range(1, 3)
+                .observe_on(rx::observe_on_one_worker(loop))
+                .subscribe(blocking);
+            finished.wait();
+            auto reports = log.get();
+            THEN("the report named the loop thread and the subscriber"){
+                REQUIRE(reports.size() == 1);
+                REQUIRE(reports[0].thread == thread);
+                REQUIRE(reports[0].subscriber == blocking.get_id());
+            }
+        }
+        WHEN("two actions block one after the other"){
+            countdown finished(2);
+            auto w = loop.create_worker();
+            for (int i = 0; i != 2; ++i) {
+                w.schedule([&](const rxsc::schedulable&){
+                    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+                    finished.done();
+                });
+            }
+            finished.wait();
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+            auto reports = log.get();
+            THEN("each was reported, for the same worker"){
+                REQUIRE(reports.size() == 2);
+                REQUIRE(reports[0].worker == reports[1].worker);
+            }
+            w.unsubscribe();
+        }
+    }
+}
+
+#endif
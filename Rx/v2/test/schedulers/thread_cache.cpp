@@ -0,0 +1,225 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+// a thread parks after its worker has ended, so poll until the counts of
+// the cache have caught up
+template<class Predicate>
+bool eventually(Predicate p) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!p() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return p();
+}
+
+rxsc::scheduler make_cached(const rxsc::thread_cache& cache) {
+    return rxsc::make_new_thread(cache.get_factory(), rxsc::new_thread::block, rxsc::new_thread::default_priority_quota, rxsc::recursion_budget(), cache);
+}
+
+// runs one action on a new worker and returns the thread that it ran on
+std::thread::id run_once(const rxsc::scheduler& sc) {
+    auto w = sc.create_worker();
+    std::thread::id ran;
+    countdown finished(1);
+    w.schedule([&](const rxsc::schedulable&){
+        ran = std::this_thread::get_id();
+        finished.done();
+    });
+    finished.wait();
+    w.unsubscribe();
+    return ran;
+}
+
+}
+
+SCENARIO("thread_cache reuses the threads of ended workers", "[thread_cache][new_thread][scheduler]"){
+    GIVEN("a new_thread on a thread_cache"){
+        rxsc::thread_cache cache;
+        auto sc = make_cached(cache);
+        WHEN("workers are created and ended one after another"){
+            std::set<std::thread::id> threads;
+            for (int i = 0; i != 10; ++i) {
+                threads.insert(run_once(sc));
+                REQUIRE(eventually([&](){return cache.get_counts().idle == 1;}));
+            }
+            THEN("they all ran on the one thread"){
+                REQUIRE(threads.size() == 1);
+                REQUIRE(*threads.begin() != std::this_thread::get_id());
+                auto counts = cache.get_counts();
+                REQUIRE(counts.created == 1);
+                REQUIRE(counts.running == 0);
+            }
+        }
+        WHEN("a source is observed on the cached threads"){
+            std::vector<int> values;
+            countdown finished(1);
+            rxs::range(1, 100)
+                .observe_on(rx::observe_on_one_worker(sc))
+                .subscribe(
+                    [&](int v){values.push_back(v);},
+                    [&](){finished.done();});
+            finished.wait();
+            THEN("every value arrived in order"){
+                REQUIRE(values.size() == 100);
+                REQUIRE(std::is_sorted(values.begin(), values.end()));
+            }
+        }
+    }
+}
+
+SCENARIO("thread_cache keeps the settings of new_thread", "[thread_cache][new_thread][recursion][scheduler]"){
+    GIVEN("a new_thread on a thread_cache that spins and has a budget of 4 items"){
+        rxsc::thread_cache cache;
+        auto sc = rxsc::make_new_thread(cache.get_factory(), rxsc::new_thread::spin_then_park, 2, rxsc::recursion_budget(4, std::chrono::nanoseconds::zero()), cache);
+        WHEN("an action recurses 10 times"){
+            auto w = sc.create_worker();
+            int calls = 0;
+            std::thread::id thread;
+            countdown finished(1);
+            w.schedule([&](const rxsc::schedulable& self){
+                thread = std::this_thread::get_id();
+                if (++calls < 10) {
+                    self();
+                } else {
+                    finished.done();
+                }
+            });
+            finished.wait();
+            w.unsubscribe();
+            THEN("it ran on a thread of the cache"){
+                REQUIRE(calls == 10);
+                REQUIRE(thread != std::this_thread::get_id());
+                REQUIRE(cache.get_counts().created == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("event_loop takes its threads from a thread_cache", "[thread_cache][event_loop][scheduler]"){
+    GIVEN("a thread_cache with one parked thread"){
+        rxsc::thread_cache cache;
+        auto parked = run_once(make_cached(cache));
+        REQUIRE(eventually([&](){return cache.get_counts().idle == 1;}));
+        WHEN("an event_loop with one thread is given the cache"){
+            rxsc::event_loop::config c;
+            c.thread_count = 1;
+            c.cache = std::make_shared<rxsc::thread_cache>(cache);
+            auto loop = rxsc::make_event_loop(c);
+            auto ran = run_once(loop);
+            THEN("the loop runs on the parked thread"){
+                REQUIRE(ran == parked);
+                auto counts = cache.get_counts();
+                REQUIRE(counts.created == 1);
+                REQUIRE(counts.running == 1);
+            }
+        }
+        WHEN("the event_loop thread is pinned"){
+            rxsc::event_loop::config c;
+            c.thread_count = 1;
+            c.cpus.push_back(std::vector<int>(1, 0));
+            c.cache = std::make_shared<rxsc::thread_cache>(cache);
+            auto loop = rxsc::make_event_loop(c);
+            auto ran = run_once(loop);
+            THEN("the loop has a thread of its own"){
+                REQUIRE(ran != parked);
+                REQUIRE(cache.get_counts().idle == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("thread_cache limits its threads", "[thread_cache][new_thread][scheduler]"){
+    GIVEN("a thread_cache of 2 threads with a short keep alive"){
+        rxsc::thread_cache::config c;
+        c.max_threads = 2;
+        c.max_idle = 1;
+        c.keep_alive = std::chrono::milliseconds(20);
+        rxsc::thread_cache cache(c);
+        auto sc = make_cached(cache);
+        WHEN("3 workers run at once"){
+            std::promise<void> release;
+            auto gate = release.get_future().share();
+            countdown started(3);
+            countdown finished(3);
+            std::vector<rxsc::worker> workers;
+            for (int i = 0; i != 3; ++i) {
+                workers.push_back(sc.create_worker());
+                workers.back().schedule([&, gate](const rxsc::schedulable&){
+                    started.done();
+                    gate.wait();
+                    finished.done();
+                });
+            }
+            started.wait();
+            auto busy = cache.get_counts();
+            release.set_value();
+            finished.wait();
+            for (auto& w : workers) {
+                w.unsubscribe();
+            }
+            THEN("the third had a thread of its own"){
+                REQUIRE(busy.running == 2);
+                REQUIRE(busy.created == 2);
+            }
+            THEN("only max_idle threads were kept, and only for the keep alive"){
+                REQUIRE(eventually([&](){return cache.get_counts().running == 0;}));
+                REQUIRE(cache.get_counts().idle <= 1);
+                REQUIRE(eventually([&](){return cache.get_counts().idle == 0;}));
+            }
+        }
+    }
+}
+
+SCENARIO("new_thread churn", "[hide][thread_cache][new_thread][scheduler][long][perf]"){
+    GIVEN("short-lived subscriptions observed on new threads"){
+        WHEN("each subscription creates and ends a worker"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int count = 20000;
+            auto churn = [&](const char* label, rx::observe_on_one_worker coordination){
+                auto start = clock::now();
+                for (int i = 0; i != count; ++i) {
+                    countdown finished(1);
+                    rxs::range(i, i)
+                        .observe_on(coordination)
+                        .subscribe(
+                            [](int){},
+                            [&](){finished.done();});
+                    finished.wait();
+                }
+                auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+                std::cout << label << count << " subscriptions, " << msElapsed.count() << "ms elapsed, " << count / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " subscriptions/sec" << std::endl;
+            };
+            for (int runs = 0; runs != 3; ++runs) {
+                churn("new_thread        : ", rx::observe_on_new_thread());
+                churn("cached new_thread : ", rx::observe_on_cached_new_thread());
+            }
+        }
+        WHEN("workers are created and ended directly"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int count = 20000;
+            auto churn = [&](const char* label, rxsc::scheduler sc){
+                auto start = clock::now();
+                for (int i = 0; i != count; ++i) {
+                    run_once(sc);
+                }
+                auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+                std::cout << label << count << " workers, " << msElapsed.count() << "ms elapsed, " << count / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " workers/sec" << std::endl;
+            };
+            for (int runs = 0; runs != 3; ++runs) {
+                churn("new_thread        : ", rxsc::make_new_thread());
+                churn("cached new_thread : ", rxsc::make_cached_new_thread());
+            }
+        }
+    }
+}
@@ -0,0 +1,338 @@
+#include "rxcpp/rx.hpp"
+#include "rxcpp/rx-test.hpp"
+namespace rx=rxcpp;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+
+#include <random>
+
+namespace {
+
+typedef rxsc::detail::time_schedulable<long> long_item;
+typedef rxsc::detail::schedulable_queue<long> long_heap;
+typedef rxsc::detail::timing_wheel_queue<long> long_wheel;
+
+rxsc::schedulable make_item(const rxsc::worker& w, rx::composite_subscription cs = rx::composite_subscription()) {
+    return rxsc::make_schedulable(w, cs, [](const rxsc::schedulable&){});
+}
+
+bool same(const rxsc::schedulable& lhs, const rxsc::schedulable& rhs) {
+    return lhs.get_subscription() == rhs.get_subscription();
+}
+
+// pushes timeouts, cancels most of them soon after and then pops them
+// all, returning the number that were still subscribed. peak is the
+// largest size of the queue.
+template<class Queue, class Item>
+int timeouts(Queue& q, std::vector<Item>& items, size_t& peak) {
+    const int count = static_cast<int>(items.size());
+    peak = 0;
+    for (int i = 0; i < count; ++i) {
+        q.push(items[i]);
+        peak = std::max(peak, q.size());
+        // nine in ten timeouts are cancelled soon after
+        if (i % 10 != 0 && i >= 16) {
+            items[i - 16].what.unsubscribe();
+        }
+    }
+    int ran = 0;
+    while (!q.empty()) {
+        if (q.top().what.is_subscribed()) {
+            ++ran;
+        }
+        q.pop();
+    }
+    return ran;
+}
+
+template<class Queue>
+void require_compacted(Queue& q, const rxsc::worker& w) {
+    std::vector<long_item> items;
+    for (long i = 0; i < 10000; ++i) {
+        items.push_back(long_item(1000000 + i, make_item(w)));
+    }
+    size_t peak = 0;
+    auto ran = timeouts(q, items, peak);
+    // one in ten is kept, and the last 16 were never cancelled
+    const int live = 1000 + 14;
+    REQUIRE(ran == live);
+    REQUIRE(peak <= 2 * live + 64);
+}
+
+}
+
+SCENARIO("timing_wheel_queue order", "[timing_wheel][scheduler]"){
+    GIVEN("a timing_wheel_queue and a schedulable_queue"){
+        auto w = rxsc::make_current_thread().create_worker();
+        WHEN("the same items are pushed and popped from both"){
+            std::mt19937 gen(42);
+            // a mix of near, far and equal times
+            std::uniform_int_distribution<long> near(0, 200);
+            std::uniform_int_distribution<long> far(0, 1L << 30);
+
+            long_heap heap;
+            long_wheel wheel;
+            long now = 0;
+            for (int round = 0; round < 50; ++round) {
+                for (int i = 0; i < 100; ++i) {
+                    auto when = now + (i % 10 == 0 ? far(gen) : near(gen));
+                    auto s = make_item(w);
+                    heap.push(long_item(when, s));
+                    wheel.push(long_item(when, s));
+                }
+                for (int i = 0; i < 60 && !heap.empty(); ++i) {
+                    REQUIRE(!wheel.empty());
+                    REQUIRE(heap.top().when == wheel.top().when);
+                    REQUIRE(same(heap.top().what, wheel.top().what));
+                    now = heap.top().when;
+                    heap.pop();
+                    wheel.pop();
+                }
+            }
+            THEN("they come out in the same order"){
+                while (!heap.empty()) {
+                    REQUIRE(!wheel.empty());
+                    REQUIRE(heap.top().when == wheel.top().when);
+                    REQUIRE(same(heap.top().what, wheel.top().what));
+                    heap.pop();
+                    wheel.pop();
+                }
+                REQUIRE(wheel.empty());
+            }
+        }
+        WHEN("items with equal times are pushed"){
+            long_wheel wheel(10);
+            std::vector<rxsc::schedulable> items;
+            for (int i = 0; i < 5; ++i) {
+                items.push_back(make_item(w));
+                wheel.push(long_item(i < 3 ? 100 : 95, items.back()));
+            }
+            THEN("they come out in time then fifo order"){
+                std::vector<rxsc::schedulable> expected = {items[3], items[4], items[0], items[1], items[2]};
+                for (auto& e : expected) {
+                    REQUIRE(same(wheel.top().what, e));
+                    wheel.pop();
+                }
+                REQUIRE(wheel.empty());
+            }
+        }
+        WHEN("an item earlier than the last top is pushed"){
+            long_wheel wheel;
+            auto late = make_item(w);
+            auto early = make_item(w);
+            wheel.push(long_item(1000, late));
+            REQUIRE(same(wheel.top().what, late));
+            wheel.push(long_item(10, early));
+            THEN("it comes out first"){
+                REQUIRE(same(wheel.top().what, early));
+                wheel.pop();
+                REQUIRE(same(wheel.top().what, late));
+                wheel.pop();
+                REQUIRE(wheel.empty());
+            }
+        }
+    }
+}
+
+SCENARIO("timing_wheel_queue clock resolution", "[timing_wheel][scheduler]"){
+    GIVEN("timing_wheel_queues over the scheduler clock"){
+        typedef rxsc::scheduler::clock_type::time_point time_point;
+        typedef rxsc::detail::time_schedulable<time_point> item;
+        auto w = rxsc::make_current_thread().create_worker();
+        auto start = w.now();
+        WHEN("items a microsecond to a day apart are pushed out of order"){
+            std::vector<std::chrono::microseconds> offsets = {
+                std::chrono::hours(24), std::chrono::microseconds(1), std::chrono::seconds(3),
+                std::chrono::milliseconds(1), std::chrono::microseconds(0), std::chrono::microseconds(2)};
+            THEN("every resolution returns them in time order"){
+                std::vector<std::chrono::nanoseconds> resolutions = {
+                    std::chrono::nanoseconds(1), std::chrono::microseconds(100),
+                    std::chrono::milliseconds(1), std::chrono::seconds(1)};
+                for (auto r : resolutions) {
+                    rxsc::detail::timing_wheel_queue<time_point> wheel(std::chrono::duration_cast<time_point::duration>(r));
+                    for (auto o : offsets) {
+                        wheel.push(item(start + o, make_item(w)));
+                    }
+                    auto sorted = offsets;
+                    std::sort(sorted.begin(), sorted.end());
+                    for (auto o : sorted) {
+                        REQUIRE(!wheel.empty());
+                        REQUIRE(wheel.top().when == start + o);
+                        wheel.pop();
+                    }
+                    REQUIRE(wheel.empty());
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("timing_wheel_queue drops unsubscribed items", "[timing_wheel][scheduler]"){
+    GIVEN("a timing_wheel_queue with 1000 timeouts"){
+        auto w = rxsc::make_current_thread().create_worker();
+        long_wheel wheel;
+        std::vector<rx::composite_subscription> timeouts;
+        for (long i = 0; i < 1000; ++i) {
+            timeouts.push_back(rx::composite_subscription());
+            wheel.push(long_item(10 + i * 1000, make_item(w, timeouts.back())));
+        }
+        auto last = make_item(w);
+        wheel.push(long_item(2000000, last));
+        REQUIRE(wheel.size() == 1001);
+        WHEN("the timeouts are unsubscribed"){
+            for (auto& cs : timeouts) {
+                cs.unsubscribe();
+            }
+            THEN("they are dropped without being returned"){
+                REQUIRE(!wheel.empty());
+                REQUIRE(same(wheel.top().what, last));
+                REQUIRE(wheel.size() == 1);
+                wheel.pop();
+                REQUIRE(wheel.empty());
+            }
+        }
+        WHEN("all the items are unsubscribed"){
+            for (auto& cs : timeouts) {
+                cs.unsubscribe();
+            }
+            last.unsubscribe();
+            THEN("the queue is empty"){
+                REQUIRE(wheel.empty());
+                REQUIRE(wheel.size() == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("timed queues compact unsubscribed items", "[timing_wheel][scheduler]"){
+    GIVEN("a schedulable_queue and a timing_wheel_queue"){
+        auto w = rxsc::make_current_thread().create_worker();
+        WHEN("most timeouts are cancelled soon after they are pushed"){
+            long_heap heap;
+            long_wheel wheel;
+            THEN("the queues only grow with the live timeouts"){
+                require_compacted(heap, w);
+                require_compacted(wheel, w);
+            }
+        }
+        WHEN("some far timeouts are cancelled"){
+            long_heap heap;
+            long_wheel wheel;
+            std::vector<rx::composite_subscription> cancelled;
+            for (long i = 0; i < 40; ++i) {
+                rx::composite_subscription cs;
+                auto item = long_item(1L << (i % 30), make_item(w, cs));
+                heap.push(item);
+                wheel.push(item);
+                if (i % 4 != 0) {
+                    cancelled.push_back(cs);
+                }
+            }
+            for (auto& cs : cancelled) {
+                cs.unsubscribe();
+            }
+            THEN("they are counted as dead until they are compacted"){
+                REQUIRE(heap.count().live == 10);
+                REQUIRE(heap.count().dead == 30);
+                REQUIRE(wheel.count().live == 10);
+                REQUIRE(wheel.count().dead == 30);
+                REQUIRE(heap.compact() == 30);
+                REQUIRE(wheel.compact() == 30);
+                REQUIRE(heap.size() == 10);
+                REQUIRE(wheel.size() == 10);
+                REQUIRE(heap.count().dead == 0);
+                REQUIRE(wheel.count().dead == 0);
+                while (!heap.empty()) {
+                    REQUIRE(!wheel.empty());
+                    REQUIRE(same(heap.top().what, wheel.top().what));
+                    heap.pop();
+                    wheel.pop();
+                }
+                REQUIRE(wheel.empty());
+            }
+        }
+    }
+}
+
+SCENARIO("virtual_time queues end with the action", "[virtual_time][scheduler]"){
+    GIVEN("a virtual time scheduler with 100 actions queued"){
+        rxsc::detail::test_type::test_type_state vt;
+        auto w = rxsc::make_current_thread().create_worker();
+        std::vector<rx::composite_subscription> lifetimes;
+        int ran = 0;
+        for (long i = 0; i < 100; ++i) {
+            lifetimes.push_back(rx::composite_subscription());
+            vt.schedule_absolute(1000 + i, rxsc::make_schedulable(w, lifetimes.back(), [&](const rxsc::schedulable&){
+                ++ran;
+            }));
+        }
+        WHEN("90 of them are unsubscribed"){
+            for (long i = 0; i < 100; ++i) {
+                if (i % 10 != 0) {
+                    lifetimes[i].unsubscribe();
+                }
+            }
+            THEN("their queue entries are dead and the rest still run"){
+                REQUIRE(vt.queue.count().live == 10);
+                REQUIRE(vt.queue.count().dead == 90);
+                REQUIRE(vt.queue.compact() == 90);
+                vt.start();
+                REQUIRE(ran == 10);
+            }
+        }
+    }
+}
+
+SCENARIO("timing_wheel_queue timeouts", "[hide][timing_wheel][scheduler][long][perf]"){
+    GIVEN("a schedulable_queue and a timing_wheel_queue"){
+        WHEN("timeouts are pushed and most are cancelled before they are due"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+            typedef rxsc::scheduler::clock_type::time_point time_point;
+            typedef rxsc::detail::time_schedulable<time_point> item;
+
+            const int count = 500000;
+            auto w = rxsc::make_current_thread().create_worker();
+            auto base = w.now();
+
+            std::mt19937 gen(42);
+            std::uniform_int_distribution<int> spread(0, 30000);
+            std::vector<milliseconds> after;
+            for (int i = 0; i < count; ++i) {
+                // timeouts of up to 30s, at millisecond resolution
+                after.push_back(milliseconds(spread(gen)));
+            }
+
+            auto items = [&](){
+                std::vector<item> result;
+                for (auto a : after) {
+                    result.push_back(item(base + a, make_item(w)));
+                }
+                return result;
+            };
+            size_t peak = 0;
+            auto report = [&](const char* label, clock::time_point start, int ran) {
+                auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+                std::cout << label << count << " timeouts, " << ran << " ran, " << msElapsed.count() << "ms elapsed, " << count / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec, peak size " << peak << std::endl;
+            };
+
+            for (int runs = 0; runs < 3; ++runs) {
+                {
+                    auto timed = items();
+                    rxsc::detail::schedulable_queue<time_point> heap;
+                    auto start = clock::now();
+                    auto ran = timeouts(heap, timed, peak);
+                    report("schedulable_queue  : ", start, ran);
+                }
+                {
+                    auto timed = items();
+                    rxsc::detail::timing_wheel_queue<time_point> wheel;
+                    auto start = clock::now();
+                    auto ran = timeouts(wheel, timed, peak);
+                    report("timing_wheel_queue : ", start, ran);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,246 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+namespace {
+
+rxsc::scheduler make_pool(size_t count) {
+    return rxsc::make_work_stealing([](std::function<void()> start){
+        return std::thread(std::move(start));
+    }, count);
+}
+
+}
+
+SCENARIO("work_stealing runs the actions of a worker in order", "[work_stealing][scheduler]"){
+    GIVEN("a work_stealing scheduler with 4 threads"){
+        auto sc = make_pool(4);
+        WHEN("10K actions are scheduled on one worker"){
+            const int count = 10000;
+            auto w = sc.create_worker();
+            std::vector<int> order;
+            countdown finished(1);
+            for (int i = 0; i < count; ++i) {
+                w.schedule([&, i](const rxsc::schedulable&){
+                    order.push_back(i);
+                    if (i == count - 1) {
+                        finished.done();
+                    }
+                });
+            }
+            finished.wait();
+            THEN("they ran in the order they were scheduled"){
+                REQUIRE(order.size() == count);
+                bool inorder = true;
+                for (int i = 0; i < count; ++i) {
+                    inorder = inorder && order[i] == i;
+                }
+                REQUIRE(inorder);
+            }
+        }
+    }
+}
+
+SCENARIO("work_stealing forwards current_thread to the running worker", "[work_stealing][scheduler]"){
+    GIVEN("a work_stealing scheduler with 2 threads"){
+        auto sc = make_pool(2);
+        WHEN("current_thread is used in an action"){
+            auto w = sc.create_worker();
+            std::vector<int> order;
+            countdown finished(1);
+            w.schedule([&](const rxsc::schedulable&){
+                rxsc::make_current_thread().create_worker().schedule([&](const rxsc::schedulable&){
+                    order.push_back(2);
+                    finished.done();
+                });
+                order.push_back(1);
+            });
+            finished.wait();
+            THEN("it queued onto the worker instead of running inline"){
+                REQUIRE(order == std::vector<int>({1, 2}));
+            }
+            w.unsubscribe();
+        }
+    }
+}
+
+SCENARIO("work_stealing never overlaps the actions of a worker", "[work_stealing][scheduler]"){
+    GIVEN("a work_stealing scheduler with 4 threads"){
+        auto sc = make_pool(4);
+        WHEN("16 workers are scheduled from 4 threads"){
+            const int workers = 16;
+            const int actions = 2000;
+            std::vector<rxsc::worker> w;
+            std::unique_ptr<std::atomic<int>[]> running(new std::atomic<int>[workers]);
+            std::unique_ptr<int[]> ran(new int[workers]);
+            for (int i = 0; i < workers; ++i) {
+                w.push_back(sc.create_worker());
+                running[i] = 0;
+                ran[i] = 0;
+            }
+            std::atomic<bool> overlapped(false);
+            countdown finished(workers * actions);
+            std::vector<std::thread> producers;
+            for (int p = 0; p < 4; ++p) {
+                producers.emplace_back([&, p](){
+                    for (int n = 0; n < actions; ++n) {
+                        for (int i = p; i < workers; i += 4) {
+                            w[i].schedule([&, i](const rxsc::schedulable&){
+                                if (running[i].fetch_add(1) != 0) {
+                                    overlapped = true;
+                                }
+                                ++ran[i];
+                                running[i].fetch_sub(1);
+                                finished.done();
+                            });
+                        }
+                    }
+                });
+            }
+            for (auto& t : producers) {
+                t.join();
+            }
+            finished.wait();
+            THEN("every action ran once with no overlap"){
+                REQUIRE(!overlapped);
+                for (int i = 0; i < workers; ++i) {
+                    REQUIRE(ran[i] == actions);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("work_stealing runs delayed actions in time order", "[work_stealing][scheduler]"){
+    GIVEN("a work_stealing scheduler"){
+        auto sc = make_pool(2);
+        WHEN("actions are scheduled out of time order"){
+            auto w = sc.create_worker();
+            std::vector<int> order;
+            countdown finished(3);
+            auto start = w.now();
+            w.schedule(start + std::chrono::milliseconds(30), [&](const rxsc::schedulable&){
+                order.push_back(3);
+                finished.done();
+            });
+            w.schedule(start + std::chrono::milliseconds(10), [&](const rxsc::schedulable&){
+                order.push_back(1);
+                finished.done();
+            });
+            w.schedule(start + std::chrono::milliseconds(20), [&](const rxsc::schedulable&){
+                order.push_back(2);
+                finished.done();
+            });
+            finished.wait();
+            THEN("they ran in time order, no earlier than requested"){
+                REQUIRE(order == std::vector<int>({1, 2, 3}));
+                REQUIRE(w.now() >= start + std::chrono::milliseconds(30));
+            }
+        }
+        WHEN("the worker is unsubscribed before a delayed action"){
+            auto w = sc.create_worker();
+            std::atomic<bool> ran(false);
+            w.schedule(w.now() + std::chrono::milliseconds(10), [&](const rxsc::schedulable&){
+                ran = true;
+            });
+            w.unsubscribe();
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            THEN("the action did not run"){
+                REQUIRE(!ran);
+            }
+        }
+    }
+}
+
+SCENARIO("observe_on and subscribe_on work_stealing", "[work_stealing][observe_on][subscribe_on]"){
+    GIVEN("a range"){
+        WHEN("observed on work_stealing"){
+            auto sum = rxs::range(1, 1000)
+                .observe_on(rx::observe_on_work_stealing())
+                .sum()
+                .as_blocking()
+                .last();
+            THEN("all the values arrive"){
+                REQUIRE(sum == 500500);
+            }
+        }
+        WHEN("subscribed on work_stealing"){
+            auto sum = rxs::range(1, 1000)
+                .subscribe_on(rx::serialize_work_stealing())
+                .sum()
+                .as_blocking()
+                .last();
+            THEN("all the values arrive"){
+                REQUIRE(sum == 500500);
+            }
+        }
+    }
+}
+
+SCENARIO("work_stealing skewed load", "[hide][work_stealing][event_loop][scheduler][long][perf]"){
+    GIVEN("event_loop and work_stealing"){
+        WHEN("most of the actions go to workers on the same event_loop thread"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            // the number of threads that event_loop uses
+            const int threads = std::max(std::thread::hardware_concurrency(), unsigned(4)) - 1;
+            const int workers = threads * 4;
+            const int actions = 20000;
+
+            auto tf = [](std::function<void()> start){
+                return std::thread(std::move(start));
+            };
+
+            auto run = [&](const char* label, rxsc::scheduler sc) {
+                std::vector<rxsc::worker> w;
+                for (int i = 0; i < workers; ++i) {
+                    w.push_back(sc.create_worker());
+                }
+                // workers are handed out round-robin by event_loop, so every
+                // threads'th worker shares one thread. give those workers the
+                // bulk of the load.
+                int total = 0;
+                std::vector<int> load(workers, actions / 100);
+                for (int i = 0; i < workers; i += threads) {
+                    load[i] = actions;
+                }
+                for (auto l : load) {
+                    total += l;
+                }
+                countdown finished(total);
+                auto start = clock::now();
+                for (int n = 0; n < actions; ++n) {
+                    for (int i = 0; i < workers; ++i) {
+                        if (n < load[i]) {
+                            w[i].schedule([&](const rxsc::schedulable&){
+                                // a little work for each action
+                                volatile int spin = 0;
+                                for (int s = 0; s < 500; ++s) {
+                                    spin = spin + s;
+                                }
+                                finished.done();
+                            });
+                        }
+                    }
+                }
+                finished.wait();
+                auto finish = clock::now();
+                auto msElapsed = duration_cast<milliseconds>(finish-start);
+                std::cout << label << total << " actions on " << workers << " workers, " << msElapsed.count() << "ms elapsed, " << total / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+                for (auto& wk : w) {
+                    wk.unsubscribe();
+                }
+            };
+
+            for (int runs = 0; runs < 3; ++runs) {
+                run("event_loop    skewed : ", rxsc::make_event_loop(tf));
+                run("work_stealing skewed : ", rxsc::make_work_stealing(tf, threads));
+            }
+        }
+    }
+}
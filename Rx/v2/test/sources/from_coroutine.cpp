@@ -0,0 +1,238 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+namespace rxsub=rxcpp::subjects;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+#if RXCPP_USE_COROUTINES
+
+namespace {
+
+// a coroutine that is started eagerly and owns itself
+struct fire_and_forget
+{
+    struct promise_type
+    {
+        fire_and_forget get_return_object() {return {};}
+        std::suspend_never initial_suspend() const noexcept {return {};}
+        std::suspend_never final_suspend() const noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {std::terminate();}
+    };
+};
+
+rx::async_generator<int> count_to(int last) {
+    for (int i = 1; i <= last; ++i) {
+        co_yield i;
+    }
+}
+
+// counts the live frames of ticks()
+std::atomic<int> live_ticks(0);
+
+struct live_tick
+{
+    live_tick() {++live_ticks;}
+    ~live_tick() {--live_ticks;}
+};
+
+rx::async_generator<int> ticks(rxsc::worker w, std::chrono::milliseconds period) {
+    live_tick live;
+    for (int i = 0;; ++i) {
+        co_yield i;
+        co_await rx::resume_after(w, period);
+    }
+}
+
+// counts the live frames of forward_from()
+std::atomic<int> live_forwards(0);
+
+struct live_forward
+{
+    live_forward() {++live_forwards;}
+    ~live_forward() {--live_forwards;}
+};
+
+rx::async_generator<int> forward_from(rx::observable<int> source) {
+    live_forward live;
+    auto reader = rx::make_async_reader(source);
+    while (auto v = co_await reader.next()) {
+        co_yield *v;
+    }
+}
+
+fire_and_forget hop_to(rxsc::worker w, std::thread::id& resumed, countdown& finished) {
+    co_await rx::resume_on(w);
+    resumed = std::this_thread::get_id();
+    finished.done();
+}
+
+fire_and_forget sum_of(rx::async_reader<int> reader, int& sum, std::string& error, countdown& finished) {
+    try {
+        while (auto v = co_await reader.next()) {
+            sum += *v;
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    finished.done();
+}
+
+}
+
+SCENARIO("co_await resume_on hops to the worker", "[coroutine][scheduler]"){
+    GIVEN("a new_thread worker"){
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("a coroutine awaits resume_on"){
+            std::thread::id resumed;
+            countdown finished(1);
+            hop_to(w, resumed, finished);
+            THEN("it continued on the worker thread"){
+                REQUIRE(finished.wait_for(std::chrono::seconds(5)));
+                REQUIRE(resumed != std::thread::id());
+                REQUIRE(resumed != std::this_thread::get_id());
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("from_coroutine emits what the coroutine yields", "[coroutine][from_coroutine][sources]"){
+    GIVEN("a coroutine that yields 1 to 5"){
+        auto source = rxs::from_coroutine([](){return count_to(5);});
+        WHEN("it is subscribed twice"){
+            std::vector<int> values;
+            int completions = 0;
+            auto collect = [&](){
+                source.subscribe(
+                    [&](int v){values.push_back(v);},
+                    [&](){++completions;});
+            };
+            collect();
+            collect();
+            THEN("each subscription ran its own coroutine to completion"){
+                REQUIRE(values == std::vector<int>({1, 2, 3, 4, 5, 1, 2, 3, 4, 5}));
+                REQUIRE(completions == 2);
+            }
+        }
+        WHEN("the subscriber takes 3"){
+            std::vector<int> values;
+            source.take(3).subscribe([&](int v){values.push_back(v);});
+            THEN("the coroutine stopped at the next co_yield"){
+                REQUIRE(values == std::vector<int>({1, 2, 3}));
+            }
+        }
+    }
+    GIVEN("a coroutine that throws"){
+        auto source = rxs::from_coroutine([]() -> rx::async_generator<int> {
+            co_yield 1;
+            throw std::runtime_error("producer failed");
+        });
+        WHEN("it is subscribed"){
+            std::vector<int> values;
+            std::string error;
+            source.subscribe(
+                [&](int v){values.push_back(v);},
+                [&](std::exception_ptr e){
+                    try {std::rethrow_exception(e);} catch (const std::exception& ex) {error = ex.what();}
+                });
+            THEN("on_error was called"){
+                REQUIRE(values == std::vector<int>({1}));
+                REQUIRE(error == "producer failed");
+            }
+        }
+    }
+}
+
+SCENARIO("suspended coroutine producers do not hold threads", "[coroutine][from_coroutine][sources]"){
+    GIVEN("many timed producers that share one new_thread worker"){
+        auto w = rxsc::make_new_thread().create_worker();
+        const int producers = 200;
+        const int each = 5;
+        WHEN("each producer yields, then waits on the worker"){
+            std::mutex lock;
+            std::set<std::thread::id> threads;
+            countdown finished(producers);
+            rx::composite_subscription subscriptions;
+            for (int p = 0; p < producers; ++p) {
+                subscriptions.add(rxs::from_coroutine([w](){return ticks(w, std::chrono::milliseconds(1));}, rx::identity_one_worker(rxsc::make_same_worker(w)))
+                    .take(each)
+                    .subscribe(
+                        [&](int){
+                            std::unique_lock<std::mutex> guard(lock);
+                            threads.insert(std::this_thread::get_id());
+                        },
+                        [&](){finished.done();}));
+            }
+            THEN("they all completed on the one worker thread and their frames were freed"){
+                REQUIRE(finished.wait_for(std::chrono::seconds(10)));
+                REQUIRE(threads.size() == 1);
+                // the last frame is freed when its queued hop is dropped
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                while (live_ticks != 0 && std::chrono::steady_clock::now() < deadline) {
+                    std::this_thread::yield();
+                }
+                REQUIRE(live_ticks == 0);
+            }
+            subscriptions.unsubscribe();
+        }
+        w.unsubscribe();
+    }
+}
+
+SCENARIO("async_reader awaits the values of an observable", "[coroutine][async_reader]"){
+    GIVEN("a synchronous range"){
+        WHEN("a coroutine sums it"){
+            int sum = 0;
+            std::string error;
+            countdown finished(1);
+            sum_of(rx::make_async_reader(rxs::range(1, 100)), sum, error, finished);
+            THEN("every value was read"){
+                REQUIRE(finished.wait_for(std::chrono::seconds(5)));
+                REQUIRE(sum == 5050);
+                REQUIRE(error.empty());
+            }
+        }
+    }
+    GIVEN("a producer that forwards a subject"){
+        rxsub::subject<int> input;
+        auto source = rxs::from_coroutine([&](){return forward_from(input.get_observable().as_dynamic());});
+        WHEN("it is unsubscribed while it waits for the next value"){
+            std::vector<int> values;
+            rx::composite_subscription lifetime;
+            source.subscribe(lifetime, [&](int v){values.push_back(v);});
+            input.get_subscriber().on_next(1);
+            REQUIRE(live_forwards == 1);
+            lifetime.unsubscribe();
+            auto freed = live_forwards == 0;
+            input.get_subscriber().on_next(2);
+            THEN("its frame was freed without another value and later values were not read"){
+                REQUIRE(freed);
+                REQUIRE(values == std::vector<int>({1}));
+                REQUIRE(live_forwards == 0);
+            }
+        }
+    }
+    GIVEN("values from another thread and a worker to resume on"){
+        auto w = rxsc::make_new_thread().create_worker();
+        WHEN("a coroutine sums them and then sees the error"){
+            int sum = 0;
+            std::string error;
+            countdown finished(1);
+            auto source = rxs::range(1, 10, rx::observe_on_new_thread())
+                .concat(rx::observable<>::error<int>(std::runtime_error("source failed")));
+            sum_of(rx::make_async_reader(source, w), sum, error, finished);
+            THEN("the values arrived and the error was rethrown"){
+                REQUIRE(finished.wait_for(std::chrono::seconds(5)));
+                REQUIRE(sum == 55);
+                REQUIRE(error == "source failed");
+            }
+        }
+        w.unsubscribe();
+    }
+}
+
+#endif
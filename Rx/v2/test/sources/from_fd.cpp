@@ -0,0 +1,164 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rxcpp::sources;
+namespace rxsc=rxcpp::schedulers;
+
+#include "catch.hpp"
+#include "../countdown.hpp"
+
+#if RXCPP_USE_EPOLL
+
+#include <sys/socket.h>
+#include <fcntl.h>
+
+namespace {
+
+struct pipe_fds
+{
+    int read;
+    int write;
+    pipe_fds() {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+            abort();
+        }
+        read = fds[0];
+        write = fds[1];
+    }
+    ~pipe_fds() {
+        close(read);
+        close(write);
+    }
+};
+
+}
+
+SCENARIO("from_fd emits when a pipe is readable", "[from_fd][reactor][sources]"){
+    GIVEN("a reactor and a pipe"){
+        rxsc::reactor loop;
+        pipe_fds p;
+        WHEN("bytes are written to the pipe"){
+            std::string received;
+            std::thread::id thread;
+            countdown finished(1);
+            auto subscription = rx::observable<>::from_fd(p.read, EPOLLIN, loop)
+                .subscribe([&](uint32_t events){
+                    thread = std::this_thread::get_id();
+                    if (events & EPOLLIN) {
+                        char buffer[64];
+                        ssize_t n;
+                        // level triggered, so read until it would block
+                        while ((n = read(p.read, buffer, sizeof(buffer))) > 0) {
+                            received.append(buffer, n);
+                        }
+                        if (received == "hello, world") {
+                            finished.done();
+                        }
+                    }
+                });
+            REQUIRE(write(p.write, "hello, ", 7) == 7);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            REQUIRE(write(p.write, "world", 5) == 5);
+            THEN("the bytes are read on the loop thread"){
+                REQUIRE(finished.wait_for(std::chrono::seconds(5)));
+                REQUIRE(thread != std::this_thread::get_id());
+            }
+            subscription.unsubscribe();
+        }
+        WHEN("the subscription ends"){
+            std::atomic<int> calls(0);
+            auto subscription = rx::observable<>::from_fd(p.read, EPOLLIN, loop)
+                .subscribe([&](uint32_t){
+                    ++calls;
+                    char buffer[64];
+                    while (read(p.read, buffer, sizeof(buffer)) > 0) {
+                    }
+                });
+            subscription.unsubscribe();
+            // let the loop remove the fd
+            countdown removed(1);
+            loop.get_scheduler().create_worker().schedule([&](const rxsc::schedulable&){
+                removed.done();
+            });
+            REQUIRE(removed.wait_for(std::chrono::seconds(5)));
+            REQUIRE(write(p.write, "x", 1) == 1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            THEN("no more events arrive"){
+                REQUIRE(calls == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("from_fd reports an fd that cannot be watched", "[from_fd][reactor][sources]"){
+    GIVEN("a reactor"){
+        rxsc::reactor loop;
+        WHEN("a closed fd is watched"){
+            countdown finished(1);
+            bool errored = false;
+            rx::observable<>::from_fd(-1, EPOLLIN, loop)
+                .subscribe(
+                    [](uint32_t){},
+                    [&](std::exception_ptr){
+                        errored = true;
+                        finished.done();
+                    });
+            THEN("on_error is called"){
+                REQUIRE(finished.wait_for(std::chrono::seconds(5)));
+                REQUIRE(errored);
+            }
+        }
+    }
+}
+
+SCENARIO("one reactor thread serves many socketpairs", "[from_fd][reactor][sources]"){
+    GIVEN("a reactor and 200 socketpairs"){
+        rxsc::reactor loop;
+        const int pairs = 200;
+        std::vector<std::array<int, 2>> sockets(pairs);
+        for (auto& s : sockets) {
+            REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, s.data()) == 0);
+        }
+        WHEN("each socket echoes what it reads back to its peer"){
+            std::set<std::thread::id> threads;
+            countdown finished(pairs);
+            rx::composite_subscription echoes;
+            for (int i = 0; i < pairs; ++i) {
+                auto fd = sockets[i][0];
+                echoes.add(rx::observable<>::from_fd(fd, EPOLLIN, loop)
+                    .subscribe([&, fd](uint32_t){
+                        threads.insert(std::this_thread::get_id());
+                        char buffer[64];
+                        ssize_t n;
+                        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+                            if (write(fd, buffer, n) != n) {
+                                abort();
+                            }
+                        }
+                    }));
+                echoes.add(rx::observable<>::from_fd(sockets[i][1], EPOLLIN, loop)
+                    .subscribe([&, i](uint32_t){
+                        char buffer[64];
+                        auto n = read(sockets[i][1], buffer, sizeof(buffer));
+                        if (n == 4 && std::string(buffer, 4) == "ping") {
+                            finished.done();
+                        }
+                    }));
+            }
+            for (auto& s : sockets) {
+                REQUIRE(write(s[1], "ping", 4) == 4);
+            }
+            THEN("every peer gets its echo from the one loop thread"){
+                REQUIRE(finished.wait_for(std::chrono::seconds(5)));
+                REQUIRE(threads.size() == 1);
+            }
+            echoes.unsubscribe();
+        }
+        for (auto& s : sockets) {
+            close(s[0]);
+            close(s[1]);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,476 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+namespace rxs=rx::rxs;
+namespace rxsc=rx::rxsc;
+
+#include "catch.hpp"
+
+// these tests replace the global operator new, so they are built into
+// binaries of their own rather than into the self test.
+
+// count the allocations made on each thread so that tests can measure
+// the allocations made by a block of code.
+static long& thread_allocations() {
+    static RXCPP_THREAD_LOCAL long allocations;
+    return allocations;
+}
+void* operator new(size_t size) {
+    ++thread_allocations();
+    if (void* p = malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+SCENARIO("subscription composite allocations", "[subscription][allocations]"){
+    GIVEN("a composite_subscription"){
+        WHEN("created"){
+            auto before = thread_allocations();
+            rx::composite_subscription cs;
+            auto after = thread_allocations();
+            THEN("the composite and its subscription share one allocation"){
+#if RXCPP_USE_OBJECT_POOL
+                // the pool takes the state without an allocation
+                REQUIRE((after - before) == 0);
+#else
+                REQUIRE((after - before) == 1);
+#endif
+            }
+        }
+        WHEN("up to 4 children are added"){
+            rx::composite_subscription cs;
+            rx::composite_subscription children[4];
+            auto before = thread_allocations();
+            for (auto& child : children) {
+                cs.add(child);
+            }
+            auto after = thread_allocations();
+            THEN("the children are stored inline"){
+                REQUIRE((after - before) == 0);
+            }
+        }
+        WHEN("5 children are added"){
+            rx::composite_subscription cs;
+            rx::composite_subscription children[5];
+            auto before = thread_allocations();
+            for (auto& child : children) {
+                cs.add(child);
+            }
+            auto after = thread_allocations();
+            THEN("the children spill into one heap allocation"){
+                REQUIRE((after - before) == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("subscribe allocations", "[subscription][allocations]"){
+    GIVEN("a range().map().filter() chain"){
+        auto chain = rx::observable<>::range(1, 3)
+            .map([](int i){return i * 2;})
+            .filter([](int i){return i > 2;});
+        int c = 0;
+        // warm up any static state
+        chain.subscribe([&](int){++c;});
+        WHEN("subscribed"){
+            auto before = thread_allocations();
+            chain.subscribe([&](int){++c;});
+            auto after = thread_allocations();
+            INFO("allocations per subscribe: " << (after - before));
+            THEN("the chain completes"){
+                REQUIRE(c == 4);
+            }
+            THEN("subscribe allocates the measured number of times"){
+#if RXCPP_USE_OBJECT_POOL
+                // the pool takes the subscriber lifetime, the schedulable
+                // and the action without an allocation
+                REQUIRE((after - before) == 4);
+#else
+                // this was 9 when the composite kept its state apart from the
+                // subscription and the action kept the range producer in a
+                // std::function. the subscriber lifetime is now one
+                // allocation and the producer is stored in its action. the
+                // rest are the current_thread queue, the schedulable and the
+                // action.
+                REQUIRE((after - before) == 7);
+#endif
+            }
+        }
+    }
+}
+
+namespace {
+// runs on current_thread and records whether each action function that it
+// is given is stored in place in its action
+class inline_probe : public rx::coordination_base
+{
+    typedef std::shared_ptr<std::vector<bool>> seen_type;
+
+    rxsc::scheduler factory;
+    seen_type seen;
+
+    class input_type
+    {
+        rxsc::worker controller;
+        rxsc::scheduler factory;
+        seen_type seen;
+    public:
+        input_type(rxsc::worker w, rxsc::scheduler sc, seen_type s)
+            : controller(std::move(w))
+            , factory(std::move(sc))
+            , seen(std::move(s))
+        {
+        }
+        inline rxsc::worker get_worker() const {
+            return controller;
+        }
+        inline rxsc::scheduler get_scheduler() const {
+            return factory;
+        }
+        inline rxsc::scheduler::clock_type::time_point now() const {
+            return factory.now();
+        }
+        template<class Observable>
+        auto in(Observable o) const
+            -> Observable {
+            return std::move(o);
+        }
+        template<class Subscriber>
+        auto out(Subscriber s) const
+            -> Subscriber {
+            return std::move(s);
+        }
+        template<class F>
+        auto act(F f) const
+            -> F {
+            seen->push_back(rxsc::detail::action_function::is_inline<F>());
+            return std::move(f);
+        }
+    };
+
+public:
+    explicit inline_probe(seen_type s)
+        : factory(rxsc::make_current_thread())
+        , seen(std::move(s))
+    {
+    }
+
+    typedef rx::coordinator<input_type> coordinator_type;
+
+    inline rxsc::scheduler::clock_type::time_point now() const {
+        return factory.now();
+    }
+
+    inline coordinator_type create_coordinator(rx::composite_subscription cs = rx::composite_subscription()) const {
+        auto w = factory.create_worker(std::move(cs));
+        return coordinator_type(input_type(std::move(w), factory, seen));
+    }
+};
+}
+
+SCENARIO("producers are stored in their action", "[subscription][action][allocations]"){
+    GIVEN("a coordination that records where each action function is stored"){
+        auto seen = std::make_shared<std::vector<bool>>();
+        inline_probe probe(seen);
+        int c = 0;
+        WHEN("a range().map().filter() chain is subscribed"){
+            rxs::range(1, 3, probe)
+                .map([](int i){return i * 2;})
+                .filter([](int i){return i > 2;})
+                .subscribe([&](int){++c;});
+            THEN("the range producer is stored in place"){
+                REQUIRE(c == 2);
+                REQUIRE(*seen == std::vector<bool>({true}));
+            }
+        }
+        WHEN("an iterate().map().take() chain is subscribed"){
+            rxs::iterate(std::vector<int>({1, 2, 3}), probe)
+                .map([](int i){return i * 2;})
+                .take(2)
+                .subscribe([&](int){++c;});
+            THEN("the iterate producer is stored in place"){
+                REQUIRE(c == 2);
+                REQUIRE(*seen == std::vector<bool>({true}));
+            }
+        }
+        WHEN("a range().observe_on().map() chain is subscribed"){
+            rxs::range(1, 3, probe)
+                .observe_on(probe)
+                .map([](int i){return i * 2;})
+                .as_dynamic()
+                .subscribe([&](int){++c;});
+            THEN("the range producer and the observe_on drain are stored in place"){
+                REQUIRE(c == 3);
+                REQUIRE(seen->size() >= 2);
+                REQUIRE(std::count(seen->begin(), seen->end(), false) == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("action allocations", "[subscription][action][allocations]"){
+    GIVEN("a current_thread worker"){
+        auto w = rxsc::make_current_thread().create_worker();
+        int ran = 0;
+        WHEN("an action with a small capture is made"){
+            auto keepAlive = std::make_shared<int>(0);
+            auto f = [&ran, keepAlive](const rxsc::schedulable&){++ran;};
+            auto before = thread_allocations();
+            auto a = rxsc::make_action(f);
+            auto after = thread_allocations();
+            THEN("the callable is stored in the action"){
+                REQUIRE(rxsc::detail::action_function::is_inline<decltype(f)>());
+#if RXCPP_USE_OBJECT_POOL
+                // the pool takes the action without an allocation
+                REQUIRE((after - before) == 0);
+#else
+                REQUIRE((after - before) == 1);
+#endif
+            }
+        }
+        WHEN("an action with a large capture is made"){
+            std::array<long long, 64> big = {};
+            auto f = [&ran, big](const rxsc::schedulable&){ran += static_cast<int>(big[0]) + 1;};
+            auto before = thread_allocations();
+            auto a = rxsc::make_action(f);
+            auto after = thread_allocations();
+            THEN("the callable is moved to the heap"){
+                REQUIRE(!rxsc::detail::action_function::is_inline<decltype(f)>());
+#if RXCPP_USE_OBJECT_POOL
+                REQUIRE((after - before) == 1);
+#else
+                REQUIRE((after - before) == 2);
+#endif
+            }
+            THEN("the action still runs"){
+                w.schedule(rxsc::make_schedulable(w, a));
+                REQUIRE(ran == 1);
+            }
+        }
+    }
+}
+
+namespace {
+// schedules a new action, capturing about what the range and observe_on
+// producers capture, until remaining reaches zero.
+struct schedule_next
+{
+    rxsc::worker w;
+    std::shared_ptr<int> keepAlive;
+    int* ran;
+    int remaining;
+    void operator()(const rxsc::schedulable&) const {
+        ++*ran;
+        if (remaining > 1) {
+            schedule_next next = {w, keepAlive, ran, remaining - 1};
+            w.schedule(next);
+        }
+    }
+};
+// the same with a capture that is larger than RXCPP_ACTION_INLINE_SIZE, so
+// it is moved to the heap.
+struct schedule_next_spilled
+{
+    rxsc::worker w;
+    int* ran;
+    int remaining;
+    std::array<char, RXCPP_ACTION_INLINE_SIZE> pad;
+    void operator()(const rxsc::schedulable&) const {
+        ++*ran;
+        if (remaining > 1) {
+            schedule_next_spilled next = {w, ran, remaining - 1, pad};
+            w.schedule(next);
+        }
+    }
+};
+// the same with a small capture.
+struct schedule_next_small
+{
+    const rxsc::worker* w;
+    int* ran;
+    int remaining;
+    void operator()(const rxsc::schedulable&) const {
+        ++*ran;
+        if (remaining > 1) {
+            schedule_next_small next = {w, ran, remaining - 1};
+            w->schedule(next);
+        }
+    }
+};
+
+template<class Next>
+void report_schedule_cost(const char* name, const rxsc::worker& w, Next first, int* ran, int count) {
+    using namespace std::chrono;
+    typedef steady_clock clock;
+
+    auto start = clock::now();
+    auto allocations = thread_allocations();
+    w.schedule(first);
+    allocations = thread_allocations() - allocations;
+    auto msElapsed = duration_cast<milliseconds>(clock::now() - start);
+    std::cout << "action schedule " << name << " (" << sizeof(Next) << " bytes, " << (rxsc::detail::action_function::is_inline<Next>() ? "inline" : "heap") << ") : " << count << " actions, " << msElapsed.count() << "ms elapsed, " << count / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec, " << double(allocations) / count << " allocations per schedule" << std::endl;
+    REQUIRE(*ran == count);
+}
+}
+
+SCENARIO("action schedule cost", "[hide][subscription][action][long][perf]"){
+    GIVEN("the current_thread scheduler"){
+        const int count = 1000000;
+        auto w = rxsc::make_current_thread().create_worker();
+        int ran = 0;
+        WHEN("each action schedules the next with a small capture"){
+            schedule_next_small first = {&w, &ran, count};
+            report_schedule_cost("small capture", w, first, &ran, count);
+        }
+        WHEN("each action schedules the next with a producer sized capture"){
+            schedule_next first = {w, std::make_shared<int>(0), &ran, count};
+            report_schedule_cost("producer capture", w, first, &ran, count);
+        }
+        WHEN("each action schedules the next with a capture that is too large"){
+            schedule_next_spilled first = {w, &ran, count, {}};
+            report_schedule_cost("spilled capture", w, first, &ran, count);
+        }
+    }
+}
+
+SCENARIO("subscribe with an arena", "[subscription][arena][allocations]"){
+    GIVEN("a range().map().filter() chain"){
+        auto chain = rx::observable<>::range(1, 3)
+            .map([](int i){return i * 2;})
+            .filter([](int i){return i > 2;});
+        int c = 0;
+        // warm up any static state
+        chain.subscribe([&](int){++c;});
+        WHEN("subscribed with a subscription_arena"){
+            auto without = thread_allocations();
+            chain.subscribe([&](int){++c;});
+            without = thread_allocations() - without;
+            auto with = thread_allocations();
+            chain.subscribe(rx::subscription_arena(), [&](int){++c;});
+            with = thread_allocations() - with;
+            INFO("allocations per subscribe: " << without << " without an arena, " << with << " with an arena");
+            THEN("the chain completes"){
+                REQUIRE(c == 6);
+            }
+            THEN("the arena is released when the chain completes"){
+                auto live = rxcpp::detail::arena::live();
+                chain.subscribe(rx::subscription_arena(), [&](int){++c;});
+                REQUIRE(rxcpp::detail::arena::live() == live);
+            }
+            THEN("the subscription state comes from the arena"){
+#if RXCPP_USE_OBJECT_POOL
+                // the pool already takes the state without an allocation, so
+                // the arena saves nothing
+                REQUIRE(with == without);
+#else
+                REQUIRE(with < without);
+#endif
+            }
+        }
+    }
+    GIVEN("a subject"){
+        rx::subjects::subject<int> sub;
+        std::vector<int> values;
+        bool completed = false;
+        WHEN("a chain is subscribed with a subscription_arena and the values arrive later"){
+            auto lifetime = sub.get_observable()
+                .map([](int i){return i * 2;})
+                .filter([](int i){return i > 2;})
+                .subscribe(
+                    rx::subscription_arena(),
+                    [&](int v){values.push_back(v);},
+                    [&](){completed = true;});
+            auto o = sub.get_subscriber();
+            o.on_next(1);
+            o.on_next(2);
+            o.on_next(3);
+            THEN("the arena outlives the subscribe call"){
+                REQUIRE(lifetime.is_subscribed());
+                o.on_completed();
+                REQUIRE(completed);
+                REQUIRE(values == std::vector<int>({4, 6}));
+            }
+            THEN("the arena is released with the subscription"){
+                auto live = rxcpp::detail::arena::live();
+                REQUIRE(live >= 1);
+                lifetime.unsubscribe();
+                o.on_next(4);
+                REQUIRE(values == std::vector<int>({4, 6}));
+                // the subject lets go of unsubscribed observers when it completes
+                o.on_completed();
+                REQUIRE(!completed);
+                lifetime = rx::composite_subscription();
+                REQUIRE(rxcpp::detail::arena::live() == live - 1);
+            }
+        }
+    }
+    GIVEN("a subject and a chain that subscribes to it from on_next"){
+        rx::subjects::subject<int> sub;
+        std::vector<rx::composite_subscription> nested;
+        WHEN("the chain is subscribed with a subscription_arena and completes in subscribe"){
+            auto live = rxcpp::detail::arena::live();
+            rx::observable<>::range(1, 3)
+                .map([](int i){return i * 2;})
+                .subscribe(
+                    rx::subscription_arena(),
+                    [&](int){
+                        nested.push_back(sub.get_observable().subscribe([](int){}));
+                    });
+            THEN("the nested subscriptions do not hold on to the arena"){
+                REQUIRE(nested.size() == 3);
+                REQUIRE(nested.back().is_subscribed());
+                REQUIRE(rxcpp::detail::arena::live() == live);
+            }
+            for (auto& n : nested) {
+                n.unsubscribe();
+            }
+        }
+    }
+    GIVEN("an arena that is too small for the subscription"){
+        int c = 0;
+        WHEN("subscribed"){
+            rx::observable<>::range(1, 100)
+                .map([](int i){return i * 2;})
+                .subscribe(rx::subscription_arena(16), [&](int){++c;});
+            THEN("the state that does not fit is allocated from the heap"){
+                REQUIRE(c == 100);
+            }
+        }
+    }
+}
+
+SCENARIO("event_loop schedule allocations", "[event_loop][scheduler][allocations]"){
+    GIVEN("an event_loop in each placement mode"){
+        auto schedule_allocations = [](rxsc::event_loop::placement p) {
+            rxsc::event_loop::config c;
+            c.thread_count = 1;
+            c.mode = p;
+            rxsc::scheduler sc(std::static_pointer_cast<rxsc::scheduler_interface>(std::make_shared<rxsc::event_loop>(c)));
+            auto w = sc.create_worker();
+            std::atomic<int> ran(0);
+            auto a = rxsc::make_action([&ran](const rxsc::schedulable&){++ran;});
+            auto scbl = rxsc::make_schedulable(w, a);
+            auto before = thread_allocations();
+            for (int i = 0; i != 100; ++i) {
+                w.schedule(scbl);
+            }
+            auto after = thread_allocations();
+            while (ran != 100) {
+                std::this_thread::yield();
+            }
+            w.unsubscribe();
+            return after - before;
+        };
+        WHEN("100 actions are scheduled"){
+            auto round_robin = schedule_allocations(rxsc::event_loop::round_robin);
+            auto least_loaded = schedule_allocations(rxsc::event_loop::least_loaded);
+            INFO("round_robin " << round_robin << ", least_loaded " << least_loaded);
+            THEN("counting the queue depth does not allocate"){
+                REQUIRE(least_loaded == round_robin);
+            }
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#include "rxcpp/rx.hpp"
+namespace rx=rxcpp;
+
+#include "catch.hpp"
+
+#if RXCPP_USE_THREAD_LOCAL
+
+namespace {
+
+template<int Tag>
+struct pooled_value
+{
+    explicit pooled_value(int v) : value(v) {}
+    int value;
+    // give each tag a size class of its own
+    char pad[512 + (Tag * 16)];
+};
+
+template<class T>
+std::shared_ptr<T> make_from_pool(int v) {
+    return std::allocate_shared<T>(rx::detail::pool_allocator<T>(), v);
+}
+
+}
+
+SCENARIO("pool reuses blocks on the same thread", "[pool][allocations]"){
+    GIVEN("a pooled object"){
+        typedef pooled_value<1> value_type;
+        auto first = make_from_pool<value_type>(1);
+        const void* address = first.get();
+        WHEN("it is released and another is made"){
+            first.reset();
+            auto second = make_from_pool<value_type>(2);
+            THEN("the block is reused"){
+                REQUIRE(second.get() == address);
+                REQUIRE(second->value == 2);
+            }
+        }
+    }
+}
+
+SCENARIO("pool returns blocks freed on another thread", "[pool][allocations]"){
+    GIVEN("a pooled object released on another thread"){
+        typedef pooled_value<2> value_type;
+        auto first = make_from_pool<value_type>(1);
+        const void* address = first.get();
+        std::thread([&](){
+            first.reset();
+        }).join();
+        WHEN("the owning thread makes another"){
+            auto second = make_from_pool<value_type>(2);
+            THEN("the remote block is reused by the owner"){
+                REQUIRE(second.get() == address);
+                REQUIRE(second->value == 2);
+            }
+        }
+    }
+}
+
+SCENARIO("pool outlives the allocating thread", "[pool][allocations]"){
+    GIVEN("pooled objects made on a thread that has exited"){
+        typedef pooled_value<3> value_type;
+        std::vector<std::shared_ptr<value_type>> values;
+        std::thread([&](){
+            for (int i = 0; i < 10; ++i) {
+                values.push_back(make_from_pool<value_type>(i));
+            }
+        }).join();
+        WHEN("they are released and a new thread makes more"){
+            values.clear();
+            std::thread([&](){
+                for (int i = 0; i < 10; ++i) {
+                    values.push_back(make_from_pool<value_type>(i));
+                }
+            }).join();
+            THEN("the values are intact"){
+                int expected = 0;
+                for (auto& v : values) {
+                    REQUIRE(v->value == expected++);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("pooled cross-thread notifications", "[hide][pool][notification][long][perf]"){
+    GIVEN("a producer and a consumer thread"){
+        WHEN("notifications are made on the producer and freed on the consumer"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+            typedef rxcpp::notifications::notification<int> notification_type;
+            typedef notification_type::type base_type;
+
+            const int values = 1000000;
+            const int batch = 256;
+
+            auto run = [&](const char* label, std::function<base_type(int)> make) {
+                std::mutex lock;
+                std::condition_variable wake;
+                std::deque<std::vector<base_type>> handoff;
+                bool done = false;
+                auto start = clock::now();
+                std::thread consumer([&](){
+                    for (;;) {
+                        std::unique_lock<std::mutex> guard(lock);
+                        wake.wait(guard, [&](){return done || !handoff.empty();});
+                        if (handoff.empty()) {
+                            break;
+                        }
+                        auto next = std::move(handoff.front());
+                        handoff.pop_front();
+                        guard.unlock();
+                        // notifications are freed here
+                    }
+                });
+                std::vector<base_type> pending;
+                for (int i = 0; i < values; ++i) {
+                    pending.push_back(make(i));
+                    if (pending.size() == batch) {
+                        std::unique_lock<std::mutex> guard(lock);
+                        handoff.push_back(std::move(pending));
+                        pending.clear();
+                        wake.notify_one();
+                    }
+                }
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    done = true;
+                    wake.notify_one();
+                }
+                consumer.join();
+                auto finish = clock::now();
+                auto msElapsed = duration_cast<milliseconds>(finish-start);
+                std::cout << label << values << " notifications, " << msElapsed.count() << "ms elapsed, " << values / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+            };
+
+            struct on_next : public rxcpp::notifications::detail::notification_base<int>
+            {
+                explicit on_next(int v) : value(v) {}
+                virtual void out(std::ostream&) const {}
+                virtual bool equals(const type&) const {return false;}
+                virtual void accept(const observer_type& o) const {o.on_next(value);}
+                int value;
+            };
+
+            for (int runs = 0; runs < 3; ++runs) {
+                run("make_shared notifications : ", [](int v) -> base_type {
+                    return std::make_shared<on_next>(v);
+                });
+                run("pooled notifications      : ", [](int v) -> base_type {
+                    return std::allocate_shared<on_next>(rx::detail::pool_allocator<on_next>(), v);
+                });
+            }
+        }
+    }
+}
+
+#endif
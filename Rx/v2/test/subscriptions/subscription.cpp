@@ -52,6 +52,55 @@ SCENARIO("for loop subscribes to map", "[hide][for][just][subscribe][long][perf]
     }
 }
 
+SCENARIO("for loop subscribes to map with an arena", "[hide][for][just][subscribe][arena][long][perf]"){
+    const int& subscriptions = static_subscriptions;
+    GIVEN("a for loop"){
+        WHEN("subscribe 100K times with and without a subscription_arena"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            auto sc = rxsc::make_current_thread();
+            auto w = sc.create_worker();
+            int runs = 10;
+
+            auto loop = [&](const rxsc::schedulable& self) {
+                auto source = rx::observable<>::just(1)
+                    .map([](int i) {
+                        return i + 1;
+                    })
+                    .filter([](int i) {
+                        return i > 1;
+                    })
+                    .take(1);
+
+                int c = 0;
+                auto start = clock::now();
+                for (int i = 0; i < subscriptions; i++) {
+                    source.subscribe([&](int){++c;});
+                }
+                auto finish = clock::now();
+                auto msElapsed = duration_cast<milliseconds>(finish-start);
+                std::cout << "loop subscribe                 : " << subscriptions << " subscribed, " << msElapsed.count() << "ms elapsed, " << subscriptions / (msElapsed.count() / 1000.0) << " ops/sec" << std::endl;
+
+                c = 0;
+                start = clock::now();
+                for (int i = 0; i < subscriptions; i++) {
+                    source.subscribe(rx::subscription_arena(), [&](int){++c;});
+                }
+                finish = clock::now();
+                msElapsed = duration_cast<milliseconds>(finish-start);
+                std::cout << "loop subscribe arena           : " << subscriptions << " subscribed, " << msElapsed.count() << "ms elapsed, " << subscriptions / (msElapsed.count() / 1000.0) << " ops/sec" << std::endl;
+
+                if (--runs > 0) {
+                    self();
+                }
+            };
+
+            w.schedule(loop);
+        }
+    }
+}
+
 SCENARIO("for loop subscribes to combine_latest", "[hide][for][just][combine_latest][subscribe][long][perf]"){
     const int& subscriptions = static_subscriptions;
     GIVEN("a for loop"){
@@ -439,3 +488,224 @@ SCENARIO("subscription composite", "[subscription]"){
     }
 }
 
+
+SCENARIO("subscription composite remove", "[subscription]"){
+    GIVEN("given a subscription"){
+        int i=0;
+        rx::composite_subscription s;
+        auto first = s.add([&i](){++i;});
+        auto second = s.add([&i](){i += 10;});
+        WHEN("one child is removed"){
+            s.remove(first);
+            THEN("the removed child is not unsubscribed"){
+                REQUIRE(i == 0);
+            }
+            THEN("only the remaining child is unsubscribed"){
+                s.unsubscribe();
+                REQUIRE(i == 10);
+            }
+            THEN("removing twice is harmless"){
+                s.remove(first);
+                s.unsubscribe();
+                REQUIRE(i == 10);
+            }
+            THEN("the slot is reused and a stale token does not remove the new child"){
+                s.add([&i](){i += 100;});
+                s.remove(first);
+                s.unsubscribe();
+                REQUIRE(i == 110);
+            }
+        }
+        WHEN("cleared and refilled"){
+            s.clear();
+            THEN("a token from before the clear does not remove a new child"){
+                s.add([&i](){i += 100;});
+                s.remove(first);
+                s.unsubscribe();
+                REQUIRE(i == 111);
+            }
+        }
+        WHEN("the same child is added twice"){
+            int k = 0;
+            auto child = rx::make_subscription([&k](){++k;});
+            auto one = s.add(child);
+            auto two = s.add(child);
+            THEN("each add returns its own token"){
+                REQUIRE(one.index != two.index);
+            }
+            THEN("removing one token leaves the other child in place"){
+                s.remove(one);
+                s.unsubscribe();
+                REQUIRE(k == 1);
+            }
+            THEN("both tokens must be removed to remove the child"){
+                s.remove(one);
+                s.remove(two);
+                s.unsubscribe();
+                REQUIRE(k == 0);
+            }
+            THEN("the child is unsubscribed once"){
+                s.unsubscribe();
+                REQUIRE(k == 1);
+            }
+        }
+        WHEN("a token from another composite is removed"){
+            rx::composite_subscription other;
+            auto foreign = other.add([&i](){i += 100;});
+            s.remove(foreign);
+            THEN("the child in the same slot is still unsubscribed"){
+                s.unsubscribe();
+                REQUIRE(i == 11);
+            }
+            THEN("the other composite still owns its child"){
+                other.unsubscribe();
+                REQUIRE(i == 100);
+            }
+        }
+        WHEN("all children are removed"){
+            s.remove(first);
+            s.remove(second);
+            THEN("unsubscribe does not call them"){
+                s.unsubscribe();
+                REQUIRE(i == 0);
+            }
+        }
+        WHEN("added after unsubscribe"){
+            s.unsubscribe();
+            THEN("the child is unsubscribed immediately"){
+                s.add([&i](){i += 1000;});
+                REQUIRE(i == 1011);
+            }
+        }
+    }
+}
+
+SCENARIO("subscription deep composite", "[subscription]"){
+    GIVEN("a chain of 100K nested composite_subscriptions"){
+        const int depth = 100000;
+        int i = 0;
+        rx::composite_subscription root;
+        {
+            auto cursor = root;
+            for (int level = 0; level < depth; ++level) {
+                rx::composite_subscription next;
+                next.add([&i](){++i;});
+                cursor.add(next);
+                cursor = next;
+            }
+        }
+        WHEN("the root is unsubscribed"){
+            root.unsubscribe();
+            THEN("every level is unsubscribed before unsubscribe returns"){
+                REQUIRE(i == depth);
+            }
+        }
+    }
+    GIVEN("a deep chain with a child that unsubscribes an unrelated composite"){
+        const int depth = 1000;
+        rx::composite_subscription root;
+        rx::composite_subscription other;
+        bool otherChild = false;
+        bool seenInCallback = false;
+        other.add([&](){otherChild = true;});
+        {
+            auto cursor = root;
+            for (int level = 0; level < depth; ++level) {
+                rx::composite_subscription next;
+                cursor.add(next);
+                cursor = next;
+            }
+            cursor.add([&](){
+                other.unsubscribe();
+                seenInCallback = otherChild;
+            });
+        }
+        WHEN("the root is unsubscribed"){
+            root.unsubscribe();
+            THEN("the unrelated composite unsubscribed its children before returning"){
+                REQUIRE(seenInCallback);
+            }
+        }
+    }
+}
+
+SCENARIO("deep composite_subscription teardown", "[hide][subscription][composite][teardown][long][perf]"){
+    GIVEN("a tree of 1M composite_subscriptions"){
+        WHEN("the root is unsubscribed"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int nodes = 1000000;
+            const int fanout = 4;
+
+            int runs = 5;
+            for (; runs > 0; --runs) {
+                int c = 0;
+                rx::composite_subscription root;
+                {
+                    // each node gets a leaf and up to fanout-1 composite children,
+                    // filled breadth first
+                    std::deque<rx::composite_subscription> parents(1, root);
+                    for (int n = 1; n < nodes; ++n) {
+                        rx::composite_subscription next;
+                        next.add([&c](){++c;});
+                        parents.front().add(next);
+                        parents.push_back(next);
+                        if (n % (fanout - 1) == 0) {
+                            parents.pop_front();
+                        }
+                    }
+                }
+                // and a chain as deep as the tree is large
+                {
+                    auto cursor = root;
+                    for (int n = 0; n < nodes; ++n) {
+                        rx::composite_subscription next;
+                        cursor.add(next);
+                        cursor = next;
+                    }
+                }
+                auto start = clock::now();
+                root.unsubscribe();
+                auto finish = clock::now();
+                auto msElapsed = duration_cast<milliseconds>(finish-start);
+                std::cout << "teardown 2M composites : " << c << " leaves unsubscribed, " << msElapsed.count() << "ms elapsed, " << (2.0 * nodes) / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " nodes/sec" << std::endl;
+            }
+        }
+    }
+}
+
+SCENARIO("composite_subscription add/remove contention", "[hide][subscription][composite][long][perf]"){
+    GIVEN("a composite_subscription"){
+        WHEN("1 to 64 threads add and remove children concurrently"){
+            using namespace std::chrono;
+            typedef steady_clock clock;
+
+            const int operations = 100000;
+
+            for (int threads = 1; threads <= 64; threads *= 2) {
+                rx::composite_subscription cs;
+                std::atomic<bool> go(false);
+                std::vector<std::thread> workers;
+                for (int t = 0; t < threads; ++t) {
+                    workers.push_back(std::thread([&](){
+                        auto child = rx::make_subscription([](){});
+                        while (!go);
+                        for (int i = 0; i < operations; ++i) {
+                            cs.remove(cs.add(child));
+                        }
+                    }));
+                }
+                auto start = clock::now();
+                go = true;
+                for (auto& w : workers) {
+                    w.join();
+                }
+                auto finish = clock::now();
+                auto msElapsed = duration_cast<milliseconds>(finish-start);
+                auto ops = static_cast<double>(operations) * threads;
+                std::cout << "composite add/remove " << std::setw(2) << threads << " threads : " << ops << " add+remove pairs, " << msElapsed.count() << "ms elapsed, " << ops / (std::max<long long>(msElapsed.count(), 1) / 1000.0) << " ops/sec" << std::endl;
+            }
+        }
+    }
+}